@@ -25,6 +25,13 @@
    define SD_DEBUG_MSVC to enable non-portable Visual C++ memory leak detection.
    define SD_DEBUG_GCC to enablbe non-portable GCC debugging.
    define NDEBUG to disable assertions. 
+
+   Build options:
+   define SD_NO_SIMD to use only the portable scalar loops in the packed array kernels, even where SSE2 or AVX2 is
+   available.
+   define SD_NO_THREADS to leave out the locks and thread-local storage that let separate Sad instances run on
+   separate threads. compilers that aren't recognized in the SdMutex section below get this build automatically; it
+   must only be used from one thread.
 */
 
 #ifdef __cplusplus
@@ -53,11 +60,53 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
+#include <float.h>
+#include <time.h>
+
+#if !defined(SD_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SD_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+/* AVX2 isn't part of any baseline, so it is only compiled where individual functions can target it and the CPU can be
+   checked at runtime */
+#if !defined(SD_NO_SIMD) && !defined(__TINYC__) && (defined(__x86_64__) || defined(__i386__)) && \
+   (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SD_SIMD_AVX2
+#define SD_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif !defined(SD_NO_SIMD) && defined(_MSC_VER) && _MSC_VER >= 1700 && (defined(_M_X64) || defined(_M_IX86))
+#define SD_SIMD_AVX2
+#define SD_AVX2_TARGET
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+/* threads are supported where the compiler has a thread-local storage class and the platform's locks are known */
+#if !defined(SD_NO_THREADS) && defined(_WIN32) && ((defined(_MSC_VER) && _MSC_VER >= 1600) || defined(__GNUC__))
+#define SD_THREADS_WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600 /* SRWLOCK */
+#endif
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif !defined(SD_NO_THREADS) && !defined(_WIN32) && defined(__GNUC__) && !defined(__TINYC__) && \
+   !defined(__EMSCRIPTEN__)
+#define SD_THREADS_PTHREAD
+#include <pthread.h>
+#endif
 
 #ifdef _MSC_VER
 #pragma warning(pop) /* start showing warnings again */
 #endif
 
+/* the shortest double formatter does its arithmetic in 64 bits, and C89's only chance at that is unsigned long */
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define SD_FORMAT_GRISU
+#endif
+
 #include "sad-script.h"
 
 #ifdef _MSC_VER
@@ -66,6 +115,27 @@
 #pragma warning(disable: 4711) /* function '...' selected for automatic inline expansion */
 #endif
 
+/* the platform's lock and thread-local storage class. without threads there is nothing to lock and one copy of each 
+   thread-local variable. */
+#if defined(SD_THREADS_WIN32)
+typedef SRWLOCK SdMutex;
+#define SdMutex_INIT SRWLOCK_INIT
+#elif defined(SD_THREADS_PTHREAD)
+typedef pthread_mutex_t SdMutex;
+#define SdMutex_INIT PTHREAD_MUTEX_INITIALIZER
+#else
+typedef int SdMutex;
+#define SdMutex_INIT 0
+#endif
+
+#if defined(SD_THREADS_WIN32) && defined(_MSC_VER)
+#define SD_THREAD_LOCAL __declspec(thread)
+#elif defined(SD_THREADS_WIN32) || defined(SD_THREADS_PTHREAD)
+#define SD_THREAD_LOCAL __thread
+#else
+#define SD_THREAD_LOCAL
+#endif
+
 /* run the garbage collector after we've allocated this many bytes since the last GC. 67,108,864 bytes = 64MB */
 #define SdEngine_ALLOCATED_BYTES_PER_GC 67108864
 
@@ -98,6 +168,7 @@ Env: ------------+-------------------------+---------------------+--------------
 Ast: ------------+-------------------------+---------------------+----------------------+---------------|-------------
 (list PROGRAM    | Lst<Function>           | Lst<Statement>)     |                      |               |
 (list FUNCTION 1)name:Str 2)params:Lst<Param> 3)Body 4)imported:Bool 5)var-args:Bool 6)return-types:Lst<VarRef>
+                7)generator:Bool
 (list PARAMETER  | name:Str                | types:Lst<VarRef>)  |                      |               |
 Statements: -----+-------------------------+---------------------+----------------------+---------------|-------------
 (list CALL       | function-name:VarRef    | args:Lst<Expr>)     |                      |               |
@@ -113,6 +184,7 @@ Statements: -----+-------------------------+---------------------+--------------
 (list SWITCH     | Lst<Expr>               | Lst<SwitchCase>     | default:Body)        |               | 
 (list RETURN     | Expr)                   |                     |                      |               | 
 (list DIE        | Expr)                   |                     |                      |               | 
+(list YIELD      | Expr)                   |                     |                      |               | 
 Exprs: ----------+-------------------------+---------------------+----------------------+---------------|-------------
 (list INT_LIT    | Int)                    |                     |                      |               | 
 (list DOUBLE_LIT | Double)                 |                     |                      |               | 
@@ -132,12 +204,37 @@ Exprs: ----------+-------------------------+---------------------+--------------
 
 /*********************************************************************************************************************/
 typedef struct SdSearchResult_s SdSearchResult;
+typedef struct SdEngineSearch_s SdEngineSearch;
+typedef struct SdRange_s SdRange;
+typedef struct SdIterator_s SdIterator;
+typedef struct SdIterator_s* SdIterator_r;
+typedef struct SdArray_s SdArray;
+typedef struct SdArray_s* SdArray_r;
+typedef struct SdAppendBuffer_s SdAppendBuffer;
+typedef struct SdAppendBuffer_s* SdAppendBuffer_r;
 typedef struct SdStringBuf_s SdStringBuf;
 typedef struct SdStringBuf_s* SdStringBuf_r;
+typedef struct SdOutput_s SdOutput;
+typedef struct SdOutput_s* SdOutput_r;
+typedef struct SdSharedValue_s SdSharedValue;
+typedef struct SdSharedValue_s* SdSharedValue_r;
+typedef struct SdSharedEntry_s SdSharedEntry;
+typedef struct SdSharedEntry_s* SdSharedEntry_r;
+typedef struct SdSharedMapStripe_s SdSharedMapStripe;
+typedef struct SdSharedMapStripe_s* SdSharedMapStripe_r;
+typedef struct SdSharedMapBinding_s SdSharedMapBinding;
+typedef struct SdSharedMapBinding_s* SdSharedMapBinding_r;
+typedef struct SdLineReader_s SdLineReader;
+typedef struct SdLineReader_s* SdLineReader_r;
+#ifdef SD_FORMAT_GRISU
+typedef struct SdDiyFp_s SdDiyFp;
+#endif
 typedef struct SdEnv_s SdEnv;
 typedef struct SdEnv_s* SdEnv_r;
 typedef struct SdValueSet_s SdValueSet;
 typedef struct SdValueSet_s* SdValueSet_r;
+typedef struct SdInternTable_s SdInternTable;
+typedef struct SdInternTable_s* SdInternTable_r;
 typedef struct SdChain_s SdChain;
 typedef struct SdChain_s* SdChain_r;
 typedef struct SdChainNode_s SdChainNode;
@@ -148,6 +245,8 @@ typedef struct SdScanner_s SdScanner;
 typedef struct SdScanner_s* SdScanner_r;
 typedef struct SdEngine_s SdEngine;
 typedef struct SdEngine_s* SdEngine_r;
+typedef struct SdHeap_s SdHeap;
+typedef struct SdHeap_s* SdHeap_r;
 typedef struct SdValuePage_s SdValuePage;
 typedef struct SdValuePage_s* SdValuePage_r;
 typedef struct SdListPage_s SdListPage;
@@ -204,6 +303,7 @@ typedef enum SdTokenType_e {
    SdTokenType_DEFAULT,
    SdTokenType_RETURN,
    SdTokenType_DIE,
+   SdTokenType_YIELD,
    SdTokenType_IMPORT,
    SdTokenType_NIL,
    SdTokenType_LAMBDA,
@@ -251,6 +351,7 @@ typedef enum SdNodeType_e {
    SdNodeType_SWITCH,
    SdNodeType_RETURN,
    SdNodeType_DIE,
+   SdNodeType_YIELD,
 
    /* Sub-components */
    SdNodeType_ELSEIF,
@@ -263,17 +364,57 @@ typedef enum SdNodeType_e {
    SdNodeType_EXPRESSIONS_FIRST = SdNodeType_FUNCTION,
    SdNodeType_EXPRESSIONS_LAST = SdNodeType_CALL,
    SdNodeType_STATEMENTS_FIRST = SdNodeType_CALL,
-   SdNodeType_STATEMENTS_LAST = SdNodeType_DIE
+   SdNodeType_STATEMENTS_LAST = SdNodeType_YIELD
 } SdNodeType;
 
+struct SdRange_s { /* the integers from low to high, inclusive. (... low) with no upper bound runs to INT_MAX. */
+   int low;
+   int high;
+};
+
 typedef union SdValueUnion_u {
    int int_value;
    SdString* string_value;
    SdBool bool_value;
    double double_value;
    SdList* list_value;
+   SdArray* array_value;
+   SdIterator* iterator_value;
+   SdRange range_value;
+   SdSharedMap* shared_map_value;
 } SdValueUnion;
 
+typedef union SdArrayElementsUnion_u {
+   int* ints;
+   double* doubles;
+} SdArrayElementsUnion;
+
+typedef enum SdArrayOp_e {
+   SdArrayOp_ADD,
+   SdArrayOp_SUBTRACT,
+   SdArrayOp_MULTIPLY,
+   SdArrayOp_DIVIDE
+} SdArrayOp;
+
+typedef enum SdStreamStage_e {
+   SdStreamStage_MAP,
+   SdStreamStage_FILTER,
+   SdStreamStage_TAKE,
+   SdStreamStage_SKIP
+} SdStreamStage;
+
+typedef enum SdIteratorKind_e {
+   SdIteratorKind_INDEXABLE, /* list, mutalist, vector, or packed array */
+   SdIteratorKind_STRING, /* one-character strings */
+   SdIteratorKind_HASHMAP, /* (list key value) pairs, walked in place in the trie */
+   SdIteratorKind_FUNCTION, /* fallback for stream functions: call the iterator closure until it returns nil */
+   SdIteratorKind_ITERATOR, /* pull from another Iterator value, such as a generator */
+   SdIteratorKind_GENERATOR, /* resume the generator's suspended body up to its next yield */
+   SdIteratorKind_FILE_LINES /* read the next line from the iterator's SdLineReader */
+} SdIteratorKind;
+
+#define SdIterator_MAX_HASHMAP_DEPTH 8 /* trie levels at shifts 0, 5, ..., 30, plus the collision buckets */
+
 typedef union SdListValuesUnion_u {
    Sd1ElementArray* array_1;
    Sd2ElementArray* array_2;
@@ -282,22 +423,106 @@ typedef union SdListValuesUnion_u {
    SdValue_r* array_n;
 } SdListValuesUnion;
 
+struct SdHeap_s { /* the slab pages and GC trigger of one Sad instance, or of a thread outside of any; see SdHeap_Get */
+   SdValuePage* value_pages_open;
+   SdValuePage* value_pages_full;
+   SdListPage* list_pages_open;
+   SdListPage* list_pages_full;
+   Sd1ElementArrayPage* array_1_pages_open;
+   Sd1ElementArrayPage* array_1_pages_full;
+   Sd2ElementArrayPage* array_2_pages_open;
+   Sd2ElementArrayPage* array_2_pages_full;
+   Sd3ElementArrayPage* array_3_pages_open;
+   Sd3ElementArrayPage* array_3_pages_full;
+   Sd4ElementArrayPage* array_4_pages_open;
+   Sd4ElementArrayPage* array_4_pages_full;
+   size_t bytes_allocated_since_last_gc;
+};
+
 struct Sad_s {
+   SdHeap heap;
    SdEnv* env;
    SdEngine* engine;
+   SdOutput* output;
 };
 
+#define SdString_INLINE_CAPACITY 16 /* strings this long or shorter, counting the null terminator, are stored inline */
+
 struct SdString_s {
-   char* buffer; /* includes null terminator */
+   char* buffer; /* includes null terminator. null while the characters are in append_buffer instead. */
+   SdAppendBuffer* append_buffer; /* set for strings made by concatenation or substring; see SdString_Concat */
+   size_t offset; /* where this string's characters start in append_buffer */
    size_t length; /* not including null terminator */
+   SdBool is_interned; /* whether this is the canonical copy of its contents in the env's intern table */
+   SdBool has_hash; /* whether hash has been computed yet */
+   int hash; /* memoized SdValue_Hash of this string */
+   char inline_chars[SdString_INLINE_CAPACITY]; /* buffer points here for short strings, saving an allocation */
 #if defined(SD_DEBUG_ALL) || defined(SD_DEBUG_GC)
    SdBool is_boxed; /* whether this string has been boxed already */
 #endif
 };
 
+struct SdAppendBuffer_s { /* characters shared by a string, the strings appended onto it, and substrings of them */
+   char* chars; /* null-terminated after the longest string using the buffer */
+   size_t length; /* length of the longest string using the buffer */
+   size_t capacity;
+   int num_strings; /* freed when the last string using it is deleted */
+};
+
+#ifdef SD_FORMAT_GRISU
+struct SdDiyFp_s { /* f * 2^e, a "do-it-yourself" floating point number with a 64-bit significand */
+   unsigned long f;
+   int e;
+};
+#endif
+
 struct SdStringBuf_s {
    char* str;
    size_t len;
+   size_t capacity; /* allocated size of str, including room for the null terminator */
+};
+
+#define SdOutput_DEFAULT_BUFFER_SIZE 65536
+
+struct SdOutput_s { /* where print sends its text */
+   char* buffer;
+   size_t length;
+   size_t capacity; /* zero when unbuffered */
+   SdOutputSink sink; /* null to write to stdout */
+   void* sink_context;
+};
+
+struct SdSharedValue_s { /* a copy of a nil, int, double, bool, or string that belongs to no SdEnv */
+   SdType type;
+   SdValueUnion payload; /* the string, if any, is owned */
+};
+
+struct SdSharedEntry_s {
+   unsigned int hash;
+   SdSharedValue key;
+   SdSharedValue value;
+   SdSharedEntry* next; /* in the same bucket */
+};
+
+#define SdSharedMap_STRIPE_COUNT 16 /* a power of two */
+
+struct SdSharedMapStripe_s { /* the keys whose hashes select this stripe, behind a lock of their own */
+   SdMutex lock;
+   SdSharedEntry** buckets;
+   size_t bucket_count; /* a power of two */
+   size_t count;
+};
+
+struct SdSharedMap_s {
+   SdSharedMapStripe stripes[SdSharedMap_STRIPE_COUNT];
+   SdMutex ref_lock;
+   size_t ref_count; /* the host's reference, if not yet given up, plus one per binding and per SharedMap value */
+};
+
+struct SdSharedMapBinding_s { /* a name by which (shared-map name) finds a map */
+   SdString* name;
+   SdSharedMap* map; /* holds a reference */
+   SdSharedMapBinding* next;
 };
 
 struct SdValue_s {
@@ -308,13 +533,23 @@ struct SdValue_s {
 
 struct SdList_s {
    size_t count;
+   size_t capacity; /* number of elements the current storage can hold before it must grow */
    SdListValuesUnion values;
    SdBool is_read_only;
+   SdBool has_hash; /* whether hash has been memoized; only for read-only lists of values that can't change */
+   int hash;
 #if defined(SD_DEBUG_ALL) || defined(SD_DEBUG_GC)
    SdBool is_boxed; /* whether this list has been boxed already */
 #endif
 };
 
+struct SdArray_s {
+   SdType element_type; /* SdType_INT or SdType_DOUBLE */
+   size_t count;
+   size_t capacity;
+   SdArrayElementsUnion elements;
+};
+
 struct SdSearchResult_s {
    size_t index; /* could be one past the end of the list if search name > everything */
    SdBool exact; /* true = index is an exact match, false = index is the next highest match */
@@ -342,12 +577,21 @@ struct SdEnv_s {
    SdValueSet* active_frames; /* contains all currently active frames in the interpreter engine */
    SdChain* call_stack; /* information about each call in the call stack */
    SdChain* protected_values; /* internal interpreter values that we don't want to get GC'd right this moment */
+   SdInternTable* interned_strings; /* doesn't keep the strings alive; see SdEnv_InternValue */
+   SdValue_r type_of_name; /* interned "type-of", kept alive by the root */
+   SdValue_r error_message_name; /* interned "error.message", kept alive by the root */
 };
 
 struct SdValueSet_s {
    SdList* list; /* elements are sorted by pointer value */
 };
 
+struct SdInternTable_s { /* boxed strings by contents, in open addressing slots probed linearly from the hash */
+   SdValue_r* slots; /* null where empty */
+   size_t capacity; /* a power of two, at least twice count */
+   size_t count;
+};
+
 struct SdChain_s {
    SdChainNode* head;
    size_t count;
@@ -378,6 +622,56 @@ struct SdScanner_s {
 
 struct SdEngine_s {
    SdEnv_r env;
+   SdOutput_r output;
+   SdSharedMapBinding* shared_maps; /* the maps that (shared-map name) returns */
+   SdIterator_r generator; /* the generator whose body is running, if any */
+};
+
+struct SdEngineSearch_s { /* state for list.binary-search while it is inside SdList_Search */
+   SdResult result;
+   SdEngine_r engine;
+   SdValue_r frame;
+   SdValue_r key_selector; /* function, int, or nil */
+   SdValue_r search_key;
+   SdValue_r compare_func; /* may be null */
+   SdList* arguments; /* reused for each call into the key selector and compare function */
+};
+
+#define SdLineReader_BUFFER_SIZE 65536
+
+struct SdLineReader_s { /* reads a file one line at a time through a buffer that is reused for every line */
+   FILE* file;
+   char* buffer;
+   size_t capacity; /* grows only to fit a line longer than the buffer */
+   size_t start; /* the next line begins here */
+   size_t scanned; /* no newline between start and here */
+   size_t end; /* bytes in the buffer */
+   SdBool at_eof;
+};
+
+struct SdIterator_s { /* the native iteration protocol used by foreach, the stream intrinsics, and Iterator values */
+   SdEngine_r engine;
+   SdValue_r frame; /* closures are called from this frame */
+   SdIteratorKind kind;
+   SdValue_r roots; /* (mutalist source closure-iterator current stream), kept reachable while the iterator is open.
+      a generator's roots are (mutalist call-frame closure current nil resume-values arguments) instead. */
+   size_t index; /* position in an indexable or string source */
+   size_t count; /* length of an indexable or string source when the iterator was opened */
+   int hashmap_depth;
+   SdValue_r hashmap_nodes[SdIterator_MAX_HASHMAP_DEPTH];
+   size_t hashmap_positions[SdIterator_MAX_HASHMAP_DEPTH]; /* next item to visit in each node on the path */
+   SdValue_r stream; /* null when iterating a bare source */
+   size_t num_stages;
+   int* counts; /* number of values that have reached each TAKE or SKIP stage */
+   SdBool done;
+   SdList* arguments; /* reused for each call into a closure */
+   SdBool running; /* generator only: the body is executing */
+   SdBool resuming; /* generator only: descending back into the body to the yield where it left off */
+   SdBool suspending; /* generator only: unwinding from a yield, recording the position at each level */
+   size_t* resume_indices; /* generator only: statement and loop positions, innermost first */
+   size_t num_resume_indices;
+   size_t resume_indices_capacity;
+   SdLineReader* lines; /* file.lines only: null once the file has been read to the end */
 };
 
 #define SdSlabAllocator_DEFINE_PAGE_STRUCT(struct_name, item_type, items_per_page) \
@@ -416,32 +710,222 @@ static void SdFree3ElementArray(Sd3ElementArray* x);
 static Sd4ElementArray* SdAlloc4ElementArray(void);
 static void SdFree4ElementArray(Sd4ElementArray* x);
 
+static SdHeap_r SdHeap_Get(void);
+static void SdHeap_FreePages(SdHeap_r self);
+
+static void SdMutex_Init(SdMutex* self);
+static void SdMutex_Destroy(SdMutex* self);
+static void SdMutex_Lock(SdMutex* self);
+static void SdMutex_Unlock(SdMutex* self);
+
+static Sad_r Sad_Enter(Sad_r self);
+static void Sad_Leave(Sad_r previous);
+
 static SdResult SdFail(SdErr code, const char* message);
 static SdResult SdFailWithStringSuffix(SdErr code, const char* message, SdString_r suffix);
 
+static SdString* SdString_NewWithLength(size_t length);
+static SdString* SdString_FromChar(char ch);
+static const char* SdString_Chars(SdString_r self);
+static void SdString_Share(SdString_r self);
+static SdBool SdString_Find(SdString_r self, SdString_r needle, size_t start, size_t* out_index);
+#ifdef SD_SIMD_SSE2
+static size_t SdString_FindCandidatesSse2(const char* chars, size_t start, size_t last, const char* needle, 
+   size_t needle_length, size_t* out_index);
+#endif
+#if defined(SD_SIMD_SSE2) || defined(SD_SIMD_AVX2)
+static int SdSimd_LowestBit(unsigned int mask);
+#endif
+static size_t SdString_Count(SdString_r self, SdString_r needle);
+static SdString* SdString_Replace(SdString_r self, SdString_r needle, SdString_r replacement); /* null if no change */
+static unsigned int SdString_Hash(SdString_r self);
+static char* SdString_AllocBuffer(SdString_r self, size_t length);
+
 static SdStringBuf* SdStringBuf_New(void);
 static void SdStringBuf_Delete(SdStringBuf* self);
+static void SdStringBuf_Reserve(SdStringBuf_r self, size_t length);
 static void SdStringBuf_AppendString(SdStringBuf_r self, SdString_r suffix);
 static void SdStringBuf_AppendCStr(SdStringBuf_r self, const char* suffix);
+static void SdStringBuf_AppendChars(SdStringBuf_r self, const char* chars, size_t count);
 static void SdStringBuf_AppendChar(SdStringBuf_r self, char ch);
 static void SdStringBuf_AppendInt(SdStringBuf_r self, int number);
 static const char* SdStringBuf_CStr(SdStringBuf_r self);
 static void SdStringBuf_Clear(SdStringBuf_r self);
 static size_t SdStringBuf_Length(SdStringBuf_r self);
+static SdString* SdStringBuf_ToString(SdStringBuf* self);
+
+static SdOutput* SdOutput_New(void);
+static void SdOutput_Delete(SdOutput* self);
+static void SdOutput_SetSink(SdOutput_r self, SdOutputSink sink, void* context);
+static void SdOutput_SetBufferSize(SdOutput_r self, size_t size);
+static void SdOutput_Write(SdOutput_r self, const char* chars, size_t length);
+static void SdOutput_Flush(SdOutput_r self);
+static void SdOutput_Emit(SdOutput_r self, const char* chars, size_t length);
+
+#define SdFormat_INT_BUFFER_SIZE 12 /* "-2147483648" and the null terminator */
+#define SdFormat_DOUBLE_BUFFER_SIZE 32
+static size_t SdFormat_Int(char* buffer, int number);
+static size_t SdFormat_Double(char* buffer, double number);
+static size_t SdFormat_DoubleDigits(double number, char* digits, int* out_exponent);
+#ifdef SD_FORMAT_GRISU
+static SdDiyFp SdDiyFp_New(unsigned long f, int e);
+static SdDiyFp SdDiyFp_FromDouble(double number);
+static SdDiyFp SdDiyFp_Multiply(SdDiyFp a, SdDiyFp b);
+static SdDiyFp SdDiyFp_Normalize(SdDiyFp self);
+static void SdFormat_Grisu2(double number, char* digits, size_t* out_length, int* out_k);
+static void SdFormat_GrisuRound(char* digits, size_t length, unsigned long delta, unsigned long rest, 
+   unsigned long ten_kappa, unsigned long distance);
+#endif
+
+static void SdHash_Init(void);
+static unsigned int SdHash_Rotate(unsigned int x, int bits);
+static unsigned int SdHash_Combine(unsigned int hash, unsigned int word);
+static unsigned int SdHash_Finish(unsigned int hash);
+static unsigned int SdHash_Int(int x);
+static unsigned int SdHash_Double(double x);
+static unsigned int SdHash_Bytes(const char* bytes, size_t length);
 
 static SdValue* SdValue_NewInt(int x);
 static SdValue* SdValue_NewDouble(double x);
 static SdValue* SdValue_NewString(SdString* x);
+static SdBool SdValue_HasStableHash(SdValue_r self);
 static SdValue* SdValue_NewList(SdList* x);
 static SdValue* SdValue_NewFunction(SdList* x);
 static SdValue* SdValue_NewError(SdList* x);
+static SdValue* SdValue_NewVector(SdList* x);
+static SdValue* SdValue_NewHashmap(SdList* x);
+static SdValue* SdValue_NewStream(SdList* x);
+static SdValue* SdValue_NewIterator(SdIterator* x);
+static SdIterator_r SdValue_GetIterator(SdValue_r self);
+static void SdIterator_FreeContents(SdIterator_r self);
+static SdValue* SdValue_NewRange(int low, int high);
+static SdRange SdValue_GetRange(SdValue_r self);
+static size_t SdRange_Count(SdRange self);
+static SdValue* SdValue_NewSharedMap(SdSharedMap_r x);
+static SdSharedMap_r SdValue_GetSharedMap(SdValue_r self);
+static SdValue* SdValue_NewArray(SdArray* x);
+static SdArray_r SdValue_GetArray(SdValue_r self);
 static SdValue* SdValue_NewType(SdType x);
 static void SdValue_Delete(SdValue* self);
 static SdBool SdValue_IsGcMarked(SdValue_r self);
 static void SdValue_SetGcMark(SdValue_r self, SdBool mark);
-
+static SdResult SdValue_CompareRank(SdType type, int* out_rank);
+static int SdValue_CompareDoubles(double a, double b);
+
+static SdValue_r* SdList_AllocElements(SdListValuesUnion* values, size_t capacity);
+static void SdList_FreeElements(SdListValuesUnion values, size_t capacity);
+static SdValue_r* SdList_Elements(SdList_r self);
+static void SdList_SetCapacity(SdList_r self, size_t new_capacity);
+static void SdList_Grow(SdList_r self);
 static SdSearchResult SdList_Search(SdList_r list, SdSearchCompareFunc compare_func, void* context); /* must be sorted */
 static SdBool SdList_InsertBySearch(SdList_r list, SdValue_r item, SdSearchCompareFunc compare_func, void* context);
+static SdResult SdList_SortIndices(SdList_r keys, size_t* indices, size_t* scratch, size_t count);
+
+static SdValue_r SdVector_New(SdEnv_r env, SdValue_r root, int shift, int origin, int count);
+static SdValue_r SdVector_FromList(SdEnv_r env, SdList_r list);
+static SdValue_r SdVector_Root(SdValue_r self);
+static int SdVector_Shift(SdValue_r self);
+static int SdVector_Origin(SdValue_r self);
+static size_t SdVector_Count(SdValue_r self);
+static SdValue_r SdVector_GetAt(SdValue_r self, size_t index);
+static SdValue_r SdVector_AssocNode(SdEnv_r env, SdValue_r node, int shift, size_t position, SdValue_r item);
+static SdValue_r SdVector_SetAt(SdEnv_r env, SdValue_r self, size_t index, SdValue_r item);
+static SdValue_r SdVector_Append(SdEnv_r env, SdValue_r self, SdValue_r item);
+static SdValue_r SdVector_Slice(SdEnv_r env, SdValue_r self, size_t start, size_t end);
+static SdList* SdVector_ToList(SdValue_r self);
+static SdBool SdVector_Equals(SdValue_r a, SdValue_r b);
+
+static SdArray* SdArray_New(SdType element_type, size_t length);
+static void SdArray_Delete(SdArray* self);
+static size_t SdArray_ElementSize(SdArray_r self);
+static void SdArray_Reserve(SdArray_r self, size_t capacity);
+static size_t SdArray_Count(SdArray_r self);
+static SdType SdArray_ElementType(SdArray_r self);
+static int SdArray_GetInt(SdArray_r self, size_t index);
+static double SdArray_GetDouble(SdArray_r self, size_t index);
+static void SdArray_SetInt(SdArray_r self, size_t index, int x);
+static void SdArray_SetDouble(SdArray_r self, size_t index, double x);
+static void SdArray_Grow(SdArray_r self);
+static void SdArray_AppendInt(SdArray_r self, int x);
+static void SdArray_AppendDouble(SdArray_r self, double x);
+static SdBool SdArray_Equals(SdArray_r a, SdArray_r b);
+static SdArray* SdArray_Elementwise(SdArrayOp op, SdArray_r a, SdArray_r b);
+static SdArray* SdArray_MapDouble(SdArray_r self, double (*func)(double));
+static double SdArray_SumDouble(SdArray_r self);
+static double SdArray_DotDouble(SdArray_r a, SdArray_r b);
+static int SdArray_SumInt(SdArray_r self);
+static int SdArray_DotInt(SdArray_r a, SdArray_r b);
+static double SdArray_ExtremeDouble(SdArray_r self, SdBool is_max);
+static int SdArray_ExtremeInt(SdArray_r self, SdBool is_max);
+static double SdArray_NaN(void);
+
+static SdBool SdStream_IsStreamable(SdValue_r value);
+static SdValue_r SdStream_AddStage(SdEnv_r env, SdValue_r source, SdStreamStage kind, SdValue_r argument);
+static SdValue_r SdStream_Source(SdValue_r self);
+static size_t SdStream_StageCount(SdValue_r self);
+static SdStreamStage SdStream_StageKind(SdValue_r self, size_t stage);
+static SdValue_r SdStream_StageArgument(SdValue_r self, size_t stage);
+
+static long SdFile_Size(FILE* fp);
+static SdLineReader* SdLineReader_Open(SdString_r file_path); /* null if the file can't be opened */
+static void SdLineReader_Close(SdLineReader* self);
+static SdResult SdLineReader_Next(SdLineReader_r self, SdString** out_line); /* null at the end of the file */
+
+static double SdArray_DotDoubles(const double* x, const double* y, size_t n);
+#ifdef SD_SIMD_AVX2
+static SdBool SdCpu_HasAvx2(void);
+SD_AVX2_TARGET static size_t SdString_FindCandidatesAvx2(const char* chars, size_t start, size_t last, 
+   const char* needle, size_t needle_length, size_t* out_index);
+SD_AVX2_TARGET static size_t SdArray_ElementwiseDoubleAvx2(SdArrayOp op, const double* x, const double* y, double* z,
+   size_t n);
+SD_AVX2_TARGET static size_t SdArray_ElementwiseIntAvx2(SdArrayOp op, const int* x, const int* y, int* z, size_t n);
+SD_AVX2_TARGET static size_t SdArray_DotDoubleAvx2(const double* x, const double* y, size_t n, double* out_total);
+SD_AVX2_TARGET static size_t SdArray_SumIntAvx2(const int* x, size_t n, unsigned int* out_total);
+SD_AVX2_TARGET static size_t SdArray_ExtremeDoubleAvx2(const double* x, size_t n, SdBool is_max, double* out_extreme,
+   SdBool* out_has_nan);
+#endif
+
+static int SdHashmap_PopCount(unsigned int x);
+static SdValue_r SdHashmap_NewNode(SdEnv_r env, unsigned int datamap, unsigned int nodemap, SdList* items);
+static SdValue_r SdHashmap_New(SdEnv_r env, SdValue_r root, int count);
+static SdValue_r SdHashmap_NewEmpty(SdEnv_r env);
+static size_t SdHashmap_Count(SdValue_r self);
+static unsigned int SdHashmap_NodeDatamap(SdList_r node);
+static unsigned int SdHashmap_NodeNodemap(SdList_r node);
+static unsigned int SdHashmap_Fragment(unsigned int hash, int shift);
+static SdValue_r SdHashmap_NodeGet(SdValue_r node_val, int shift, unsigned int hash, SdValue_r key);
+static SdValue_r SdHashmap_Get(SdValue_r self, SdValue_r key); /* may be null */
+static SdValue_r SdHashmap_MergePairs(SdEnv_r env, int shift, unsigned int hash1, SdValue_r key1, SdValue_r value1, 
+   unsigned int hash2, SdValue_r key2, SdValue_r value2);
+static SdList* SdHashmap_CopyItems(SdList_r node);
+static SdValue_r SdHashmap_NodeSet(SdEnv_r env, SdValue_r node_val, int shift, unsigned int hash, SdValue_r key, 
+   SdValue_r value, SdBool* out_added);
+static SdValue_r SdHashmap_Set(SdEnv_r env, SdValue_r self, SdValue_r key, SdValue_r value);
+static SdValue_r SdHashmap_NodeRemove(SdEnv_r env, SdValue_r node_val, int shift, unsigned int hash, SdValue_r key);
+static SdValue_r SdHashmap_Remove(SdEnv_r env, SdValue_r self, SdValue_r key);
+static void SdHashmap_NodeAppendPairs(SdEnv_r env, SdValue_r node_val, int shift, SdList_r pairs);
+static SdList* SdHashmap_ToList(SdEnv_r env, SdValue_r self);
+static void SdHashmap_NodeHash(SdValue_r node_val, int shift, int* hash);
+static int SdHashmap_Hash(SdValue_r self);
+static SdBool SdHashmap_NodeIsSubsetOf(SdValue_r node_val, int shift, SdValue_r other);
+static SdBool SdHashmap_Equals(SdValue_r a, SdValue_r b);
+
+static SdBool SdSharedValue_CanStore(SdValue_r value);
+static void SdSharedValue_Freeze(SdValue_r value, SdSharedValue_r out_frozen);
+static void SdSharedValue_Copy(SdSharedValue_r frozen, SdSharedValue_r out_copy);
+static SdValue_r SdSharedValue_Box(SdEnv_r env, SdSharedValue_r frozen); /* takes the frozen string, if any */
+static SdString* SdSharedValue_CopyString(SdString_r str);
+static void SdSharedValue_Release(SdSharedValue_r frozen);
+static SdBool SdSharedValue_Matches(SdSharedValue_r frozen, SdValue_r value);
+static void SdSharedMap_Retain(SdSharedMap_r self);
+static SdSharedMapStripe_r SdSharedMap_Lock(SdSharedMap_r self, unsigned int hash); /* unlock the stripe after */
+static void SdSharedMap_Get(SdSharedMap_r self, SdValue_r key, SdSharedValue_r out_value); /* nil if missing */
+static void SdSharedMap_Set(SdSharedMap_r self, SdValue_r key, SdValue_r value);
+static SdBool SdSharedMap_Add(SdSharedMap_r self, SdValue_r key); /* false if the key was already present */
+static SdResult SdSharedMap_Increment(SdSharedMap_r self, SdValue_r key, int delta, int* out_count);
+static SdSharedEntry_r SdSharedMapStripe_Find(SdSharedMapStripe_r self, unsigned int hash, SdValue_r key);
+static SdSharedEntry_r SdSharedMapStripe_Insert(SdSharedMapStripe_r self, unsigned int hash, SdValue_r key);
+static void SdSharedMapStripe_Grow(SdSharedMapStripe_r self);
 
 static SdEnv* SdEnv_New(void);
 static void SdEnv_Delete(SdEnv* self);
@@ -455,6 +939,7 @@ static SdValue_r SdEnv_FindVariableSlotLocation(SdEnv_r self, SdValue_r frame, S
    int* out_frame_hops, int* out_index_in_frame); /* may be null */
 static SdValue_r SdEnv_BeginFrame(SdEnv_r self, SdValue_r parent);
 static void SdEnv_EndFrame(SdEnv_r self, SdValue_r frame);
+static void SdEnv_ResumeFrame(SdEnv_r self, SdValue_r frame);
 static void SdEnv_PushCall(SdEnv_r self, SdValue_r calling_frame, SdValue_r name, SdValue_r arguments);
 static void SdEnv_PopCall(SdEnv_r self);
 static void SdEnv_PushProtectedValue(SdEnv_r self, SdValue_r value);
@@ -467,9 +952,19 @@ static SdValue_r SdEnv_BoxInt(SdEnv_r env, int x);
 static SdValue_r SdEnv_BoxDouble(SdEnv_r env, double x);
 static SdValue_r SdEnv_BoxBool(SdEnv_r env, SdBool x);
 static SdValue_r SdEnv_BoxString(SdEnv_r env, SdString* x);
+static SdValue_r SdEnv_InternString(SdEnv_r env, SdString* x);
+static SdValue_r SdEnv_InternValue(SdEnv_r env, SdValue_r value);
+static void SdEnv_PruneInternedStrings(SdEnv_r self);
 static SdValue_r SdEnv_BoxList(SdEnv_r env, SdList* x);
 static SdValue_r SdEnv_BoxFunction(SdEnv_r env, SdList* x);
 static SdValue_r SdEnv_BoxError(SdEnv_r env, SdList* x);
+static SdValue_r SdEnv_BoxVector(SdEnv_r env, SdList* x);
+static SdValue_r SdEnv_BoxHashmap(SdEnv_r env, SdList* x);
+static SdValue_r SdEnv_BoxStream(SdEnv_r env, SdList* x);
+static SdValue_r SdEnv_BoxIterator(SdEnv_r env, SdIterator* x);
+static SdValue_r SdEnv_BoxRange(SdEnv_r env, int low, int high);
+static SdValue_r SdEnv_BoxSharedMap(SdEnv_r env, SdSharedMap_r x);
+static SdValue_r SdEnv_BoxArray(SdEnv_r env, SdArray* x);
 static SdValue_r SdEnv_BoxType(SdEnv_r env, SdType x);
 
 static SdValue_r SdEnv_Root_New(SdEnv_r env);
@@ -520,6 +1015,7 @@ static SdValue_r SdAst_Function_Body(SdValue_r self);
 static SdValue_r SdAst_Function_Parameters(SdValue_r self);
 static SdBool SdAst_Function_IsImported(SdValue_r self);
 static SdBool SdAst_Function_HasVariableLengthArgumentList(SdValue_r self);
+static SdBool SdAst_Function_IsGenerator(SdValue_r self);
 static SdList_r SdAst_Function_ReturnTypes(SdValue_r self);
 
 static SdValue_r SdAst_Parameter_New(SdEnv_r env, SdString* identifier, SdList* type_var_refs);
@@ -597,6 +1093,10 @@ static SdValue_r SdAst_Return_Expr(SdValue_r self);
 static SdValue_r SdAst_Die_New(SdEnv_r env, SdValue_r expr);
 static SdValue_r SdAst_Die_Expr(SdValue_r self);
 
+static SdValue_r SdAst_Yield_New(SdEnv_r env, SdValue_r expr);
+static SdValue_r SdAst_Yield_Expr(SdValue_r self);
+static SdBool SdAst_Body_ContainsYield(SdValue_r body);
+
 static SdValue_r SdAst_IntLit_New(SdEnv_r env, int value);
 static SdValue_r SdAst_IntLit_Value(SdValue_r self);
 
@@ -635,6 +1135,13 @@ static SdBool SdValueSet_Remove(SdValueSet_r self, SdValue_r item); /* true = re
 static SdList_r SdValueSet_GetList(SdValueSet_r self);
 static int SdValueSet_CompareFunc(SdValue_r lhs, void* context);
 
+static SdInternTable* SdInternTable_New(void);
+static void SdInternTable_Delete(SdInternTable* self);
+static SdValue_r SdInternTable_Find(SdInternTable_r self, SdString_r str); /* may be null */
+static void SdInternTable_Add(SdInternTable_r self, SdValue_r value); /* value's contents must not be present yet */
+static void SdInternTable_RemoveUnmarked(SdInternTable_r self);
+static void SdInternTable_Rebuild(SdInternTable_r self, size_t capacity, SdBool marked_only);
+
 static SdChain* SdChain_New(void);
 static void SdChain_Delete(SdChain* self);
 static size_t SdChain_Count(SdChain_r self);
@@ -691,12 +1198,17 @@ static SdResult SdParser_ParseMatch(SdEnv_r env, SdScanner_r scanner, SdValue_r*
 static SdResult SdParser_ParseMatchCase(SdEnv_r env, SdScanner_r scanner, SdValue_r* out_node);
 static SdResult SdParser_ParseReturn(SdEnv_r env, SdScanner_r scanner, SdValue_r* out_node);
 static SdResult SdParser_ParseDie(SdEnv_r env, SdScanner_r scanner, SdValue_r* out_node);
+static SdResult SdParser_ParseYield(SdEnv_r env, SdScanner_r scanner, SdValue_r* out_node);
 
-static SdEngine* SdEngine_New(SdEnv_r env);
+static SdEngine* SdEngine_New(SdEnv_r env, SdOutput_r output);
 static void SdEngine_Delete(SdEngine* self);
+static SdSharedMapBinding_r SdEngine_FindSharedMap(SdEngine_r self, SdString_r name); /* may be null */
+static void SdEngine_BindSharedMap(SdEngine_r self, SdString* name, SdSharedMap_r map); /* takes the name */
+static SdResult SdEngine_CompareOperands(SdValue_r a, SdValue_r b, int* out_order, SdBool* out_unordered);
 static SdResult SdEngine_ExecuteProgram(SdEngine_r self);
 static SdResult SdEngine_Call(SdEngine_r self, SdValue_r frame, SdValue_r var_ref, SdList_r arguments, 
    SdValue_r* out_return);
+static void SdEngine_CollectGarbageIfNeeded(SdEngine_r self);
 static SdResult SdEngine_CallClosure(SdEngine_r self, SdValue_r frame, SdValue_r closure, SdList_r arguments, 
    SdValue_r* out_return);
 static SdResult SdEngine_EvaluateExpr(SdEngine_r self, SdValue_r frame, SdValue_r expr, SdValue_r* out_value);
@@ -712,12 +1224,37 @@ static SdResult SdEngine_ExecuteSet(SdEngine_r self, SdValue_r frame, SdValue_r
 static SdResult SdEngine_ExecuteMultiSet(SdEngine_r self, SdValue_r frame, SdValue_r statement);
 static SdResult SdEngine_ExecuteIf(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
 static SdResult SdEngine_ExecuteFor(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
+static size_t SdEngine_IndexableCount(SdValue_r haystack);
+static SdValue_r SdEngine_IndexableGetAt(SdEngine_r self, SdValue_r haystack, size_t index);
+static SdResult SdEngine_Iterator_Begin(SdEngine_r self, SdValue_r frame, SdValue_r value, SdIterator_r out_iterator);
+static SdValue_r SdEngine_Iterator_NextHashmapPair(SdIterator_r self); /* may be null */
+static SdResult SdEngine_Iterator_NextFromSource(SdIterator_r self, SdValue_r* out_value);
+static SdResult SdEngine_Iterator_Next(SdIterator_r self, SdValue_r* out_value);
+static void SdEngine_Iterator_End(SdIterator_r self);
+static SdResult SdEngine_Iterator_Box(SdEngine_r self, SdValue_r source, SdValue_r* out_return);
+static SdResult SdEngine_CallStreamValue(SdEngine_r self, SdValue_r value, SdList_r arguments, SdValue_r* out_return);
+static SdValue_r SdEngine_Generator_New(SdEngine_r self, SdValue_r closure, SdValue_r call_frame, SdValue_r arguments);
+static SdValue_r SdEngine_FileLines_New(SdEngine_r self, SdLineReader* reader);
+static SdResult SdEngine_Generator_Resume(SdIterator_r self, SdValue_r* out_value);
+static SdBool SdEngine_IsResuming(SdEngine_r self);
+static SdBool SdEngine_IsSuspending(SdEngine_r self);
+static void SdEngine_SaveResumeIndex(SdEngine_r self, size_t index);
+static size_t SdEngine_RestoreResumeIndex(SdEngine_r self);
+static void SdEngine_SaveResumeValue(SdEngine_r self, SdValue_r value);
+static SdValue_r SdEngine_RestoreResumeValue(SdEngine_r self);
+static void SdEngine_SuspendFrame(SdEngine_r self, SdValue_r frame);
+static SdValue_r SdEngine_ResumeFrame(SdEngine_r self);
+static SdResult SdEngine_ExecuteForEachIteration(SdEngine_r self, SdValue_r frame, SdValue_r statement, 
+   SdValue_r iter_value, size_t index, SdValue_r* out_return);
 static SdResult SdEngine_ExecuteForEach(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
 static SdResult SdEngine_ExecuteWhile(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
 static SdResult SdEngine_ExecuteDo(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
 static SdResult SdEngine_ExecuteSwitch(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
+static SdResult SdEngine_ExecuteSwitchBranch(SdEngine_r self, SdValue_r frame, SdValue_r statement, size_t branch,
+   SdValue_r* out_return);
 static SdResult SdEngine_ExecuteReturn(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
 static SdResult SdEngine_ExecuteDie(SdEngine_r self, SdValue_r frame, SdValue_r statement);
+static SdResult SdEngine_ExecuteYield(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return);
 static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Args1(SdList_r arguments, SdValue_r* out_a, SdType* out_a_type);
 static SdResult SdEngine_Args2(SdList_r arguments, SdValue_r* out_a, SdType* out_a_type, SdValue_r* out_b, 
@@ -756,6 +1293,11 @@ static SdResult SdEngine_Intrinsic_And(SdEngine_r self, SdList_r arguments, SdVa
 static SdResult SdEngine_Intrinsic_Or(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_Not(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_Equals(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_LessThan(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_LessThanEquals(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_GreaterThan(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_GreaterThanEquals(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_Compare(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_ShiftLeft(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_ShiftRight(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_ListLength(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
@@ -763,9 +1305,33 @@ static SdResult SdEngine_Intrinsic_ListGetAt(SdEngine_r self, SdList_r arguments
 static SdResult SdEngine_Intrinsic_ListSetAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_ListInsertAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_ListRemoveAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ListSort(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static int SdEngine_BinarySearch_CompareFunc(SdValue_r lhs, void* context);
+static SdResult SdEngine_Intrinsic_ListBinarySearch(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StreamMap(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StreamFilter(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StreamTake(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StreamSkip(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StreamReduce(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StreamToList(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ToIterator(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_IteratorNext(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_Range(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_RangeLength(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_RangeGetAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_StringLength(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_StringGetAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringIntern(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringSubstring(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringSplit(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringFind(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringStartsWith(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringIndexOf(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringCount(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_StringReplace(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_Print(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_Flush(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_FileLines(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_Error(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_ErrorMessage(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_GetType(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
@@ -777,26 +1343,75 @@ static SdResult SdEngine_Intrinsic_DoubleToInt(SdEngine_r self, SdList_r argumen
 static SdResult SdEngine_Intrinsic_StringJoin(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_List(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 static SdResult SdEngine_Intrinsic_Mutalist(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_Vector(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ListToVector(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_VectorLength(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_VectorGetAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_VectorSetAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_VectorAppend(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_VectorSlice(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_VectorToList(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_Hashmap(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_HashmapCount(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_HashmapGet(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_HashmapHas(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_HashmapSet(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_HashmapRemove(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_HashmapToList(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_SharedMap(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_SharedMapGet(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_SharedMapSet(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_SharedMapAdd(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_SharedMapIncrement(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_SharedMapCount(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_IntArray(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_DoubleArray(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_IntArrayNew(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_DoubleArrayNew(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayLength(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayGetAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArraySetAt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayAppend(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_CheckIntDivision(int a, int b);
+static SdResult SdEngine_ArrayElementwise(SdEngine_r self, SdList_r arguments, SdArrayOp op, SdValue_r* out_return);
+static SdResult SdEngine_ArrayExtreme(SdEngine_r self, SdList_r arguments, SdBool is_max, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayAdd(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArraySubtract(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayMultiply(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayDivide(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArraySum(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayDot(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayMin(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayMax(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArraySin(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayCos(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayTan(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayASin(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayACos(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayATan(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArraySinH(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayCosH(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayTanH(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayExp(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayLog(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayLog10(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArraySqrt(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayCeil(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_ArrayFloor(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
+static SdResult SdEngine_Intrinsic_Clock(SdEngine_r self, SdList_r arguments, SdValue_r* out_return);
 
 /* Global variables */
 static SdResult SdResult_SUCCESS = { SdErr_SUCCESS };
-static char SdResult_Message[500] = { 0 };
-static SdValue SdValue_NIL = { SdType_NIL, { 0 }, SdFalse };
-static SdValue SdValue_TRUE = { SdType_BOOL, { SdTrue }, SdFalse };
-static SdValue SdValue_FALSE = { SdType_BOOL, { SdFalse }, SdFalse };
-static SdValuePage* SdValuePage_FirstOpen = NULL;
-static SdValuePage* SdValuePage_FirstFull = NULL;
-static SdListPage* SdListPage_FirstOpen = NULL;
-static SdListPage* SdListPage_FirstFull = NULL;
-static Sd1ElementArrayPage* Sd1ElementArrayPage_FirstOpen = NULL;
-static Sd1ElementArrayPage* Sd1ElementArrayPage_FirstFull = NULL;
-static Sd2ElementArrayPage* Sd2ElementArrayPage_FirstOpen = NULL;
-static Sd2ElementArrayPage* Sd2ElementArrayPage_FirstFull = NULL;
-static Sd3ElementArrayPage* Sd3ElementArrayPage_FirstOpen = NULL;
-static Sd3ElementArrayPage* Sd3ElementArrayPage_FirstFull = NULL;
-static Sd4ElementArrayPage* Sd4ElementArrayPage_FirstOpen = NULL;
-static Sd4ElementArrayPage* Sd4ElementArrayPage_FirstFull = NULL;
-static size_t SdAlloc_BytesAllocatedSinceLastGc = 0;
+static SD_THREAD_LOCAL char SdResult_Message[500] = { 0 };
+/* these are shared by every instance, so they start out marked and the garbage collector never writes to them */
+static SdValue SdValue_NIL = { SdType_NIL, { 0 }, SdTrue };
+static SdValue SdValue_TRUE = { SdType_BOOL, { SdTrue }, SdTrue };
+static SdValue SdValue_FALSE = { SdType_BOOL, { SdFalse }, SdTrue };
+static unsigned int SdHash_Seed = 0;
+static SdBool SdHash_IsSeeded = SdFalse;
+static SdMutex SdHash_SeedLock = SdMutex_INIT;
+static SD_THREAD_LOCAL Sad_r Sad_Current = NULL; /* the instance whose API call is running on this thread, if any */
+static SD_THREAD_LOCAL SdHeap SdHeap_ThreadDefault; /* for allocations made outside of any instance */
 
 /* Helpers ***********************************************************************************************************/
 #define STRINGIFY(x) #x
@@ -905,7 +1520,7 @@ void* SdAlloc(size_t size) {
       SdExit(buf);
    }
 
-   SdAlloc_BytesAllocatedSinceLastGc += size;
+   SdHeap_Get()->bytes_allocated_since_last_gc += size;
    
    return ptr;
 }
@@ -931,8 +1546,8 @@ void* SdRealloc(void* ptr, size_t new_size, size_t old_size) {
 
    if (new_ptr != ptr) {
       /* realloc had to allocate a new buffer, copy everything over, and then free the old buffer. */
-      SdAlloc_BytesAllocatedSinceLastGc -= old_size;
-      SdAlloc_BytesAllocatedSinceLastGc += new_size;
+      SdHeap_Get()->bytes_allocated_since_last_gc -= old_size;
+      SdHeap_Get()->bytes_allocated_since_last_gc += new_size;
    }
    
    return new_ptr;
@@ -956,6 +1571,8 @@ static void* SdUnreferenced(void* x) {
 }
 
 static void SdExit(const char* message) {
+   if (Sad_Current && Sad_Current->output)
+      SdOutput_Flush(Sad_Current->output); /* so the text printed before the failure isn't lost */
    fprintf(stderr, "FATAL ERROR: %s\n", message);
    exit(-1);
 }
@@ -973,6 +1590,14 @@ static const char* SdType_Name(SdType x) {
       case SdType_FUNCTION: return "Function";
       case SdType_ERROR: return "Error";
       case SdType_TYPE: return "Type";
+      case SdType_VECTOR: return "Vector";
+      case SdType_HASHMAP: return "Hashmap";
+      case SdType_INT_ARRAY: return "IntArray";
+      case SdType_DOUBLE_ARRAY: return "DoubleArray";
+      case SdType_STREAM: return "Stream";
+      case SdType_ITERATOR: return "Iterator";
+      case SdType_RANGE: return "Range";
+      case SdType_SHARED_MAP: return "SharedMap";
       default: SdAssert(SdFalse); return "unknown";
    }
 }
@@ -980,16 +1605,17 @@ static const char* SdType_Name(SdType x) {
 /* SdSlabAllocator ***************************************************************************************************/
 #define SdSlabAllocator_DEFINE_ALLOC_FUNC(name, page_type, item_type, first_open, first_full, items_per_page) \
    static item_type* name(void) { \
+      SdHeap_r heap = SdHeap_Get(); \
       page_type* page = NULL; \
       item_type* ptr = NULL; \
       \
       /* find a page with a slot free */ \
-      page = first_open; \
+      page = heap->first_open; \
       \
       /* if there's no open page, then create a new page */ \
       if (!page) { \
          page = SdAlloc(sizeof(page_type)); \
-         first_open = page; \
+         heap->first_open = page; \
       } \
       \
       /* if there's anything in the free list, then use that first because recycling is cool.  if not, then press \
@@ -1005,35 +1631,36 @@ static const char* SdType_Name(SdType x) {
       \
       /* if this page is now full, then move it to the full list */ \
       if (page->num_free_ptrs == 0 && page->next_unused_index == items_per_page) { \
-         first_open = page->next_page; \
-         page->next_page = first_full; \
-         first_full = page; \
+         heap->first_open = page->next_page; \
+         page->next_page = heap->first_full; \
+         heap->first_full = page; \
       } \
       \
       return ptr; \
    }
 
 SdSlabAllocator_DEFINE_ALLOC_FUNC(
-   SdAllocValue, SdValuePage, SdValue, SdValuePage_FirstOpen, SdValuePage_FirstFull, SdValuePage_ITEMS_PER_PAGE)
+   SdAllocValue, SdValuePage, SdValue, value_pages_open, value_pages_full, SdValuePage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_ALLOC_FUNC(
-   SdAllocList, SdListPage, SdList, SdListPage_FirstOpen, SdListPage_FirstFull, SdListPage_ITEMS_PER_PAGE)
+   SdAllocList, SdListPage, SdList, list_pages_open, list_pages_full, SdListPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_ALLOC_FUNC(
-   SdAlloc1ElementArray, Sd1ElementArrayPage, Sd1ElementArray, Sd1ElementArrayPage_FirstOpen,
-   Sd1ElementArrayPage_FirstFull, Sd1ElementArrayPage_ITEMS_PER_PAGE)
+   SdAlloc1ElementArray, Sd1ElementArrayPage, Sd1ElementArray, array_1_pages_open, array_1_pages_full,
+   Sd1ElementArrayPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_ALLOC_FUNC(
-   SdAlloc2ElementArray, Sd2ElementArrayPage, Sd2ElementArray, Sd2ElementArrayPage_FirstOpen,
-   Sd2ElementArrayPage_FirstFull, Sd2ElementArrayPage_ITEMS_PER_PAGE)
+   SdAlloc2ElementArray, Sd2ElementArrayPage, Sd2ElementArray, array_2_pages_open, array_2_pages_full,
+   Sd2ElementArrayPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_ALLOC_FUNC(
-   SdAlloc3ElementArray, Sd3ElementArrayPage, Sd3ElementArray, Sd3ElementArrayPage_FirstOpen,
-   Sd3ElementArrayPage_FirstFull, Sd3ElementArrayPage_ITEMS_PER_PAGE)
+   SdAlloc3ElementArray, Sd3ElementArrayPage, Sd3ElementArray, array_3_pages_open, array_3_pages_full,
+   Sd3ElementArrayPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_ALLOC_FUNC(
-   SdAlloc4ElementArray, Sd4ElementArrayPage, Sd4ElementArray, Sd4ElementArrayPage_FirstOpen,
-   Sd4ElementArrayPage_FirstFull, Sd4ElementArrayPage_ITEMS_PER_PAGE)
+   SdAlloc4ElementArray, Sd4ElementArrayPage, Sd4ElementArray, array_4_pages_open, array_4_pages_full,
+   Sd4ElementArrayPage_ITEMS_PER_PAGE)
 
 #undef SdSlabAllocator_DEFINE_ALLOC_FUNC
 
 #define SdSlabAllocator_DEFINE_FREE_FUNC(name, page_type, item_type, first_open, first_full, items_per_page) \
    static void name(item_type* x) { \
+      SdHeap_r heap = SdHeap_Get(); \
       page_type* page = NULL; \
       page_type* prev_page = NULL; \
       SdBool page_was_full = SdFalse; \
@@ -1042,7 +1669,7 @@ SdSlabAllocator_DEFINE_ALLOC_FUNC(
          return; \
       \
       /* figure out which page this value belongs to */ \
-      page = first_open; \
+      page = heap->first_open; \
       while (page) { \
          if (x >= &page->values[0] && x < &page->values[items_per_page]) \
             break; /* it's on this page */ \
@@ -1052,7 +1679,7 @@ SdSlabAllocator_DEFINE_ALLOC_FUNC(
       \
       if (!page) { \
          prev_page = NULL; \
-         page = first_full; \
+         page = heap->first_full; \
          while (page) { \
             if (x >= &page->values[0] && x < &page->values[items_per_page]) { \
                page_was_full = SdTrue; \
@@ -1076,38 +1703,117 @@ SdSlabAllocator_DEFINE_ALLOC_FUNC(
          if (prev_page) \
             prev_page->next_page = page->next_page; \
          else \
-            first_full = page->next_page; \
-         page->next_page = first_open; \
-         first_open = page; \
+            heap->first_full = page->next_page; \
+         page->next_page = heap->first_open; \
+         heap->first_open = page; \
       } else if (page->num_free_ptrs == page->next_unused_index) { \
          /* if this page was open and is now empty, then we can remove this page */ \
          if (prev_page) \
             prev_page->next_page = page->next_page; \
          else \
-            first_open = page->next_page; \
+            heap->first_open = page->next_page; \
          SdFree(page); \
       } \
    }
 
 SdSlabAllocator_DEFINE_FREE_FUNC(
-   SdFreeValue, SdValuePage, SdValue, SdValuePage_FirstOpen, SdValuePage_FirstFull, SdValuePage_ITEMS_PER_PAGE)
+   SdFreeValue, SdValuePage, SdValue, value_pages_open, value_pages_full, SdValuePage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_FREE_FUNC(
-   SdFreeList, SdListPage, SdList, SdListPage_FirstOpen, SdListPage_FirstFull, SdListPage_ITEMS_PER_PAGE)
+   SdFreeList, SdListPage, SdList, list_pages_open, list_pages_full, SdListPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_FREE_FUNC(
-   SdFree1ElementArray, Sd1ElementArrayPage, Sd1ElementArray, Sd1ElementArrayPage_FirstOpen,
-   Sd1ElementArrayPage_FirstFull, Sd1ElementArrayPage_ITEMS_PER_PAGE)
+   SdFree1ElementArray, Sd1ElementArrayPage, Sd1ElementArray, array_1_pages_open, array_1_pages_full,
+   Sd1ElementArrayPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_FREE_FUNC(
-   SdFree2ElementArray, Sd2ElementArrayPage, Sd2ElementArray, Sd2ElementArrayPage_FirstOpen,
-   Sd2ElementArrayPage_FirstFull, Sd2ElementArrayPage_ITEMS_PER_PAGE)
+   SdFree2ElementArray, Sd2ElementArrayPage, Sd2ElementArray, array_2_pages_open, array_2_pages_full,
+   Sd2ElementArrayPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_FREE_FUNC(
-   SdFree3ElementArray, Sd3ElementArrayPage, Sd3ElementArray, Sd3ElementArrayPage_FirstOpen,
-   Sd3ElementArrayPage_FirstFull, Sd3ElementArrayPage_ITEMS_PER_PAGE)
+   SdFree3ElementArray, Sd3ElementArrayPage, Sd3ElementArray, array_3_pages_open, array_3_pages_full,
+   Sd3ElementArrayPage_ITEMS_PER_PAGE)
 SdSlabAllocator_DEFINE_FREE_FUNC(
-   SdFree4ElementArray, Sd4ElementArrayPage, Sd4ElementArray, Sd4ElementArrayPage_FirstOpen,
-   Sd4ElementArrayPage_FirstFull, Sd4ElementArrayPage_ITEMS_PER_PAGE)
+   SdFree4ElementArray, Sd4ElementArrayPage, Sd4ElementArray, array_4_pages_open, array_4_pages_full,
+   Sd4ElementArrayPage_ITEMS_PER_PAGE)
 
 #undef SdSlabAllocator_DEFINE_FREE_FUNC
 
+/* SdHeap ************************************************************************************************************/
+/* each Sad instance allocates from its own slab pages and keeps its own count toward the next garbage collection, so 
+   that instances on separate threads never touch the same allocator state. the public Sad functions make their 
+   instance current on the calling thread for the duration of the call; anything allocated outside of any instance 
+   comes from a heap that belongs to the thread. */
+static SdHeap_r SdHeap_Get(void) {
+   return Sad_Current ? &Sad_Current->heap : &SdHeap_ThreadDefault;
+}
+
+/* frees whatever pages are left, including the ones holding anything the instance leaked */
+static void SdHeap_FreePages(SdHeap_r self) {
+   SdAssert(self);
+#define SdHeap_FREE_PAGE_LIST(page_type, first) \
+   while (self->first) { \
+      page_type* next_page = self->first->next_page; \
+      SdFree(self->first); \
+      self->first = next_page; \
+   }
+   SdHeap_FREE_PAGE_LIST(SdValuePage, value_pages_open)
+   SdHeap_FREE_PAGE_LIST(SdValuePage, value_pages_full)
+   SdHeap_FREE_PAGE_LIST(SdListPage, list_pages_open)
+   SdHeap_FREE_PAGE_LIST(SdListPage, list_pages_full)
+   SdHeap_FREE_PAGE_LIST(Sd1ElementArrayPage, array_1_pages_open)
+   SdHeap_FREE_PAGE_LIST(Sd1ElementArrayPage, array_1_pages_full)
+   SdHeap_FREE_PAGE_LIST(Sd2ElementArrayPage, array_2_pages_open)
+   SdHeap_FREE_PAGE_LIST(Sd2ElementArrayPage, array_2_pages_full)
+   SdHeap_FREE_PAGE_LIST(Sd3ElementArrayPage, array_3_pages_open)
+   SdHeap_FREE_PAGE_LIST(Sd3ElementArrayPage, array_3_pages_full)
+   SdHeap_FREE_PAGE_LIST(Sd4ElementArrayPage, array_4_pages_open)
+   SdHeap_FREE_PAGE_LIST(Sd4ElementArrayPage, array_4_pages_full)
+#undef SdHeap_FREE_PAGE_LIST
+}
+
+/* SdMutex ***********************************************************************************************************/
+/* a thin layer over the platform's lock. a build without threads has nothing to lock. */
+static void SdMutex_Init(SdMutex* self) { /* for locks that aren't statically initialized with SdMutex_INIT */
+   SdAssert(self);
+#if defined(SD_THREADS_WIN32)
+   InitializeSRWLock(self);
+#elif defined(SD_THREADS_PTHREAD)
+   if (pthread_mutex_init(self, NULL) != 0)
+      SdExit("pthread_mutex_init failed.");
+#else
+   *self = SdMutex_INIT;
+#endif
+}
+
+static void SdMutex_Destroy(SdMutex* self) {
+   SdAssert(self);
+#if defined(SD_THREADS_PTHREAD)
+   pthread_mutex_destroy(self);
+#else
+   (void)self; /* an SRWLOCK holds no resources */
+#endif
+}
+
+static void SdMutex_Lock(SdMutex* self) {
+   SdAssert(self);
+#if defined(SD_THREADS_WIN32)
+   AcquireSRWLockExclusive(self);
+#elif defined(SD_THREADS_PTHREAD)
+   if (pthread_mutex_lock(self) != 0)
+      SdExit("pthread_mutex_lock failed.");
+#else
+   (void)self;
+#endif
+}
+
+static void SdMutex_Unlock(SdMutex* self) {
+   SdAssert(self);
+#if defined(SD_THREADS_WIN32)
+   ReleaseSRWLockExclusive(self);
+#elif defined(SD_THREADS_PTHREAD)
+   pthread_mutex_unlock(self);
+#else
+   (void)self;
+#endif
+}
+
 /* SdResult **********************************************************************************************************/
 static SdResult SdFail(SdErr code, const char* message) {
    SdResult err;
@@ -1174,8 +1880,11 @@ end:
 
 Sad* Sad_New(void) {
    Sad* self = SdAlloc(sizeof(Sad));
+   Sad_r previous = Sad_Enter(self);
    self->env = SdEnv_New();
-   self->engine = SdEngine_New(self->env);
+   self->output = SdOutput_New();
+   self->engine = SdEngine_New(self->env, self->output);
+   Sad_Leave(previous);
    
    /* These are some functions provided for completeness but aren't used at the moment.  We don't want to trigger
       unused function warnings for these particular functions.  The compiler will optimize this out. */
@@ -1189,79 +1898,181 @@ Sad* Sad_New(void) {
 }
 
 void Sad_Delete(Sad* self) {
+   Sad_r previous = NULL;
+
    SdAssert(self);
+   previous = Sad_Enter(self);
    SdEnv_Delete(self->env);
    SdEngine_Delete(self->engine);
+   Sad_Leave(previous);
+   SdOutput_Delete(self->output);
+   SdHeap_FreePages(&self->heap);
    SdFree(self);
 }
 
+/* makes self the current instance on this thread, so that allocations come from its heap; returns the instance to
+   restore with Sad_Leave, which may be another one whose call is further up the stack */
+static Sad_r Sad_Enter(Sad_r self) {
+   Sad_r previous = Sad_Current;
+
+   SdAssert(self);
+   Sad_Current = self;
+   return previous;
+}
+
+static void Sad_Leave(Sad_r previous) {
+   Sad_Current = previous;
+}
+
+void Sad_SetSharedMap(Sad_r self, const char* name, SdSharedMap_r map) {
+   SdAssert(self);
+   SdAssert(name);
+   SdAssert(map);
+   SdEngine_BindSharedMap(self->engine, SdString_FromCStr(name), map);
+}
+
+void Sad_SetOutputSink(Sad_r self, SdOutputSink sink, void* context) {
+   SdAssert(self);
+   SdOutput_SetSink(self->output, sink, context);
+}
+
+void Sad_SetOutputBufferSize(Sad_r self, size_t size) {
+   SdAssert(self);
+   SdOutput_SetBufferSize(self->output, size);
+}
+
+void Sad_Flush(Sad_r self) {
+   SdAssert(self);
+   SdOutput_Flush(self->output);
+}
+
 SdResult Sad_AddScript(Sad_r self, const char* code) {
    SdValue_r program_node = NULL;
    SdResult result = SdResult_SUCCESS;
+   Sad_r previous = NULL;
 
    SdAssert(self);
    SdAssert(code);
-   if (SdFailed(result = SdParser_ParseProgram(self->env, code, &program_node)))
-      return result;
-   return SdEnv_AddProgramAst(self->env, program_node);
+   previous = Sad_Enter(self);
+   if (!SdFailed(result = SdParser_ParseProgram(self->env, code, &program_node)))
+      result = SdEnv_AddProgramAst(self->env, program_node);
+   Sad_Leave(previous);
+   return result;
 }
 
 SdResult Sad_Execute(Sad_r self) {
+   SdResult result = SdResult_SUCCESS;
+   Sad_r previous = NULL;
+
    SdAssert(self);
-   return SdEngine_ExecuteProgram(self->engine);
+   previous = Sad_Enter(self);
+   result = SdEngine_ExecuteProgram(self->engine);
+   SdOutput_Flush(self->output); /* whether or not it failed, so the output comes before any error message */
+   Sad_Leave(previous);
+   return result;
 }
 
 SdResult Sad_ExecuteScript(Sad_r self, const char* code) {
-   SdValue_r program_node = NULL;
    SdResult result = SdResult_SUCCESS;
 
    SdAssert(self);
    SdAssert(code);
-   if (SdFailed(result = SdParser_ParseProgram(self->env, code, &program_node)))
+   if (SdFailed(result = Sad_AddScript(self, code)))
       return result;
-   if (SdFailed(result = SdEnv_AddProgramAst(self->env, program_node)))
-      return result;
-   return SdEngine_ExecuteProgram(self->engine);
+   return Sad_Execute(self);
 }
 
 /* SdString **********************************************************************************************************/
 SdString* SdString_New(void) {
-   SdString* self = SdAlloc(sizeof(SdString));
-   self->buffer = SdAlloc(sizeof(char)); /* one char for the null terminator */
-   return self;
+   return SdString_NewWithLength(0);
 }
 
 SdString* SdString_FromCStr(const char* cstr) {
    SdString* self = NULL;
+   size_t length = 0;
 
    SdAssert(cstr);
-   self = SdAlloc(sizeof(SdString));
-   self->buffer = SdStrdup(cstr);
-   self->length = strlen(cstr);
+   length = strlen(cstr);
+   self = SdString_NewWithLength(length);
+   memcpy(self->buffer, cstr, length);
+   return self;
+}
+
+/* the caller fills in the characters; the buffer comes zeroed, so it is already null-terminated */
+static SdString* SdString_NewWithLength(size_t length) {
+   SdString* self = SdAlloc(sizeof(SdString));
+   self->buffer = SdString_AllocBuffer(self, length);
+   self->length = length;
+   return self;
+}
+
+static SdString* SdString_FromChar(char ch) {
+   SdString* self = SdString_NewWithLength(1);
+   self->buffer[0] = ch;
    return self;
 }
 
+static char* SdString_AllocBuffer(SdString_r self, size_t length) {
+   return length < SdString_INLINE_CAPACITY ? self->inline_chars : SdAlloc(length + 1);
+}
+
+static void SdString_ReleaseAppendBuffer(SdString_r self) {
+   SdAppendBuffer* append_buffer = self->append_buffer;
+
+   self->append_buffer = NULL;
+   if (--append_buffer->num_strings == 0) {
+      SdFree(append_buffer->chars);
+      SdFree(append_buffer);
+   }
+}
+
 void SdString_Delete(SdString* self) {
    SdAssert(self);
-   SdFree(self->buffer);
+   if (self->append_buffer)
+      SdString_ReleaseAppendBuffer(self);
+   else if (self->buffer != self->inline_chars)
+      SdFree(self->buffer);
    SdFree(self);
 }
 
 const char* SdString_CStr(SdString_r self) {
    SdAssert(self);
+   if (self->append_buffer) {
+      if (self->offset + self->length == self->append_buffer->length)
+         return &self->append_buffer->chars[self->offset];
+
+      /* a longer string has since been appended onto the shared characters, or this is a substring that stops 
+         short of the end, so they aren't terminated where this string ends. take a terminated copy of our characters
+         and let go of the shared buffer. */
+      self->buffer = SdString_AllocBuffer(self, self->length);
+      memcpy(self->buffer, &self->append_buffer->chars[self->offset], self->length);
+      self->buffer[self->length] = 0;
+      self->offset = 0;
+      SdString_ReleaseAppendBuffer(self);
+   }
    return self->buffer;
 }
 
+/* the characters without the guarantee of a null terminator after them. unlike SdString_CStr, this never copies. */
+static const char* SdString_Chars(SdString_r self) {
+   SdAssert(self);
+   return self->append_buffer ? &self->append_buffer->chars[self->offset] : self->buffer;
+}
+
 SdBool SdString_Equals(SdString_r a, SdString_r b) {
    SdAssert(a);
    SdAssert(b);
-   return a->length == b->length && strcmp(a->buffer, b->buffer) == 0;
+   if (a == b)
+      return SdTrue;
+   if (a->is_interned && b->is_interned) /* each contents is interned only once */
+      return SdFalse;
+   return a->length == b->length && memcmp(SdString_Chars(a), SdString_Chars(b), a->length) == 0;
 }
 
 SdBool SdString_EqualsCStr(SdString_r a, const char* b) {
    SdAssert(a);
    SdAssert(b);
-   return strcmp(a->buffer, b) == 0;  
+   return strlen(b) == a->length && memcmp(SdString_Chars(a), b, a->length) == 0;
 }
 
 size_t SdString_Length(SdString_r self) {
@@ -1270,14 +2081,276 @@ size_t SdString_Length(SdString_r self) {
 }
 
 int SdString_Compare(SdString_r a, SdString_r b) {
-   const char* a_str = NULL;
-   const char* b_str = NULL;
+   int order = 0;
+
+   SdAssert(a);
+   SdAssert(b);
+   if (a == b)
+      return 0;
+   order = memcmp(SdString_Chars(a), SdString_Chars(b), SdMin(a->length, b->length));
+   if (order != 0)
+      return order;
+   return a->length < b->length ? -1 : a->length > b->length ? 1 : 0;
+}
+
+/* memoized, since the characters of a string never change once written */
+static unsigned int SdString_Hash(SdString_r self) {
+   SdAssert(self);
+   if (!self->has_hash) {
+      self->hash = (int)SdHash_Bytes(SdString_Chars(self), SdString_Length(self));
+      self->has_hash = SdTrue;
+   }
+   return (unsigned int)self->hash;
+}
+
+/* appending onto a string that was itself made by appending, and that nothing longer has been appended onto yet, 
+   writes into the spare capacity of the same buffer. so set s = [s + piece] in a loop copies each piece once, plus
+   the occasional doubling of the buffer, rather than copying all of s every time. the characters of a string never 
+   move or change once written; the earlier string just loses its terminator, which SdString_CStr restores. */
+SdString* SdString_Concat(SdString_r a, SdString_r b) {
+   SdString* self = NULL;
+   SdAppendBuffer* append_buffer = NULL;
+   const char* a_chars = NULL;
+   const char* b_chars = NULL;
+   size_t a_length = 0, b_length = 0, new_length = 0;
 
    SdAssert(a);
    SdAssert(b);
-   a_str = SdString_CStr(a);
-   b_str = SdString_CStr(b);
-   return strcmp(a_str, b_str);
+   a_length = a->length;
+   b_length = b->length;
+   new_length = a_length + b_length;
+   a_chars = SdString_Chars(a);
+   b_chars = SdString_Chars(b);
+
+   if (new_length < SdString_INLINE_CAPACITY) {
+      self = SdString_NewWithLength(new_length);
+      memcpy(self->buffer, a_chars, a_length);
+      memcpy(&self->buffer[a_length], b_chars, b_length);
+      return self;
+   }
+
+   self = SdAlloc(sizeof(SdString));
+   append_buffer = a->append_buffer;
+   if (append_buffer && a->offset + a_length == append_buffer->length && 
+       append_buffer->capacity > append_buffer->length + b_length) {
+      self->offset = a->offset;
+   } else {
+      append_buffer = SdAlloc(sizeof(SdAppendBuffer));
+      append_buffer->capacity = 2 * (new_length + 1);
+      append_buffer->chars = SdAlloc(append_buffer->capacity);
+      memcpy(append_buffer->chars, a_chars, a_length);
+      append_buffer->length = a_length;
+   }
+
+   /* b may live in the same buffer, but only below append_buffer->length, so it doesn't overlap what we write */
+   memcpy(&append_buffer->chars[append_buffer->length], b_chars, b_length);
+   append_buffer->length += b_length;
+   append_buffer->chars[append_buffer->length] = 0;
+   append_buffer->num_strings++;
+
+   self->append_buffer = append_buffer;
+   self->length = new_length;
+   return self;
+}
+
+/* Substrings long enough to be worth it are views that share the parent's characters. A view keeps the whole parent
+   buffer alive, so short pieces of a big string are copied out instead; a view has to cover at least a quarter of
+   the buffer. Either way the cost of the copy is bounded by a constant factor of the substring's length. */
+#define SdString_MIN_VIEW_LENGTH 64
+
+SdString* SdString_Substring(SdString_r self, size_t start, size_t length) {
+   SdString* substring = NULL;
+
+   SdAssert(self);
+   SdAssert(start <= self->length);
+   SdAssert(length <= self->length - start);
+   if (length < SdString_MIN_VIEW_LENGTH || length < self->length / 4 || 
+       (self->append_buffer && length < self->append_buffer->length / 4)) {
+      substring = SdString_NewWithLength(length);
+      memcpy(substring->buffer, &SdString_Chars(self)[start], length);
+      return substring;
+   }
+
+   SdString_Share(self);
+   substring = SdAlloc(sizeof(SdString));
+   substring->append_buffer = self->append_buffer;
+   substring->append_buffer->num_strings++;
+   substring->offset = self->offset + start;
+   substring->length = length;
+   return substring;
+}
+
+/* moves a string's own heap buffer into an append buffer so that other strings can share it. */
+static void SdString_Share(SdString_r self) {
+   SdAppendBuffer* append_buffer = NULL;
+
+   SdAssert(self);
+   if (self->append_buffer)
+      return;
+
+   SdAssert(self->buffer != self->inline_chars); /* short strings are always copied instead */
+   append_buffer = SdAlloc(sizeof(SdAppendBuffer));
+   append_buffer->chars = self->buffer;
+   append_buffer->length = self->length;
+   append_buffer->capacity = self->length + 1;
+   append_buffer->num_strings = 1;
+   self->append_buffer = append_buffer;
+   self->buffer = NULL;
+   self->offset = 0;
+}
+
+/* finds the first occurrence of needle at or after start. an empty needle is found at start. candidate positions are
+   found 16 or 32 at a time by comparing the needle's first and last characters against two shifted blocks of the
+   haystack, and only the positions where both match are checked in full. the scalar loop below finishes the tail 
+   that doesn't fill a whole block. */
+static SdBool SdString_Find(SdString_r self, SdString_r needle, size_t start, size_t* out_index) {
+   const char* chars = NULL;
+   const char* needle_chars = NULL;
+   const char* candidate = NULL;
+   size_t length = 0, needle_length = 0, last = 0;
+
+   SdAssert(self);
+   SdAssert(needle);
+   SdAssert(out_index);
+   length = self->length;
+   needle_length = needle->length;
+   if (start > length || needle_length > length - start)
+      return SdFalse;
+   if (needle_length == 0) {
+      *out_index = start;
+      return SdTrue;
+   }
+
+   chars = SdString_Chars(self);
+   needle_chars = SdString_Chars(needle);
+   last = length - needle_length; /* the last index where the needle could start */
+#ifdef SD_SIMD_AVX2
+   if (SdCpu_HasAvx2()) {
+      start = SdString_FindCandidatesAvx2(chars, start, last, needle_chars, needle_length, out_index);
+      if (start > last + 1)
+         return SdTrue;
+   }
+#endif
+#ifdef SD_SIMD_SSE2
+   start = SdString_FindCandidatesSse2(chars, start, last, needle_chars, needle_length, out_index);
+   if (start > last + 1)
+      return SdTrue;
+#endif
+   while (start <= last) {
+      candidate = memchr(&chars[start], needle_chars[0], last - start + 1);
+      if (!candidate)
+         return SdFalse;
+      start = (size_t)(candidate - chars);
+      if (memcmp(candidate + 1, needle_chars + 1, needle_length - 1) == 0) {
+         *out_index = start;
+         return SdTrue;
+      }
+      start++;
+   }
+   return SdFalse;
+}
+
+/* these scan whole blocks of candidate start positions in [start, last]. if the needle is found, they set *out_index
+   and return a position past last; otherwise they return where the caller should continue. */
+#ifdef SD_SIMD_SSE2
+static size_t SdString_FindCandidatesSse2(const char* chars, size_t start, size_t last, const char* needle, 
+   size_t needle_length, size_t* out_index) {
+   __m128i first = _mm_set1_epi8(needle[0]), final = _mm_set1_epi8(needle[needle_length - 1]);
+
+   for (; start + 16 <= last + 1; start += 16) {
+      __m128i block_first = _mm_loadu_si128((const __m128i*)&chars[start]);
+      __m128i block_final = _mm_loadu_si128((const __m128i*)&chars[start + needle_length - 1]);
+      unsigned int mask = (unsigned int)_mm_movemask_epi8(
+         _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(final, block_final)));
+      while (mask) {
+         size_t index = start + (size_t)SdSimd_LowestBit(mask);
+         if (memcmp(&chars[index], needle, needle_length) == 0) {
+            *out_index = index;
+            return last + 2;
+         }
+         mask &= mask - 1;
+      }
+   }
+   return start;
+}
+#endif
+
+#ifdef SD_SIMD_AVX2
+SD_AVX2_TARGET static size_t SdString_FindCandidatesAvx2(const char* chars, size_t start, size_t last, 
+   const char* needle, size_t needle_length, size_t* out_index) {
+   __m256i first = _mm256_set1_epi8(needle[0]), final = _mm256_set1_epi8(needle[needle_length - 1]);
+
+   for (; start + 32 <= last + 1; start += 32) {
+      __m256i block_first = _mm256_loadu_si256((const __m256i*)&chars[start]);
+      __m256i block_final = _mm256_loadu_si256((const __m256i*)&chars[start + needle_length - 1]);
+      unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+         _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(final, block_final)));
+      while (mask) {
+         size_t index = start + (size_t)SdSimd_LowestBit(mask);
+         if (memcmp(&chars[index], needle, needle_length) == 0) {
+            *out_index = index;
+            return last + 2;
+         }
+         mask &= mask - 1;
+      }
+   }
+   return start;
+}
+#endif
+
+#if defined(SD_SIMD_SSE2) || defined(SD_SIMD_AVX2)
+static int SdSimd_LowestBit(unsigned int mask) { /* mask must not be zero */
+#if defined(__GNUC__) || defined(__clang__)
+   return __builtin_ctz(mask);
+#else
+   int bit = 0;
+   while (!(mask & 1)) {
+      mask >>= 1;
+      bit++;
+   }
+   return bit;
+#endif
+}
+#endif
+
+/* counts non-overlapping occurrences. needle must not be empty. */
+static size_t SdString_Count(SdString_r self, SdString_r needle) {
+   size_t count = 0, start = 0, index = 0;
+
+   SdAssert(self);
+   SdAssert(needle);
+   SdAssert(needle->length > 0);
+   while (SdString_Find(self, needle, start, &index)) {
+      count++;
+      start = index + needle->length;
+   }
+   return count;
+}
+
+/* replaces every non-overlapping occurrence of needle, which must not be empty. returns null if there are none, so 
+   the caller can keep the original string. */
+static SdString* SdString_Replace(SdString_r self, SdString_r needle, SdString_r replacement) {
+   SdStringBuf* buf = NULL;
+   const char* chars = NULL;
+   size_t start = 0, index = 0;
+
+   SdAssert(self);
+   SdAssert(needle);
+   SdAssert(replacement);
+   SdAssert(needle->length > 0);
+   if (!SdString_Find(self, needle, 0, &index))
+      return NULL;
+
+   chars = SdString_Chars(self);
+   buf = SdStringBuf_New();
+   SdStringBuf_Reserve(buf, self->length);
+   do {
+      SdStringBuf_AppendChars(buf, &chars[start], index - start);
+      SdStringBuf_AppendString(buf, replacement);
+      start = index + needle->length;
+   } while (SdString_Find(self, needle, start, &index));
+   SdStringBuf_AppendChars(buf, &chars[start], self->length - start);
+   return SdStringBuf_ToString(buf);
 }
 
 /* SdStringBuf *******************************************************************************************************/
@@ -1285,6 +2358,7 @@ static SdStringBuf* SdStringBuf_New(void) {
    SdStringBuf_r self = SdAlloc(sizeof(SdStringBuf));
    self->str = SdAlloc(sizeof(char)); /* zero-length string, with null terminator */
    self->len = 0;
+   self->capacity = 1;
    return self;
 }
 
@@ -1294,50 +2368,66 @@ static void SdStringBuf_Delete(SdStringBuf* self) {
    SdFree(self);
 }
 
+/* makes room for the string to reach the given length without reallocating. callers that know the final size
+   reserve it up front so that the buffer is allocated exactly once. */
+static void SdStringBuf_Reserve(SdStringBuf_r self, size_t length) {
+   SdAssert(self);
+   if (length + 1 > self->capacity) {
+      self->str = SdRealloc(self->str, length + 1, self->capacity);
+      self->capacity = length + 1;
+   }
+}
+
+/* grows the capacity geometrically so that a series of appends is amortized O(1) per character. */
+static void SdStringBuf_Grow(SdStringBuf_r self, size_t length) {
+   size_t new_capacity = 0;
+
+   SdAssert(self);
+   if (length + 1 > self->capacity) {
+      new_capacity = self->capacity < 8 ? 16 : self->capacity * 2;
+      if (new_capacity < length + 1)
+         new_capacity = length + 1;
+      SdStringBuf_Reserve(self, new_capacity - 1);
+   }
+}
+
 static void SdStringBuf_AppendString(SdStringBuf_r self, SdString_r suffix) {
    SdAssert(self);
    SdAssert(suffix);
-   SdStringBuf_AppendCStr(self, SdString_CStr(suffix));
+   SdStringBuf_AppendChars(self, SdString_Chars(suffix), SdString_Length(suffix));
 }
 
 static void SdStringBuf_AppendCStr(SdStringBuf_r self, const char* suffix) {
-   size_t old_len = 0, suffix_len = 0, new_len = 0;
-
    SdAssert(self);
    SdAssert(suffix);
-   old_len = self->len;
-   suffix_len = strlen(suffix);
-   new_len = old_len + suffix_len;
+   SdStringBuf_AppendChars(self, suffix, strlen(suffix));
+}
+
+static void SdStringBuf_AppendChars(SdStringBuf_r self, const char* chars, size_t count) {
+   size_t new_len = 0;
 
-   self->str = SdRealloc(self->str, new_len + 1, old_len + 1);
-   SdAssert(self->str);
-   memcpy(&self->str[old_len], suffix, suffix_len);
+   SdAssert(self);
+   SdAssert(chars);
+   new_len = self->len + count;
+   SdStringBuf_Grow(self, new_len);
+   memcpy(&self->str[self->len], chars, count);
    self->str[new_len] = 0;
    self->len = new_len;
 }
 
 static void SdStringBuf_AppendChar(SdStringBuf_r self, char ch) {
-   size_t old_len = 0, new_len = 0;
-
    SdAssert(self);
    SdAssert(ch != 0);
-   old_len = self->len;
-   new_len = old_len + 1;
-
-   self->str = SdRealloc(self->str, new_len + 1, old_len + 1);
-   SdAssert(self->str);
-   self->str[old_len] = ch;
-   self->str[new_len] = 0;
-   self->len = new_len;
+   SdStringBuf_Grow(self, self->len + 1);
+   self->str[self->len++] = ch;
+   self->str[self->len] = 0;
 }
 
 static void SdStringBuf_AppendInt(SdStringBuf_r self, int number) {
-   char number_buf[30] = { 0 };
+   char number_buf[SdFormat_INT_BUFFER_SIZE];
 
    SdAssert(self);
-   memset(number_buf, 0, sizeof(number_buf));
-   sprintf(number_buf, "%d", number);
-   SdStringBuf_AppendCStr(self, number_buf);
+   SdStringBuf_AppendChars(self, number_buf, SdFormat_Int(number_buf, number));
 }
 
 static const char* SdStringBuf_CStr(SdStringBuf_r self) {
@@ -1356,25 +2446,514 @@ static size_t SdStringBuf_Length(SdStringBuf_r self) {
    return self->len;
 }
 
-/* SdValue ***********************************************************************************************************/
-static SdValue* SdValue_NewInt(int x) {
-   SdValue* value = SdAllocValue();
-   value->type = SdType_INT;
-   value->payload.int_value = x;
-   return value;
-}
+/* deletes the buffer and hands its characters to a new string without copying them. */
+static SdString* SdStringBuf_ToString(SdStringBuf* self) {
+   SdString* str = NULL;
 
-static SdValue* SdValue_NewDouble(double x) {
-   SdValue* value = SdAllocValue();
-   value->type = SdType_DOUBLE;
-   value->payload.double_value = x;
-   return value;
+   SdAssert(self);
+   if (self->len < SdString_INLINE_CAPACITY) {
+      str = SdString_NewWithLength(self->len);
+      memcpy(str->buffer, self->str, self->len);
+      SdStringBuf_Delete(self);
+      return str;
+   }
+
+   if (self->capacity > self->len + 1)
+      self->str = SdRealloc(self->str, self->len + 1, self->capacity);
+   str = SdAlloc(sizeof(SdString));
+   str->buffer = self->str;
+   str->length = self->len;
+   SdFree(self);
+   return str;
 }
 
-static SdValue* SdValue_NewString(SdString* x) {
-   SdValue* value = NULL;
+/* SdOutput **********************************************************************************************************/
+/* print's text is collected here and handed to the sink in large pieces, instead of one stdio call per print. it is
+   flushed when the program finishes or fails, when the sink or buffer size changes, and by the flush intrinsic. */
+static SdOutput* SdOutput_New(void) {
+   SdOutput* self = SdAlloc(sizeof(SdOutput));
+   self->buffer = SdAlloc(SdOutput_DEFAULT_BUFFER_SIZE);
+   self->capacity = SdOutput_DEFAULT_BUFFER_SIZE;
+   return self;
+}
 
-   SdAssert(x);
+static void SdOutput_Delete(SdOutput* self) {
+   SdAssert(self);
+   SdOutput_Flush(self);
+   if (self->buffer)
+      SdFree(self->buffer);
+   SdFree(self);
+}
+
+/* a null sink means stdout */
+static void SdOutput_SetSink(SdOutput_r self, SdOutputSink sink, void* context) {
+   SdAssert(self);
+   SdOutput_Flush(self);
+   self->sink = sink;
+   self->sink_context = context;
+}
+
+/* a size of zero sends each print straight to the sink */
+static void SdOutput_SetBufferSize(SdOutput_r self, size_t size) {
+   SdAssert(self);
+   SdOutput_Flush(self);
+   if (self->buffer)
+      SdFree(self->buffer);
+   self->buffer = size > 0 ? SdAlloc(size) : NULL;
+   self->capacity = size;
+}
+
+static void SdOutput_Write(SdOutput_r self, const char* chars, size_t length) {
+   SdAssert(self);
+   SdAssert(chars);
+   if (length == 0) /* the buffer may be null when unbuffered, and memcpy mustn't see a null pointer */
+      return;
+   if (self->length + length > self->capacity) {
+      SdOutput_Flush(self);
+      if (length >= self->capacity) { /* it wouldn't fit anyway, so skip the copy */
+         SdOutput_Emit(self, chars, length);
+         return;
+      }
+   }
+   memcpy(&self->buffer[self->length], chars, length);
+   self->length += length;
+}
+
+static void SdOutput_Flush(SdOutput_r self) {
+   SdAssert(self);
+   if (self->length > 0) {
+      SdOutput_Emit(self, self->buffer, self->length);
+      self->length = 0;
+   }
+   if (!self->sink)
+      fflush(stdout);
+}
+
+static void SdOutput_Emit(SdOutput_r self, const char* chars, size_t length) {
+   SdAssert(self);
+   if (length == 0)
+      return;
+   if (self->sink)
+      self->sink(self->sink_context, chars, length);
+   else
+      fwrite(chars, sizeof(char), length, stdout);
+}
+
+/* SdFormat **********************************************************************************************************/
+/* number to text conversions for to-string. neither uses the C library's printf family, which is slow and depends on
+   the locale. */
+static const char SdFormat_DIGIT_PAIRS[] = 
+   "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354"
+   "555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+/* writes the decimal digits two at a time from the end, then moves them to the front. returns the length. */
+static size_t SdFormat_Int(char* buffer, int number) {
+   char digits[SdFormat_INT_BUFFER_SIZE];
+   char* p = &digits[SdFormat_INT_BUFFER_SIZE];
+   unsigned int magnitude = 0;
+   size_t length = 0;
+
+   SdAssert(buffer);
+   magnitude = number < 0 ? 0u - (unsigned int)number : (unsigned int)number; /* INT_MIN has no positive int */
+   while (magnitude >= 100) {
+      unsigned int pair = (magnitude % 100) * 2;
+      magnitude /= 100;
+      *--p = SdFormat_DIGIT_PAIRS[pair + 1];
+      *--p = SdFormat_DIGIT_PAIRS[pair];
+   }
+   if (magnitude >= 10) {
+      *--p = SdFormat_DIGIT_PAIRS[magnitude * 2 + 1];
+      *--p = SdFormat_DIGIT_PAIRS[magnitude * 2];
+   } else {
+      *--p = (char)('0' + magnitude);
+   }
+   if (number < 0)
+      *--p = '-';
+
+   length = (size_t)(&digits[SdFormat_INT_BUFFER_SIZE] - p);
+   memcpy(buffer, p, length);
+   buffer[length] = 0;
+   return length;
+}
+
+/* writes the shortest decimal that reads back as exactly the same double. numbers from 1e-4 up to 1e16 are written
+   out in full, always with a decimal point so that they read as doubles; the rest use an exponent like 1.5e-7.
+   returns the length. */
+static size_t SdFormat_Double(char* buffer, double number) {
+   char digits[20];
+   char* p = buffer;
+   size_t num_digits = 0, i = 0;
+   int exponent = 0, point = 0;
+
+   SdAssert(buffer);
+   if (number != number) {
+      strcpy(buffer, "nan");
+      return 3;
+   }
+   if (number < 0 || (number == 0 && 1 / number < 0)) {
+      *p++ = '-';
+      number = -number;
+   }
+   if (number > DBL_MAX) {
+      strcpy(p, "inf");
+      return (size_t)(p - buffer) + 3;
+   }
+   if (number == 0) {
+      strcpy(p, "0.0");
+      return (size_t)(p - buffer) + 3;
+   }
+
+   num_digits = SdFormat_DoubleDigits(number, digits, &exponent);
+   point = (int)num_digits + exponent; /* the digits are 0.ddd times 10^point */
+   if (point > 0 && point <= 16) {
+      for (i = 0; i < num_digits || (int)i < point; i++) {
+         if ((int)i == point)
+            *p++ = '.';
+         *p++ = i < num_digits ? digits[i] : '0';
+      }
+      if ((int)num_digits <= point) {
+         *p++ = '.';
+         *p++ = '0';
+      }
+   } else if (point > -4 && point <= 0) {
+      *p++ = '0';
+      *p++ = '.';
+      for (i = 0; (int)i < -point; i++)
+         *p++ = '0';
+      memcpy(p, digits, num_digits);
+      p += num_digits;
+   } else {
+      *p++ = digits[0];
+      if (num_digits > 1) {
+         *p++ = '.';
+         memcpy(p, &digits[1], num_digits - 1);
+         p += num_digits - 1;
+      }
+      *p++ = 'e';
+      p += SdFormat_Int(p, point - 1);
+   }
+   *p = 0;
+   return (size_t)(p - buffer);
+}
+
+/* for a finite positive number, writes the shortest digit string d such that d * 10^exponent reads back as the same 
+   number. returns the number of digits. */
+static size_t SdFormat_DoubleDigits(double number, char* digits, int* out_exponent) {
+#ifdef SD_FORMAT_GRISU
+   size_t length = 0;
+
+   SdFormat_Grisu2(number, digits, &length, out_exponent);
+   return length;
+#else
+   /* without 64-bit arithmetic, fall back to asking the C library for more and more digits until they round-trip */
+   char buf[SdFormat_DOUBLE_BUFFER_SIZE];
+   char* exponent_part = NULL;
+   size_t length = 0, i = 0;
+   int precision = 0;
+
+   for (precision = 1; precision <= 17; precision++) {
+      sprintf(buf, "%.*e", precision - 1, number);
+      if (strtod(buf, NULL) == number)
+         break;
+   }
+   exponent_part = strchr(buf, 'e');
+   for (i = 0; &buf[i] < exponent_part; i++)
+      if (buf[i] >= '0' && buf[i] <= '9')
+         digits[length++] = buf[i];
+   while (length > 1 && digits[length - 1] == '0')
+      length--;
+   *out_exponent = atoi(exponent_part + 1) - (int)length + 1;
+   return length;
+#endif
+}
+
+#ifdef SD_FORMAT_GRISU
+/* Grisu2, from Florian Loitsch's "Printing Floating-Point Numbers Quickly and Accurately with Integers" (2010). The
+   number and the halfway points to its neighbors are scaled by a cached power of ten so that the digits can be 
+   generated with integer arithmetic, stopping as soon as the digits so far identify the number uniquely. The output
+   always reads back exactly; in rare cases it is one digit longer than the true shortest. */
+static const unsigned long SdFormat_CACHED_POWERS_F[] = { /* normalized significands of 10^-348, 10^-340, ... 10^340 */
+   0xFA8FD5A0081C0288UL, 0xBAAEE17FA23EBF76UL, 0x8B16FB203055AC76UL, 0xCF42894A5DCE35EAUL, 0x9A6BB0AA55653B2DUL,
+   0xE61ACF033D1A45DFUL, 0xAB70FE17C79AC6CAUL, 0xFF77B1FCBEBCDC4FUL, 0xBE5691EF416BD60CUL, 0x8DD01FAD907FFC3CUL,
+   0xD3515C2831559A83UL, 0x9D71AC8FADA6C9B5UL, 0xEA9C227723EE8BCBUL, 0xAECC49914078536DUL, 0x823C12795DB6CE57UL,
+   0xC21094364DFB5637UL, 0x9096EA6F3848984FUL, 0xD77485CB25823AC7UL, 0xA086CFCD97BF97F4UL, 0xEF340A98172AACE5UL,
+   0xB23867FB2A35B28EUL, 0x84C8D4DFD2C63F3BUL, 0xC5DD44271AD3CDBAUL, 0x936B9FCEBB25C996UL, 0xDBAC6C247D62A584UL,
+   0xA3AB66580D5FDAF6UL, 0xF3E2F893DEC3F126UL, 0xB5B5ADA8AAFF80B8UL, 0x87625F056C7C4A8BUL, 0xC9BCFF6034C13053UL,
+   0x964E858C91BA2655UL, 0xDFF9772470297EBDUL, 0xA6DFBD9FB8E5B88FUL, 0xF8A95FCF88747D94UL, 0xB94470938FA89BCFUL,
+   0x8A08F0F8BF0F156BUL, 0xCDB02555653131B6UL, 0x993FE2C6D07B7FACUL, 0xE45C10C42A2B3B06UL, 0xAA242499697392D3UL,
+   0xFD87B5F28300CA0EUL, 0xBCE5086492111AEBUL, 0x8CBCCC096F5088CCUL, 0xD1B71758E219652CUL, 0x9C40000000000000UL,
+   0xE8D4A51000000000UL, 0xAD78EBC5AC620000UL, 0x813F3978F8940984UL, 0xC097CE7BC90715B3UL, 0x8F7E32CE7BEA5C70UL,
+   0xD5D238A4ABE98068UL, 0x9F4F2726179A2245UL, 0xED63A231D4C4FB27UL, 0xB0DE65388CC8ADA8UL, 0x83C7088E1AAB65DBUL,
+   0xC45D1DF942711D9AUL, 0x924D692CA61BE758UL, 0xDA01EE641A708DEAUL, 0xA26DA3999AEF774AUL, 0xF209787BB47D6B85UL,
+   0xB454E4A179DD1877UL, 0x865B86925B9BC5C2UL, 0xC83553C5C8965D3DUL, 0x952AB45CFA97A0B3UL, 0xDE469FBD99A05FE3UL,
+   0xA59BC234DB398C25UL, 0xF6C69A72A3989F5CUL, 0xB7DCBF5354E9BECEUL, 0x88FCF317F22241E2UL, 0xCC20CE9BD35C78A5UL,
+   0x98165AF37B2153DFUL, 0xE2A0B5DC971F303AUL, 0xA8D9D1535CE3B396UL, 0xFB9B7CD9A4A7443CUL, 0xBB764C4CA7A44410UL,
+   0x8BAB8EEFB6409C1AUL, 0xD01FEF10A657842CUL, 0x9B10A4E5E9913129UL, 0xE7109BFBA19C0C9DUL, 0xAC2820D9623BF429UL,
+   0x80444B5E7AA7CF85UL, 0xBF21E44003ACDD2DUL, 0x8E679C2F5E44FF8FUL, 0xD433179D9C8CB841UL, 0x9E19DB92B4E31BA9UL,
+   0xEB96BF6EBADF77D9UL, 0xAF87023B9BF0EE6BUL
+};
+
+static const short SdFormat_CACHED_POWERS_E[] = {
+   -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927, -901, -874,
+   -847, -821, -794, -768, -741, -715, -688, -661, -635, -608, -582, -555, -529, -502,
+   -475, -449, -422, -396, -369, -343, -316, -289, -263, -236, -210, -183, -157, -130,
+   -103, -77, -50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216, 242,
+   269, 295, 322, 348, 375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+   641, 667, 694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+   1013, 1039, 1066
+};
+
+static const unsigned long SdFormat_POWERS_OF_10[] = {
+   1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL, 10000000000UL, 
+   100000000000UL, 1000000000000UL, 10000000000000UL, 100000000000000UL, 1000000000000000UL, 10000000000000000UL,
+   100000000000000000UL, 1000000000000000000UL, 10000000000000000000UL
+};
+
+#define SdDiyFp_HIDDEN_BIT 0x0010000000000000UL
+#define SdDiyFp_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFUL
+#define SdDiyFp_EXPONENT_BIAS 1075 /* 1023, plus 52 for the binary point after the significand */
+
+static SdDiyFp SdDiyFp_New(unsigned long f, int e) {
+   SdDiyFp x;
+   x.f = f;
+   x.e = e;
+   return x;
+}
+
+static SdDiyFp SdDiyFp_FromDouble(double number) {
+   unsigned long bits = 0;
+   int biased_exponent = 0;
+
+   memcpy(&bits, &number, sizeof(double));
+   biased_exponent = (int)((bits >> 52) & 0x7FF);
+   if (biased_exponent != 0)
+      return SdDiyFp_New((bits & SdDiyFp_SIGNIFICAND_MASK) + SdDiyFp_HIDDEN_BIT, 
+         biased_exponent - SdDiyFp_EXPONENT_BIAS);
+   else /* subnormal */
+      return SdDiyFp_New(bits & SdDiyFp_SIGNIFICAND_MASK, 1 - SdDiyFp_EXPONENT_BIAS);
+}
+
+/* the upper 64 bits of the 128-bit product, rounded, built from 32-bit halves */
+static SdDiyFp SdDiyFp_Multiply(SdDiyFp a, SdDiyFp b) {
+   unsigned long a_hi = a.f >> 32, a_lo = a.f & 0xFFFFFFFFUL, b_hi = b.f >> 32, b_lo = b.f & 0xFFFFFFFFUL;
+   unsigned long hi_hi = a_hi * b_hi, lo_hi = a_lo * b_hi, hi_lo = a_hi * b_lo, lo_lo = a_lo * b_lo;
+   unsigned long middle = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFUL) + (lo_hi & 0xFFFFFFFFUL) + (1UL << 31);
+
+   return SdDiyFp_New(hi_hi + (hi_lo >> 32) + (lo_hi >> 32) + (middle >> 32), a.e + b.e + 64);
+}
+
+static SdDiyFp SdDiyFp_Normalize(SdDiyFp self) {
+   while (!(self.f & 0x8000000000000000UL)) {
+      self.f <<= 1;
+      self.e--;
+   }
+   return self;
+}
+
+static void SdFormat_Grisu2(double number, char* digits, size_t* out_length, int* out_k) {
+   SdDiyFp v, w, upper, lower, cached, one;
+   unsigned long upper_digits = 0, fraction = 0, delta = 0, distance = 0;
+   double dk = 0;
+   int k = 0, index = 0, kappa = 0;
+   size_t length = 0;
+
+   /* the boundaries halfway to the neighboring doubles; the lower one is closer when f is a power of two */
+   v = SdDiyFp_FromDouble(number);
+   upper = SdDiyFp_New((v.f << 1) + 1, v.e - 1);
+   while (!(upper.f & (SdDiyFp_HIDDEN_BIT << 1))) {
+      upper.f <<= 1;
+      upper.e--;
+   }
+   upper.f <<= 10;
+   upper.e -= 10;
+   if (v.f == SdDiyFp_HIDDEN_BIT)
+      lower = SdDiyFp_New((v.f << 2) - 1, v.e - 2);
+   else
+      lower = SdDiyFp_New((v.f << 1) - 1, v.e - 1);
+   lower.f <<= lower.e - upper.e;
+   lower.e = upper.e;
+
+   /* pick the cached power of ten that brings the upper boundary's exponent into [-60, -32] */
+   dk = (-61 - upper.e) * 0.30102999566398114 + 347;
+   k = (int)dk;
+   if (dk - k > 0.0)
+      k++;
+   index = (k >> 3) + 1;
+   *out_k = -(-348 + index * 8);
+   cached = SdDiyFp_New(SdFormat_CACHED_POWERS_F[index], SdFormat_CACHED_POWERS_E[index]);
+
+   w = SdDiyFp_Multiply(SdDiyFp_Normalize(v), cached);
+   upper = SdDiyFp_Multiply(upper, cached);
+   lower = SdDiyFp_Multiply(lower, cached);
+   lower.f++;
+   upper.f--;
+   delta = upper.f - lower.f;
+   distance = upper.f - w.f;
+
+   /* generate digits of the scaled upper boundary: the integer part first, then the fraction */
+   one = SdDiyFp_New(1UL << -upper.e, upper.e);
+   upper_digits = upper.f >> -one.e;
+   fraction = upper.f & (one.f - 1);
+   for (kappa = 1; kappa < 10 && upper_digits >= SdFormat_POWERS_OF_10[kappa]; kappa++) {}
+   while (kappa > 0) {
+      unsigned long digit = upper_digits / SdFormat_POWERS_OF_10[kappa - 1];
+      unsigned long rest = 0;
+
+      upper_digits %= SdFormat_POWERS_OF_10[kappa - 1];
+      if (digit || length)
+         digits[length++] = (char)('0' + digit);
+      kappa--;
+      rest = (upper_digits << -one.e) + fraction;
+      if (rest <= delta) {
+         *out_k += kappa;
+         SdFormat_GrisuRound(digits, length, delta, rest, SdFormat_POWERS_OF_10[kappa] << -one.e, distance);
+         *out_length = length;
+         return;
+      }
+   }
+   for (;;) {
+      unsigned long digit = 0;
+
+      fraction *= 10;
+      delta *= 10;
+      digit = fraction >> -one.e;
+      if (digit || length)
+         digits[length++] = (char)('0' + digit);
+      fraction &= one.f - 1;
+      kappa--;
+      if (fraction < delta) {
+         *out_k += kappa;
+         SdFormat_GrisuRound(digits, length, delta, fraction, one.f, 
+            -kappa < 20 ? distance * SdFormat_POWERS_OF_10[-kappa] : 0);
+         *out_length = length;
+         return;
+      }
+   }
+}
+
+/* nudges the last digit down while that keeps the digits inside the boundaries and brings them closer to the number */
+static void SdFormat_GrisuRound(char* digits, size_t length, unsigned long delta, unsigned long rest, 
+   unsigned long ten_kappa, unsigned long distance) {
+   while (rest < distance && delta - rest >= ten_kappa && 
+          (rest + ten_kappa < distance || distance - rest > rest + ten_kappa - distance)) {
+      digits[length - 1]--;
+      rest += ten_kappa;
+   }
+}
+#endif
+
+/* SdHash ************************************************************************************************************/
+/* SdValue_Hash is built from the 32-bit MurmurHash3 round and finalizer, which only need 32-bit multiplies, so it fits 
+   C89 where the 64-bit wyhash/xxh3 style doesn't. The seed is chosen at random once per process, so scripts can't 
+   predict which keys collide. It can't differ per Sad instance because hashes are memoized in strings and lists, and
+   SdValue_Hash is public API that doesn't take an instance. */
+#define SdHash_C1 0xCC9E2D51u
+#define SdHash_C2 0x1B873593u
+
+/* the seed is process-wide, since shared maps hash their keys the same way in every instance */
+static void SdHash_Init(void) {
+   unsigned int hash = 0x9E3779B9u;
+   int stack_local = 0;
+   void* heap_block = NULL;
+
+   /* with address space layout randomization, the stack and heap addresses differ from run to run as well */
+   heap_block = SdAlloc(1);
+   hash = SdHash_Combine(hash, (unsigned int)time(NULL));
+   hash = SdHash_Combine(hash, (unsigned int)clock());
+   hash = SdHash_Combine(hash, (unsigned int)(size_t)&stack_local);
+   hash = SdHash_Combine(hash, (unsigned int)(size_t)heap_block);
+
+   SdMutex_Lock(&SdHash_SeedLock);
+   if (!SdHash_IsSeeded) {
+      SdHash_Seed = SdHash_Finish(hash);
+      SdHash_IsSeeded = SdTrue;
+   }
+   SdMutex_Unlock(&SdHash_SeedLock);
+   SdFree(heap_block);
+}
+
+static unsigned int SdHash_Rotate(unsigned int x, int bits) {
+   return (x << bits) | (x >> (32 - bits));
+}
+
+/* mixes one 32-bit word into the running hash */
+static unsigned int SdHash_Combine(unsigned int hash, unsigned int word) {
+   word *= SdHash_C1;
+   word = SdHash_Rotate(word, 15);
+   word *= SdHash_C2;
+   hash ^= word;
+   hash = SdHash_Rotate(hash, 13);
+   return hash * 5 + 0xE6546B64u;
+}
+
+/* avalanches the running hash so that every input bit affects every output bit */
+static unsigned int SdHash_Finish(unsigned int hash) {
+   hash ^= hash >> 16;
+   hash *= 0x85EBCA6Bu;
+   hash ^= hash >> 13;
+   hash *= 0xC2B2AE35u;
+   hash ^= hash >> 16;
+   return hash;
+}
+
+static unsigned int SdHash_Int(int x) {
+   return SdHash_Finish(SdHash_Combine(SdHash_Seed, (unsigned int)x));
+}
+
+static unsigned int SdHash_Double(double x) {
+   unsigned int words[sizeof(double) / sizeof(unsigned int)];
+   unsigned int hash = SdHash_Seed;
+   size_t i = 0;
+
+   if (x == 0)
+      x = 0; /* -0.0 == 0.0, so they must hash the same */
+   memcpy(words, &x, sizeof(words));
+   for (i = 0; i < sizeof(double) / sizeof(unsigned int); i++)
+      hash = SdHash_Combine(hash, words[i]);
+   return SdHash_Finish(hash);
+}
+
+static unsigned int SdHash_Bytes(const char* bytes, size_t length) {
+   const unsigned char* p = (const unsigned char*)bytes;
+   unsigned int hash = SdHash_Seed, word = 0;
+   size_t i = 0, num_words = length / 4;
+
+   /* assembling each word from bytes avoids unaligned loads; compilers turn this into a single load */
+   for (i = 0; i < num_words; i++, p += 4) {
+      word = (unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+      hash = SdHash_Combine(hash, word);
+   }
+
+   word = 0;
+   switch (length & 3) {
+      case 3: word |= (unsigned int)p[2] << 16; /* fall through */
+      case 2: word |= (unsigned int)p[1] << 8; /* fall through */
+      case 1: word |= (unsigned int)p[0];
+         hash = SdHash_Combine(hash, word);
+   }
+
+   return SdHash_Finish(hash ^ (unsigned int)length);
+}
+
+/* SdValue ***********************************************************************************************************/
+static SdValue* SdValue_NewInt(int x) {
+   SdValue* value = SdAllocValue();
+   value->type = SdType_INT;
+   value->payload.int_value = x;
+   return value;
+}
+
+static SdValue* SdValue_NewDouble(double x) {
+   SdValue* value = SdAllocValue();
+   value->type = SdType_DOUBLE;
+   value->payload.double_value = x;
+   return value;
+}
+
+static SdValue* SdValue_NewString(SdString* x) {
+   SdValue* value = NULL;
+
+   SdAssert(x);
    value = SdAllocValue();
    value->type = SdType_STRING;
    value->payload.string_value = x;
@@ -1418,6 +2997,97 @@ static SdValue* SdValue_NewError(SdList* x) {
    return value;
 }
 
+static SdValue* SdValue_NewVector(SdList* x) {
+   SdValue* value = SdValue_NewList(x);
+   value->type = SdType_VECTOR;
+   return value;
+}
+
+static SdValue* SdValue_NewHashmap(SdList* x) {
+   SdValue* value = SdValue_NewList(x);
+   value->type = SdType_HASHMAP;
+   return value;
+}
+
+static SdValue* SdValue_NewStream(SdList* x) {
+   SdValue* value = SdValue_NewList(x);
+   value->type = SdType_STREAM;
+   return value;
+}
+
+static SdValue* SdValue_NewIterator(SdIterator* x) {
+   SdValue* value = NULL;
+
+   SdAssert(x);
+   value = SdAllocValue();
+   value->type = SdType_ITERATOR;
+   value->payload.iterator_value = x;
+   return value;
+}
+
+static SdIterator_r SdValue_GetIterator(SdValue_r self) {
+   SdAssert(self);
+   SdAssert(SdValue_Type(self) == SdType_ITERATOR);
+   return self->payload.iterator_value;
+}
+
+static void SdIterator_FreeContents(SdIterator_r self) {
+   SdAssert(self);
+   SdFree(self->counts);
+   SdList_Delete(self->arguments);
+   if (self->resume_indices) SdFree(self->resume_indices);
+   if (self->lines) SdLineReader_Close(self->lines);
+}
+
+static SdValue* SdValue_NewRange(int low, int high) {
+   SdValue* value = NULL;
+
+   value = SdAllocValue();
+   value->type = SdType_RANGE;
+   value->payload.range_value.low = low;
+   value->payload.range_value.high = high;
+   return value;
+}
+
+static SdRange SdValue_GetRange(SdValue_r self) {
+   SdAssert(self);
+   SdAssert(SdValue_Type(self) == SdType_RANGE);
+   return self->payload.range_value;
+}
+
+static size_t SdRange_Count(SdRange self) {
+   if (self.high < self.low)
+      return 0;
+   return (size_t)((unsigned int)self.high - (unsigned int)self.low) + 1;
+}
+
+static SdValue* SdValue_NewSharedMap(SdSharedMap_r x) {
+   SdValue* value = NULL;
+
+   SdAssert(x);
+   value = SdAllocValue();
+   value->type = SdType_SHARED_MAP;
+   value->payload.shared_map_value = x;
+   SdSharedMap_Retain(x);
+   return value;
+}
+
+static SdSharedMap_r SdValue_GetSharedMap(SdValue_r self) {
+   SdAssert(self);
+   SdAssert(SdValue_Type(self) == SdType_SHARED_MAP);
+   return self->payload.shared_map_value;
+}
+
+static SdValue* SdValue_NewArray(SdArray* x) {
+   SdValue* value = NULL;
+
+   SdAssert(x);
+   value = SdAllocValue();
+   value->type = SdArray_ElementType(x) == SdType_INT ? SdType_INT_ARRAY : SdType_DOUBLE_ARRAY;
+   value->payload.array_value = x;
+   return value;
+}
+
 static SdValue* SdValue_NewType(SdType x) {
    SdValue* value = SdValue_NewInt((int)x);
    value->type = SdType_TYPE;
@@ -1434,8 +3104,22 @@ static void SdValue_Delete(SdValue* self) {
       case SdType_LIST:
       case SdType_FUNCTION:
       case SdType_ERROR:
+      case SdType_VECTOR:
+      case SdType_HASHMAP:
+      case SdType_STREAM:
          SdList_Delete(SdValue_GetList(self));
          break;
+      case SdType_INT_ARRAY:
+      case SdType_DOUBLE_ARRAY:
+         SdArray_Delete(SdValue_GetArray(self));
+         break;
+      case SdType_ITERATOR: /* the roots list is a separate value and is collected on its own */
+         SdIterator_FreeContents(SdValue_GetIterator(self));
+         SdFree(SdValue_GetIterator(self));
+         break;
+      case SdType_SHARED_MAP: /* the map itself lives on while the host or another value or instance holds it */
+         SdSharedMap_Delete(SdValue_GetSharedMap(self));
+         break;
       default:
          break; /* nothing to free for these types */
    }
@@ -1477,10 +3161,19 @@ SdList_r SdValue_GetList(SdValue_r self) {
       SdValue_Type(self) == SdType_MUTALIST ||
       SdValue_Type(self) == SdType_LIST ||
       SdValue_Type(self) == SdType_FUNCTION ||
-      SdValue_Type(self) == SdType_ERROR);
+      SdValue_Type(self) == SdType_ERROR ||
+      SdValue_Type(self) == SdType_VECTOR ||
+      SdValue_Type(self) == SdType_HASHMAP ||
+      SdValue_Type(self) == SdType_STREAM);
    return self->payload.list_value;
 }
 
+static SdArray_r SdValue_GetArray(SdValue_r self) {
+   SdAssert(self);
+   SdAssert(SdValue_Type(self) == SdType_INT_ARRAY || SdValue_Type(self) == SdType_DOUBLE_ARRAY);
+   return self->payload.array_value;
+}
+
 SdBool SdValue_Equals(SdValue_r a, SdValue_r b) {
    SdType a_type = SdType_NIL, b_type = SdType_NIL;
    
@@ -1519,244 +3212,442 @@ SdBool SdValue_Equals(SdValue_r a, SdValue_r b) {
       case SdType_BOOL: return SdValue_GetBool(a) == SdValue_GetBool(b);
       case SdType_STRING: return SdString_Equals(SdValue_GetString(a), SdValue_GetString(b));
       case SdType_MUTALIST: case SdType_LIST: return SdList_Equals(SdValue_GetList(a), SdValue_GetList(b));
+      case SdType_VECTOR: return SdVector_Equals(a, b);
+      case SdType_HASHMAP: return SdHashmap_Equals(a, b);
+      case SdType_INT_ARRAY: case SdType_DOUBLE_ARRAY: 
+         return SdArray_Equals(SdValue_GetArray(a), SdValue_GetArray(b));
+      case SdType_RANGE:
+         return SdValue_GetRange(a).low == SdValue_GetRange(b).low && 
+            SdValue_GetRange(a).high == SdValue_GetRange(b).high;
+      case SdType_SHARED_MAP: return SdValue_GetSharedMap(a) == SdValue_GetSharedMap(b);
       default: return SdFalse;
    }
 }
 
 int SdValue_Hash(SdValue_r self) {
-   int hash = 0;
+   unsigned int hash = 0;
 
    SdAssert(self);
    switch (SdValue_Type(self)) {
       case SdType_ANY:
       case SdType_NIL:
+      case SdType_ITERATOR:
          hash = 0;
          break;
 
       case SdType_INT:
       case SdType_TYPE:
-         hash = SdValue_GetInt(self);
+         hash = SdHash_Int(SdValue_GetInt(self));
          break;
 
-      case SdType_DOUBLE: {
-         double number = 0;
-         size_t i = 0, count = 0;
-         
-         number = SdValue_GetDouble(self);
-         count = sizeof(double) / sizeof(int);
-         for (i = 0; i < count; i++) {
-            hash ^= ((int*)&number)[i];
-         }
+      case SdType_DOUBLE:
+         hash = SdHash_Double(SdValue_GetDouble(self));
          break;
-      }
 
       case SdType_BOOL:
-         hash = SdValue_GetBool(self);
+         hash = SdHash_Int(SdValue_GetBool(self));
          break;
-         
-      case SdType_STRING: {
-         size_t i = 0, length = 0, count = 0;
-         SdString_r str = NULL;
-         const char* cstr = NULL;
 
-         str = SdValue_GetString(self);
-         cstr = SdString_CStr(str);
-         length = SdString_Length(str);
-         count = SdMin(sizeof(int) * 8, length);
-         for (i = 0; i < count; i++) {
-            char ch = cstr[i];
-            hash = (hash << 1) ^ ch;
-         }
-         hash ^= length;
+      case SdType_RANGE:
+         hash = SdHash_Combine(SdHash_Seed, (unsigned int)SdValue_GetRange(self).low);
+         hash = SdHash_Finish(SdHash_Combine(hash, (unsigned int)SdValue_GetRange(self).high));
+         break;
+
+      case SdType_SHARED_MAP: /* by identity, like equality */
+         hash = SdHash_Finish(SdHash_Combine(SdHash_Seed, (unsigned int)(size_t)SdValue_GetSharedMap(self)));
+         break;
+         
+      case SdType_STRING:
+         hash = SdString_Hash(SdValue_GetString(self));
          break;
-      }
 
       case SdType_LIST:
       case SdType_MUTALIST:
       case SdType_FUNCTION:
-      case SdType_ERROR: {
+      case SdType_ERROR:
+      case SdType_STREAM: {
          size_t i = 0, length = 0, count = 0;
          SdList_r list = NULL;
+         SdBool is_stable = SdFalse;
 
          list = SdValue_GetList(self);
+         if (list->has_hash) {
+            hash = (unsigned int)list->hash;
+            break;
+         }
+
+         /* a read-only list's hash can be memoized as long as the items it hashes can't change either */
+         is_stable = SdValue_Type(self) == SdType_LIST && list->is_read_only;
          length = SdList_Count(list);
          count = SdMin(sizeof(int) * 8, length);
+         hash = SdHash_Seed;
          for (i = 0; i < count; i++) {
             SdValue_r item = SdList_GetAt(list, i);
-            hash = (hash << 1) ^ SdValue_Hash(item);
+            hash = SdHash_Combine(hash, (unsigned int)SdValue_Hash(item));
+            if (is_stable && !SdValue_HasStableHash(item))
+               is_stable = SdFalse;
+         }
+         hash = SdHash_Finish(hash ^ (unsigned int)length);
+         if (is_stable) {
+            list->hash = (int)hash;
+            list->has_hash = SdTrue;
          }
-         hash ^= length;
          break;
       }
-   }
 
-   return hash;
-}
+      case SdType_VECTOR: { /* hash the items rather than the header so that equal slices hash the same */
+         size_t i = 0, length = 0, count = 0;
 
-static SdBool SdValue_IsGcMarked(SdValue_r self) {
-   SdAssert(self);
-   return self->gc_mark;
-}
+         length = SdVector_Count(self);
+         count = SdMin(sizeof(int) * 8, length);
+         hash = SdHash_Seed;
+         for (i = 0; i < count; i++)
+            hash = SdHash_Combine(hash, (unsigned int)SdValue_Hash(SdVector_GetAt(self, i)));
+         hash = SdHash_Finish(hash ^ (unsigned int)length);
+         break;
+      }
 
-static void SdValue_SetGcMark(SdValue_r self, SdBool mark) {
-   SdAssert(self);
-   self->gc_mark = mark;
-}
+      case SdType_HASHMAP:
+         hash = SdHash_Finish((unsigned int)SdHashmap_Hash(self));
+         break;
 
-/* SdList ************************************************************************************************************/
-SdList* SdList_New(void) {
-   return SdAllocList();
-}
+      case SdType_INT_ARRAY:
+      case SdType_DOUBLE_ARRAY: {
+         size_t i = 0, length = 0, count = 0;
+         SdArray_r array = NULL;
 
-SdList* SdList_NewWithLength(size_t length) {
-   SdList* list = NULL;
-   SdValue_r* elements = NULL;
-   size_t i = 0;
-   
-   list = SdAllocList();
-   if (length == 1) {
-      list->count = 1;
-      list->values.array_1 = SdAlloc1ElementArray();
-      elements = list->values.array_1->elements;
-   } else if (length == 2) {
-      list->count = 2;
-      list->values.array_2 = SdAlloc2ElementArray();
-      elements = list->values.array_2->elements;
-   } else if (length == 3) {
-      list->count = 3;
-      list->values.array_3 = SdAlloc3ElementArray();
-      elements = list->values.array_3->elements;
-   } else if (length == 4) {
-      list->count = 4;
-      list->values.array_4 = SdAlloc4ElementArray();
-      elements = list->values.array_4->elements;
-   } else if (length > 0) {
-      list->count = length;
-      list->values.array_n = SdAlloc(length * sizeof(SdValue_r));
-      elements = list->values.array_n;
+         array = SdValue_GetArray(self);
+         length = SdArray_Count(array);
+         count = SdMin(sizeof(int) * 8, length);
+         hash = SdHash_Seed;
+         for (i = 0; i < count; i++) {
+            if (SdArray_ElementType(array) == SdType_INT)
+               hash = SdHash_Combine(hash, SdHash_Int(SdArray_GetInt(array, i)));
+            else
+               hash = SdHash_Combine(hash, SdHash_Double(SdArray_GetDouble(array, i)));
+         }
+         hash = SdHash_Finish(hash ^ (unsigned int)length);
+         break;
+      }
    }
-   
-   for (i = 0; i < length; i++)
-      elements[i] = &SdValue_NIL;
-   
-   return list;
-}
 
-void SdList_Delete(SdList* self) {
-   SdAssert(self);
-   if (self->count == 1)
-      SdFree1ElementArray(self->values.array_1);
-   else if (self->count == 2)
-      SdFree2ElementArray(self->values.array_2);
-   else if (self->count == 3)
-      SdFree3ElementArray(self->values.array_3);
-   else if (self->count == 4)
-      SdFree4ElementArray(self->values.array_4);
-   else
-      SdFree(self->values.array_n);
-   SdFreeList(self);
+   return (int)hash;
 }
 
-void SdList_MakeReadOnly(SdList_r self) {
+/* whether SdValue_Hash(self) will return the same value for the rest of self's life. called just after hashing self, 
+   so a read-only list with stable items has memoized its hash by now. */
+static SdBool SdValue_HasStableHash(SdValue_r self) {
    SdAssert(self);
-   self->is_read_only = SdTrue;
-}
+   switch (SdValue_Type(self)) {
+      case SdType_NIL:
+      case SdType_INT:
+      case SdType_DOUBLE:
+      case SdType_BOOL:
+      case SdType_STRING:
+      case SdType_TYPE:
+      case SdType_RANGE:
+      case SdType_SHARED_MAP:
+         return SdTrue;
 
-SdBool SdList_IsReadOnly(SdList_r self) {
-   SdAssert(self);
-   return self->is_read_only;
+      case SdType_LIST:
+         return SdValue_GetList(self)->has_hash;
+
+      default:
+         return SdFalse;
+   }
 }
 
-void SdList_Append(SdList_r self, SdValue_r item) {
-   size_t new_count = 0;
-   
-   SdAssert(self);
-   SdAssert(item);
-   new_count = self->count + 1;
-   
-   if (self->is_read_only)
-      SdExit("Attempted to write to a read-only list.");
+/* orders values first by kind (nil, number, bool, string, list, vector, packed array) and then by value within a kind.
+   ints and doubles are both numbers and compare by numeric value. sequences are compared element by element, with a
+   shorter sequence ordered before any longer sequence that it is a prefix of. */
+SdResult SdValue_Compare(SdValue_r a, SdValue_r b, int* out_order) {
+   SdResult result = SdResult_SUCCESS;
+   SdType a_type = SdType_NIL, b_type = SdType_NIL;
+   int a_rank = 0, b_rank = 0;
+
+   SdAssert(a);
+   SdAssert(b);
+   SdAssert(out_order);
+   a_type = SdValue_Type(a);
+   b_type = SdValue_Type(b);
+   *out_order = 0;
+
+   if (SdFailed(result = SdValue_CompareRank(a_type, &a_rank)) || 
+       SdFailed(result = SdValue_CompareRank(b_type, &b_rank)))
+      return result;
+   if (a_rank != b_rank) {
+      *out_order = a_rank < b_rank ? -1 : 1;
+      return SdResult_SUCCESS;
+   }
+
+   if (a_type == SdType_INT && b_type == SdType_INT) {
+      int a_int = SdValue_GetInt(a), b_int = SdValue_GetInt(b);
+      *out_order = a_int < b_int ? -1 : a_int > b_int ? 1 : 0;
+      return SdResult_SUCCESS;
+   } else if (a_type == SdType_INT || a_type == SdType_DOUBLE) {
+      double a_double = a_type == SdType_INT ? (double)SdValue_GetInt(a) : SdValue_GetDouble(a);
+      double b_double = b_type == SdType_INT ? (double)SdValue_GetInt(b) : SdValue_GetDouble(b);
+      *out_order = SdValue_CompareDoubles(a_double, b_double);
+      if (*out_order == 0 && a_type != b_type) /* = says 1 and 1.0 differ, so put the int first */
+         *out_order = a_type == SdType_INT ? -1 : 1;
+      return SdResult_SUCCESS;
+   }
 
-   switch (self->count) {
-      case 0: {
-         Sd1ElementArray* array = SdAlloc1ElementArray();
-         array->elements[0] = item;
-         self->values.array_1 = array;
+   switch (a_type) {
+      case SdType_BOOL:
+         *out_order = (int)(SdValue_GetBool(a) != 0) - (int)(SdValue_GetBool(b) != 0);
          break;
-      }
-      case 1: {
-         Sd2ElementArray* array = SdAlloc2ElementArray();
-         array->elements[0] = self->values.array_1->elements[0];
-         array->elements[1] = item;
-         SdFree1ElementArray(self->values.array_1);
-         self->values.array_2 = array;
+      case SdType_STRING: {
+         int order = SdString_Compare(SdValue_GetString(a), SdValue_GetString(b));
+         *out_order = order < 0 ? -1 : order > 0 ? 1 : 0;
          break;
       }
-      case 2: {
-         Sd3ElementArray* array = SdAlloc3ElementArray();
-         array->elements[0] = self->values.array_2->elements[0];
-         array->elements[1] = self->values.array_2->elements[1];
-         array->elements[2] = item;
-         SdFree2ElementArray(self->values.array_2);
-         self->values.array_3 = array;
+      case SdType_LIST: case SdType_MUTALIST: {
+         SdList_r a_list = SdValue_GetList(a), b_list = SdValue_GetList(b);
+         size_t i = 0, a_count = SdList_Count(a_list), b_count = SdList_Count(b_list);
+         for (i = 0; i < a_count && i < b_count; i++) {
+            if (SdFailed(result = SdValue_Compare(SdList_GetAt(a_list, i), SdList_GetAt(b_list, i), out_order)))
+               return result;
+            if (*out_order != 0)
+               return SdResult_SUCCESS;
+         }
+         *out_order = a_count < b_count ? -1 : a_count > b_count ? 1 : 0;
          break;
       }
-      case 3: {
-         Sd4ElementArray* array = SdAlloc4ElementArray();
-         array->elements[0] = self->values.array_3->elements[0];
-         array->elements[1] = self->values.array_3->elements[1];
-         array->elements[2] = self->values.array_3->elements[2];
-         array->elements[3] = item;
-         SdFree3ElementArray(self->values.array_3);
-         self->values.array_4 = array;
+      case SdType_VECTOR: {
+         size_t i = 0, a_count = SdVector_Count(a), b_count = SdVector_Count(b);
+         for (i = 0; i < a_count && i < b_count; i++) {
+            if (SdFailed(result = SdValue_Compare(SdVector_GetAt(a, i), SdVector_GetAt(b, i), out_order)))
+               return result;
+            if (*out_order != 0)
+               return SdResult_SUCCESS;
+         }
+         *out_order = a_count < b_count ? -1 : a_count > b_count ? 1 : 0;
          break;
       }
-      case 4: {
-         SdValue_r* array = SdAlloc(5 * sizeof(SdValue_r));
-         array[0] = self->values.array_4->elements[0];
-         array[1] = self->values.array_4->elements[1];
-         array[2] = self->values.array_4->elements[2];
-         array[3] = self->values.array_4->elements[3];
-         array[4] = item;
-         SdFree4ElementArray(self->values.array_4);
-         self->values.array_n = array;
+      case SdType_INT_ARRAY: case SdType_DOUBLE_ARRAY: { /* int and double arrays compare numerically, like numbers */
+         SdArray_r a_array = SdValue_GetArray(a), b_array = SdValue_GetArray(b);
+         size_t i = 0, a_count = SdArray_Count(a_array), b_count = SdArray_Count(b_array);
+         for (i = 0; i < a_count && i < b_count; i++) {
+            double a_double = SdArray_ElementType(a_array) == SdType_INT ? (double)SdArray_GetInt(a_array, i) 
+               : SdArray_GetDouble(a_array, i);
+            double b_double = SdArray_ElementType(b_array) == SdType_INT ? (double)SdArray_GetInt(b_array, i) 
+               : SdArray_GetDouble(b_array, i);
+            if ((*out_order = SdValue_CompareDoubles(a_double, b_double)) != 0)
+               return SdResult_SUCCESS;
+         }
+         *out_order = a_count < b_count ? -1 : a_count > b_count ? 1 : 0;
+         if (*out_order == 0 && a_type != b_type) /* as with numbers, the int array goes first */
+            *out_order = a_type == SdType_INT_ARRAY ? -1 : 1;
          break;
       }
-      default: {
-         self->values.array_n = SdRealloc(
-            self->values.array_n, new_count * sizeof(SdValue_r), self->count * sizeof(SdValue_r));
-         SdAssert(self->values.array_n); /* we're growing the list so SdRealloc() shouldn't return NULL. */
-         self->values.array_n[new_count - 1] = item;
+      default:
          break;
-      }
    }
+
+   return SdResult_SUCCESS;
+}
+
+static SdResult SdValue_CompareRank(SdType type, int* out_rank) {
+   SdAssert(out_rank);
+   switch (type) {
+      case SdType_NIL: *out_rank = 0; return SdResult_SUCCESS;
+      case SdType_INT: case SdType_DOUBLE: *out_rank = 1; return SdResult_SUCCESS;
+      case SdType_BOOL: *out_rank = 2; return SdResult_SUCCESS;
+      case SdType_STRING: *out_rank = 3; return SdResult_SUCCESS;
+      case SdType_LIST: case SdType_MUTALIST: *out_rank = 4; return SdResult_SUCCESS;
+      case SdType_VECTOR: *out_rank = 5; return SdResult_SUCCESS;
+      case SdType_INT_ARRAY: case SdType_DOUBLE_ARRAY: *out_rank = 6; return SdResult_SUCCESS;
+      case SdType_HASHMAP: return SdFail(SdErr_TYPE_MISMATCH, "Hashmaps are not ordered.");
+      case SdType_FUNCTION: return SdFail(SdErr_TYPE_MISMATCH, "Functions are not ordered.");
+      case SdType_STREAM: return SdFail(SdErr_TYPE_MISMATCH, "Streams are not ordered.");
+      case SdType_ITERATOR: return SdFail(SdErr_TYPE_MISMATCH, "Iterators are not ordered.");
+      case SdType_RANGE: return SdFail(SdErr_TYPE_MISMATCH, "Ranges are not ordered.");
+      case SdType_SHARED_MAP: return SdFail(SdErr_TYPE_MISMATCH, "Shared maps are not ordered.");
+      case SdType_ERROR: return SdFail(SdErr_TYPE_MISMATCH, "Errors are not ordered.");
+      case SdType_TYPE: return SdFail(SdErr_TYPE_MISMATCH, "Types are not ordered.");
+      default: return SdFail(SdErr_TYPE_MISMATCH, "Values of this type are not ordered.");
+   }
+}
+
+/* NaN is ordered after every other number and equal to itself, so that sorting is well-defined */
+static int SdValue_CompareDoubles(double a, double b) {
+   SdBool a_nan = a != a, b_nan = b != b;
+
+   if (a_nan || b_nan)
+      return a_nan == b_nan ? 0 : a_nan ? 1 : -1;
+   return a < b ? -1 : a > b ? 1 : 0;
+}
+
+static SdBool SdValue_IsGcMarked(SdValue_r self) {
+   SdAssert(self);
+   return self->gc_mark;
+}
+
+static void SdValue_SetGcMark(SdValue_r self, SdBool mark) {
+   SdAssert(self);
+   self->gc_mark = mark;
+}
+
+/* SdList ************************************************************************************************************/
+/* list storage is chosen by capacity rather than count: capacities 1 through 4 come from the slab allocators and larger
+   capacities are plain heap arrays. capacity grows geometrically so that appending n items is amortized O(n). */
+static SdValue_r* SdList_AllocElements(SdListValuesUnion* values, size_t capacity) {
+   SdAssert(values);
+   switch (capacity) {
+      case 0: values->array_n = NULL; return NULL;
+      case 1: values->array_1 = SdAlloc1ElementArray(); return values->array_1->elements;
+      case 2: values->array_2 = SdAlloc2ElementArray(); return values->array_2->elements;
+      case 3: values->array_3 = SdAlloc3ElementArray(); return values->array_3->elements;
+      case 4: values->array_4 = SdAlloc4ElementArray(); return values->array_4->elements;
+      default: values->array_n = SdAlloc(capacity * sizeof(SdValue_r)); return values->array_n;
+   }
+}
+
+static void SdList_FreeElements(SdListValuesUnion values, size_t capacity) {
+   switch (capacity) {
+      case 0: break;
+      case 1: SdFree1ElementArray(values.array_1); break;
+      case 2: SdFree2ElementArray(values.array_2); break;
+      case 3: SdFree3ElementArray(values.array_3); break;
+      case 4: SdFree4ElementArray(values.array_4); break;
+      default: SdFree(values.array_n); break;
+   }
+}
+
+static SdValue_r* SdList_Elements(SdList_r self) {
+   SdAssert(self);
+   switch (self->capacity) {
+      case 0: return NULL;
+      case 1: return self->values.array_1->elements;
+      case 2: return self->values.array_2->elements;
+      case 3: return self->values.array_3->elements;
+      case 4: return self->values.array_4->elements;
+      default: return self->values.array_n;
+   }
+}
+
+static void SdList_SetCapacity(SdList_r self, size_t new_capacity) {
+   SdListValuesUnion old_values = { 0 };
+   SdValue_r* old_elements = NULL;
+   SdValue_r* elements = NULL;
+   size_t i = 0;
+
+   SdAssert(self);
+   SdAssert(new_capacity >= self->count);
+   if (new_capacity == self->capacity)
+      return;
+
+   if (self->capacity > 4 && new_capacity > 4) {
+      self->values.array_n = SdRealloc(self->values.array_n, new_capacity * sizeof(SdValue_r), 
+         self->capacity * sizeof(SdValue_r));
+   } else {
+      old_values = self->values;
+      old_elements = SdList_Elements(self);
+      elements = SdList_AllocElements(&self->values, new_capacity);
+      for (i = 0; i < self->count; i++)
+         elements[i] = old_elements[i];
+      SdList_FreeElements(old_values, self->capacity);
+   }
+
+   self->capacity = new_capacity;
+}
+
+static void SdList_Grow(SdList_r self) {
+   size_t new_capacity = 0;
+
+   SdAssert(self);
+   if (self->capacity == 0)
+      new_capacity = 1;
+   else if (self->capacity < 4)
+      new_capacity = self->capacity == 1 ? 2 : 4;
+   else
+      new_capacity = self->capacity * 2;
+   SdList_SetCapacity(self, new_capacity);
+}
+
+SdList* SdList_New(void) {
+   return SdAllocList();
+}
+
+SdList* SdList_NewWithLength(size_t length) {
+   SdList* list = NULL;
+   SdValue_r* elements = NULL;
+   size_t i = 0;
+   
+   list = SdList_NewWithCapacity(length);
+   elements = SdList_Elements(list);
+   for (i = 0; i < length; i++)
+      elements[i] = &SdValue_NIL;
+   list->count = length;
+   
+   return list;
+}
+
+SdList* SdList_NewWithCapacity(size_t capacity) {
+   SdList* list = NULL;
+
+   list = SdAllocList();
+   SdList_AllocElements(&list->values, capacity);
+   list->capacity = capacity;
+   return list;
+}
+
+void SdList_Delete(SdList* self) {
+   SdAssert(self);
+   SdList_FreeElements(self->values, self->capacity);
+   SdFreeList(self);
+}
+
+void SdList_MakeReadOnly(SdList_r self) {
+   SdAssert(self);
+   self->is_read_only = SdTrue;
+}
+
+SdBool SdList_IsReadOnly(SdList_r self) {
+   SdAssert(self);
+   return self->is_read_only;
+}
+
+void SdList_Reserve(SdList_r self, size_t capacity) {
+   SdAssert(self);
+   if (capacity > self->capacity)
+      SdList_SetCapacity(self, capacity);
+}
+
+size_t SdList_Capacity(SdList_r self) {
+   SdAssert(self);
+   return self->capacity;
+}
+
+void SdList_Append(SdList_r self, SdValue_r item) {
+   SdAssert(self);
+   SdAssert(item);
+   
+   if (self->is_read_only)
+      SdExit("Attempted to write to a read-only list.");
+
+   if (self->count == self->capacity)
+      SdList_Grow(self);
    
-   self->count = new_count;
+   SdList_Elements(self)[self->count] = item;
+   self->count++;
 }
 
 void SdList_SetAt(SdList_r self, size_t index, SdValue_r item) {
    SdAssert(self);
    SdAssert(item);
-   SdAssert(index < self->count + 1);
+   SdAssert(index < self->count);
    
    if (self->is_read_only)
       SdExit("Attempted to write to a read-only list.");
    
-   switch (self->count) {
-      case 1: self->values.array_1->elements[index] = item; break;
-      case 2: self->values.array_2->elements[index] = item; break;
-      case 3: self->values.array_3->elements[index] = item; break;
-      case 4: self->values.array_4->elements[index] = item; break;
-      default: self->values.array_n[index] = item; break;
-   }
+   SdList_Elements(self)[index] = item;
 }
 
 void SdList_InsertAt(SdList_r self, size_t index, SdValue_r item) {
-   SdListValuesUnion old_values = { 0 };
-   SdValue_r* old_elements = NULL;
    SdValue_r* elements = NULL;
-   size_t i = 0, old_count = 0;
-   SdBool is_new_buffer = SdFalse;
+   size_t i = 0;
    
    SdAssert(self);
    SdAssert(item);
@@ -1765,96 +3656,20 @@ void SdList_InsertAt(SdList_r self, size_t index, SdValue_r item) {
    if (self->is_read_only)
       SdExit("Attempted to write to a read-only list.");
    
-   if (index == self->count) {
-      SdList_Append(self, item);
-      return;
-   }
-   
-   old_count = self->count;
-   old_values = self->values;
-   switch (old_count) {
-      case 1: old_elements = self->values.array_1->elements; break;
-      case 2: old_elements = self->values.array_2->elements; break;
-      case 3: old_elements = self->values.array_3->elements; break;
-      case 4: old_elements = self->values.array_4->elements; break;
-      default: old_elements = self->values.array_n; break;
-   }
-   
-   switch (old_count) {
-      case 0:
-         self->values.array_1 = SdAlloc1ElementArray();
-         elements = self->values.array_1->elements;
-         is_new_buffer = SdTrue;
-         break;
-      case 1:
-         self->values.array_2 = SdAlloc2ElementArray();
-         elements = self->values.array_2->elements;
-         is_new_buffer = SdTrue;
-         break;
-      case 2:
-         self->values.array_3 = SdAlloc3ElementArray();
-         elements = self->values.array_3->elements;
-         is_new_buffer = SdTrue;
-         break;
-      case 3:
-         self->values.array_4 = SdAlloc4ElementArray();
-         elements = self->values.array_4->elements;
-         is_new_buffer = SdTrue;
-         break;
-      case 4:
-         self->values.array_n = SdAlloc(5 * sizeof(SdValue_r));
-         elements = self->values.array_n;
-         is_new_buffer = SdTrue;
-         break;
-      default:
-         self->values.array_n = SdRealloc(
-            self->values.array_n, (old_count + 1) * sizeof(SdValue_r), old_count * sizeof(SdValue_r));
-         assert(self->values.array_n != NULL);
-         
-         for (i = old_count; i > index && i <= old_count; i--)
-            self->values.array_n[i] = self->values.array_n[i - 1];
-         self->values.array_n[index] = item;
-         break;
-   }
-   
-   if (is_new_buffer) {
-      switch (old_count) {
-         case 0:
-         case 1:
-         case 2:
-         case 3:
-         case 4:
-            for (i = 0; i < index; i++) {
-               elements[i] = old_elements[i];
-            }
-            elements[index] = item;
-            for (i = index; i < old_count; i++) {
-               elements[i + 1] = old_elements[i];
-            }
-            break;
-      }
-   }
-      
-   switch (old_count) {
-      case 1: SdFree1ElementArray(old_values.array_1); break;
-      case 2: SdFree2ElementArray(old_values.array_2); break;
-      case 3: SdFree3ElementArray(old_values.array_3); break;
-      case 4: SdFree4ElementArray(old_values.array_4); break;
-   }
+   if (self->count == self->capacity)
+      SdList_Grow(self);
    
+   elements = SdList_Elements(self);
+   for (i = self->count; i > index; i--)
+      elements[i] = elements[i - 1];
+   elements[index] = item;
    self->count++;
 }
 
 SdValue_r SdList_GetAt(SdList_r self, size_t index) {
    SdAssert(self);
    SdAssert(index < self->count);
-   switch (self->count) {
-      case 1: return self->values.array_1->elements[index];
-      case 2: return self->values.array_2->elements[index];
-      case 3: return self->values.array_3->elements[index];
-      case 4: return self->values.array_4->elements[index];
-      default: return self->values.array_n[index];
-   }
+   return SdList_Elements(self)[index];
 }
 
 size_t SdList_Count(SdList_r self) {
@@ -1863,12 +3678,9 @@ size_t SdList_Count(SdList_r self) {
 }
 
 SdValue_r SdList_RemoveAt(SdList_r self, size_t index) {
-   SdListValuesUnion old_values = { 0 };
    SdValue_r old_value = NULL;
-   SdValue_r* old_elements = NULL;
    SdValue_r* elements = NULL;
-   size_t i = 0, old_count = 0;
-   SdBool is_new_buffer = SdFalse;
+   size_t i = 0;
    
    SdAssert(self);
    SdAssert(index < self->count);
@@ -1876,66 +3688,16 @@ SdValue_r SdList_RemoveAt(SdList_r self, size_t index) {
    if (self->is_read_only)
       SdExit("Attempted to write to a read-only list.");
    
-   old_count = self->count;
-   old_values = self->values;
-
-   switch (old_count) {
-      case 1: old_elements = self->values.array_1->elements; break;
-      case 2: old_elements = self->values.array_2->elements; break;
-      case 3: old_elements = self->values.array_3->elements; break;
-      case 4: old_elements = self->values.array_4->elements; break;
-      default: old_elements = self->values.array_n; break;
-   }
-   
-   old_value = old_elements[index];
-   for (i = index; i < old_count - 1; i++) {
-      old_elements[i] = old_elements[i + 1];
-   }
-   
-   switch (old_count) {
-      case 1:
-         self->values.array_n = NULL;
-         break;
-      case 2:
-         self->values.array_1 = SdAlloc1ElementArray();
-         elements = self->values.array_1->elements;
-         is_new_buffer = SdTrue;
-         break;
-      case 3:
-         self->values.array_2 = SdAlloc2ElementArray();
-         elements = self->values.array_2->elements;
-         is_new_buffer = SdTrue;
-         break;
-      case 4:
-         self->values.array_3 = SdAlloc3ElementArray();
-         elements = self->values.array_3->elements;
-         is_new_buffer = SdTrue;
-         break;
-      case 5:
-         self->values.array_4 = SdAlloc4ElementArray();
-         elements = self->values.array_4->elements;
-         is_new_buffer = SdTrue;
-         break;
-      default:
-         self->values.array_n = SdRealloc(
-            self->values.array_n, (old_count - 1) * sizeof(SdValue_r), old_count * sizeof(SdValue_r));
-         break;
-   }
-   
-   if (is_new_buffer) {
-      for (i = 0; i < old_count - 1; i++)
-         elements[i] = old_elements[i];
-   }
-
-   switch (old_count) {
-      case 1: SdFree1ElementArray(old_values.array_1); break;
-      case 2: SdFree2ElementArray(old_values.array_2); break;
-      case 3: SdFree3ElementArray(old_values.array_3); break;
-      case 4: SdFree4ElementArray(old_values.array_4); break;
-      case 5: SdFree(old_values.array_n); break;
-   }
-
+   elements = SdList_Elements(self);
+   old_value = elements[index];
+   for (i = index; i < self->count - 1; i++)
+      elements[i] = elements[i + 1];
    self->count--;
+
+   /* give memory back once the list has shrunk well below its capacity, but not so eagerly that alternating appends 
+      and removals thrash the allocator. */
+   if (self->capacity > 4 && self->count <= self->capacity / 4)
+      SdList_SetCapacity(self, self->capacity / 2);
    
    return old_value;
 }
@@ -1946,16 +3708,10 @@ void SdList_Clear(SdList_r self) {
    if (self->is_read_only)
       SdExit("Attempted to write to a read-only list.");
    
-   switch (self->count) {
-      case 1: SdFree1ElementArray(self->values.array_1); break;
-      case 2: SdFree2ElementArray(self->values.array_2); break;
-      case 3: SdFree3ElementArray(self->values.array_3); break;
-      case 4: SdFree4ElementArray(self->values.array_4); break;
-      default: SdFree(self->values.array_n); break;
-   }
-   
+   SdList_FreeElements(self->values, self->capacity);
    self->values.array_n = NULL;
    self->count = 0;
+   self->capacity = 0;
 }
 
 static SdSearchResult SdList_Search(SdList_r list, SdSearchCompareFunc compare_func, void* context) {
@@ -2019,6 +3775,61 @@ static SdBool SdList_InsertBySearch(SdList_r list, SdValue_r item, SdSearchCompa
    }
 }
 
+/* stable merge sort of the positions in 'indices' by the corresponding values in 'keys'. runs that are already in
+   order are detected before merging, so sorted input takes linear time. 'scratch' must have room for 'count' items. */
+static SdResult SdList_SortIndices(SdList_r keys, size_t* indices, size_t* scratch, size_t count) {
+   SdResult result = SdResult_SUCCESS;
+   size_t half = 0, i = 0, j = 0, k = 0;
+   int order = 0;
+
+   SdAssert(keys);
+   SdAssert(indices);
+   SdAssert(scratch);
+
+   if (count <= 8) { /* insertion sort for short runs */
+      for (i = 1; i < count; i++) {
+         size_t index = indices[i];
+         for (j = i; j > 0; j--) {
+            if (SdFailed(result = SdValue_Compare(SdList_GetAt(keys, indices[j - 1]), SdList_GetAt(keys, index), 
+               &order)))
+               return result;
+            if (order <= 0)
+               break;
+            indices[j] = indices[j - 1];
+         }
+         indices[j] = index;
+      }
+      return SdResult_SUCCESS;
+   }
+
+   half = count / 2;
+   if (SdFailed(result = SdList_SortIndices(keys, indices, scratch, half)) ||
+       SdFailed(result = SdList_SortIndices(keys, &indices[half], scratch, count - half)))
+      return result;
+
+   /* if the two halves are already in order then there is nothing to merge */
+   if (SdFailed(result = SdValue_Compare(SdList_GetAt(keys, indices[half - 1]), SdList_GetAt(keys, indices[half]), 
+      &order)))
+      return result;
+   if (order <= 0)
+      return SdResult_SUCCESS;
+
+   memcpy(scratch, indices, half * sizeof(size_t));
+   i = 0; /* position in the left half, which is now in scratch */
+   j = half; /* position in the right half, which is still in place */
+   k = 0; /* output position */
+   while (i < half && j < count) {
+      if (SdFailed(result = SdValue_Compare(SdList_GetAt(keys, indices[j]), SdList_GetAt(keys, scratch[i]), &order)))
+         return result;
+      /* take from the left on ties to keep the sort stable */
+      indices[k++] = order < 0 ? indices[j++] : scratch[i++];
+   }
+   while (i < half)
+      indices[k++] = scratch[i++];
+
+   return SdResult_SUCCESS;
+}
+
 SdBool SdList_Equals(SdList_r a, SdList_r b) {
    size_t i = 0, a_count = 0, b_count = 0;
 
@@ -2047,76 +3858,1661 @@ SdList* SdList_Clone(SdList_r self) {
    return clone;
 }
 
-/* SdFile ************************************************************************************************************/
-SdResult SdFile_WriteAllText(SdString_r file_path, SdString_r text) {
-   SdResult result = SdResult_SUCCESS;
-   FILE* fp = NULL;
-   size_t count = 0;
+/* SdVector **********************************************************************************************************/
+/* a vector is a persistent (immutable) list stored as a 32-way trie of read-only lists. updates copy only the path from
+   the root to the changed leaf, so set-at and append are O(log32 n) and the new vector shares every other node with
+   the old one. a slice shares the whole trie and just narrows the [origin, origin + count) window into it.
+   (list root:List|Nil shift:Int origin:Int count:Int) */
+#define SdVector_BITS 5
+#define SdVector_WIDTH (1 << SdVector_BITS)
+#define SdVector_MASK (SdVector_WIDTH - 1)
 
-   SdAssert(file_path);
-   SdAssert(text);
-   fp = fopen(SdString_CStr(file_path), "w");
-   if (!fp) {
-      result = SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to open the file.");
-      goto end;
-   }
+static SdValue_r SdVector_New(SdEnv_r env, SdValue_r root, int shift, int origin, int count) {
+   SdList* header = NULL;
 
-   count = SdString_Length(text);
-   if (fwrite(SdString_CStr(text), sizeof(char), count, fp) != count) {
-      result = SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to write to the file.");
-      goto end;
-   }
+   SdAssert(env);
+   SdAssert(root);
+   header = SdList_NewWithLength(4);
+   SdList_SetAt(header, 0, root);
+   SdList_SetAt(header, 1, SdEnv_BoxInt(env, shift));
+   SdList_SetAt(header, 2, SdEnv_BoxInt(env, origin));
+   SdList_SetAt(header, 3, SdEnv_BoxInt(env, count));
+   SdList_MakeReadOnly(header);
+   return SdEnv_BoxVector(env, header);
+}
+
+static SdValue_r SdVector_FromList(SdEnv_r env, SdList_r list) {
+   SdList* level = NULL;
+   SdValue_r root = NULL;
+   size_t i = 0, count = 0;
+   int shift = 0;
 
-end:
-   if (fp) fclose(fp);
-   return result;
-}
+   SdAssert(env);
+   SdAssert(list);
+   count = SdList_Count(list);
+   if (count == 0)
+      return SdVector_New(env, SdEnv_BoxNil(env), 0, 0, 0);
 
-SdResult SdFile_ReadAllText(SdString_r file_path, SdString** out_text) {
-   SdResult result = SdResult_SUCCESS;
-   SdStringBuf* buf = NULL;
-   FILE* fp = NULL;
-   char line[1000] = { 0 };
+   /* pack the items into leaves, then repeatedly pack each level's nodes into parents until one root remains. */
+   level = SdList_Clone(list);
+   while (SdTrue) {
+      SdList* parents = NULL;
+      size_t level_count = 0;
 
-   SdAssert(file_path);
-   SdAssert(out_text);
-   fp = fopen(SdString_CStr(file_path), "r");
-   if (!fp) {
-      result = SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to open the file.");
-      goto end;
-   }
+      level_count = SdList_Count(level);
+      parents = SdList_NewWithCapacity((level_count + SdVector_MASK) / SdVector_WIDTH);
+      for (i = 0; i < level_count; i += SdVector_WIDTH) {
+         SdList* node = NULL;
+         size_t j = 0;
 
-   buf = SdStringBuf_New();
-   while (fgets(line, sizeof(line) / sizeof(char), fp)) {
-      SdStringBuf_AppendCStr(buf, line);
+         node = SdList_NewWithLength(SdVector_WIDTH);
+         for (j = 0; j < SdVector_WIDTH && i + j < level_count; j++)
+            SdList_SetAt(node, j, SdList_GetAt(level, i + j));
+         SdList_MakeReadOnly(node);
+         SdList_Append(parents, SdEnv_BoxList(env, node));
+      }
+      SdList_Delete(level);
+      level = parents;
+      if (SdList_Count(level) == 1)
+         break;
+      shift += SdVector_BITS;
    }
 
-   *out_text = SdString_FromCStr(SdStringBuf_CStr(buf));
-end:
-   if (buf) SdStringBuf_Delete(buf);
-   if (fp) fclose(fp);
-   return result;
+   root = SdList_GetAt(level, 0);
+   SdList_Delete(level);
+   return SdVector_New(env, root, shift, 0, (int)count);
 }
 
-/* SdEnv *************************************************************************************************************/
-/* list is (list (list <unrelated> name1:str ...) (list <unrelated> name2:str ...) ...) 
-The objects are sorted by name.  If an exact match is found, then its index is returned.  Otherwise the next highest 
-match is returned.  The index may be one past the end of the list indicating that the search_name is higher than any 
-name in the list. */
-static SdSearchResult SdEnv_BinarySearchByName(SdList_r list, SdString_r search_name) {
-   SdAssert(list);
-   SdAssert(search_name);
-   return SdList_Search(list, SdEnv_BinarySearchByName_CompareFunc, search_name);
+static SdValue_r SdVector_Root(SdValue_r self) {
+   SdAssert(SdValue_Type(self) == SdType_VECTOR);
+   return SdList_GetAt(SdValue_GetList(self), 0);
 }
 
-/* Assume lhs is a list, and compare by the string at index 1 (the name). */
-static int SdEnv_BinarySearchByName_CompareFunc(SdValue_r lhs, void* context) {
-   SdString_r search_name = NULL, pivot_name = NULL;
-   SdList_r pivot_item = NULL;
+static int SdVector_Shift(SdValue_r self) {
+   SdAssert(SdValue_Type(self) == SdType_VECTOR);
+   return SdValue_GetInt(SdList_GetAt(SdValue_GetList(self), 1));
+}
 
-   SdAssert(lhs);
-   SdAssert(context);
-   search_name = context;
+static int SdVector_Origin(SdValue_r self) {
+   SdAssert(SdValue_Type(self) == SdType_VECTOR);
+   return SdValue_GetInt(SdList_GetAt(SdValue_GetList(self), 2));
+}
+
+static size_t SdVector_Count(SdValue_r self) {
+   SdAssert(SdValue_Type(self) == SdType_VECTOR);
+   return (size_t)SdValue_GetInt(SdList_GetAt(SdValue_GetList(self), 3));
+}
+
+static SdValue_r SdVector_GetAt(SdValue_r self, size_t index) {
+   SdValue_r node = NULL;
+   size_t position = 0;
+   int shift = 0;
+
+   SdAssert(self);
+   SdAssert(index < SdVector_Count(self));
+   node = SdVector_Root(self);
+   position = (size_t)SdVector_Origin(self) + index;
+   for (shift = SdVector_Shift(self); shift > 0; shift -= SdVector_BITS)
+      node = SdList_GetAt(SdValue_GetList(node), (position >> shift) & SdVector_MASK);
+   return SdList_GetAt(SdValue_GetList(node), position & SdVector_MASK);
+}
+
+static SdValue_r SdVector_AssocNode(SdEnv_r env, SdValue_r node, int shift, size_t position, SdValue_r item) {
+   SdList* copy = NULL;
+   size_t slot = 0;
+
+   SdAssert(env);
+   SdAssert(node);
+   SdAssert(item);
+   if (SdValue_Type(node) == SdType_NIL)
+      copy = SdList_NewWithLength(SdVector_WIDTH);
+   else
+      copy = SdList_Clone(SdValue_GetList(node));
+
+   slot = (position >> shift) & SdVector_MASK;
+   if (shift == 0) {
+      SdList_SetAt(copy, slot, item);
+   } else {
+      SdValue_r child = SdValue_Type(node) == SdType_NIL ? node : SdList_GetAt(SdValue_GetList(node), slot);
+      SdList_SetAt(copy, slot, SdVector_AssocNode(env, child, shift - SdVector_BITS, position, item));
+   }
+
+   SdList_MakeReadOnly(copy);
+   return SdEnv_BoxList(env, copy);
+}
+
+static SdValue_r SdVector_SetAt(SdEnv_r env, SdValue_r self, size_t index, SdValue_r item) {
+   size_t position = 0;
+   int shift = 0;
+
+   SdAssert(env);
+   SdAssert(self);
+   SdAssert(item);
+   SdAssert(index < SdVector_Count(self));
+   position = (size_t)SdVector_Origin(self) + index;
+   shift = SdVector_Shift(self);
+   return SdVector_New(env, SdVector_AssocNode(env, SdVector_Root(self), shift, position, item), shift,
+      SdVector_Origin(self), (int)SdVector_Count(self));
+}
+
+static SdValue_r SdVector_Append(SdEnv_r env, SdValue_r self, SdValue_r item) {
+   SdValue_r root = NULL;
+   size_t position = 0;
+   int shift = 0;
+
+   SdAssert(env);
+   SdAssert(self);
+   SdAssert(item);
+   root = SdVector_Root(self);
+   shift = SdVector_Shift(self);
+   position = (size_t)SdVector_Origin(self) + SdVector_Count(self);
+
+   /* the trie is full, so push the existing root down one level underneath a new root. */
+   while ((position >> shift) >= SdVector_WIDTH) {
+      SdList* new_root = SdList_NewWithLength(SdVector_WIDTH);
+      SdList_SetAt(new_root, 0, root);
+      SdList_MakeReadOnly(new_root);
+      root = SdEnv_BoxList(env, new_root);
+      shift += SdVector_BITS;
+   }
+
+   return SdVector_New(env, SdVector_AssocNode(env, root, shift, position, item), shift, SdVector_Origin(self),
+      (int)SdVector_Count(self) + 1);
+}
+
+static SdValue_r SdVector_Slice(SdEnv_r env, SdValue_r self, size_t start, size_t end) {
+   SdAssert(env);
+   SdAssert(self);
+   SdAssert(start <= end);
+   SdAssert(end <= SdVector_Count(self));
+   return SdVector_New(env, SdVector_Root(self), SdVector_Shift(self), SdVector_Origin(self) + (int)start,
+      (int)(end - start));
+}
+
+static SdList* SdVector_ToList(SdValue_r self) {
+   SdList* list = NULL;
+   size_t i = 0, count = 0;
+
+   SdAssert(self);
+   count = SdVector_Count(self);
+   list = SdList_NewWithLength(count);
+   for (i = 0; i < count; i++)
+      SdList_SetAt(list, i, SdVector_GetAt(self, i));
+   return list;
+}
+
+static SdBool SdVector_Equals(SdValue_r a, SdValue_r b) {
+   size_t i = 0, count = 0;
+
+   SdAssert(a);
+   SdAssert(b);
+   count = SdVector_Count(a);
+   if (count != SdVector_Count(b))
+      return SdFalse;
+
+   for (i = 0; i < count; i++)
+      if (!SdValue_Equals(SdVector_GetAt(a, i), SdVector_GetAt(b, i)))
+         return SdFalse;
+
+   return SdTrue;
+}
+
+/* SdHashmap *********************************************************************************************************/
+/* a hashmap is a persistent (immutable) hash array mapped trie. each node consumes five bits of the key's hash and is a
+   read-only list laid out as (list datamap:Int nodemap:Int key-1 value-1 ... key-n value-n child-1 ... child-m).
+   a bit set in datamap means that hash fragment holds a key/value pair inline; a bit set in nodemap means it holds a
+   child node. once the hash bits run out, a node is a plain collision bucket with both maps zero. updates copy only
+   the path from the root, so set and remove are O(log32 n) and everything else is shared with the original.
+   (list root:List count:Int) */
+#define SdHashmap_BITS 5
+#define SdHashmap_MASK 31
+#define SdHashmap_MAX_SHIFT 30 /* the last level that still has hash bits to consume */
+
+static int SdHashmap_PopCount(unsigned int x) {
+   int count = 0;
+   while (x) {
+      x &= x - 1;
+      count++;
+   }
+   return count;
+}
+
+static SdValue_r SdHashmap_NewNode(SdEnv_r env, unsigned int datamap, unsigned int nodemap, SdList* items) {
+   SdList* node = NULL;
+   size_t i = 0, count = 0;
+
+   SdAssert(env);
+   SdAssert(items);
+   count = SdList_Count(items);
+   node = SdList_NewWithLength(count + 2);
+   SdList_SetAt(node, 0, SdEnv_BoxInt(env, (int)datamap));
+   SdList_SetAt(node, 1, SdEnv_BoxInt(env, (int)nodemap));
+   for (i = 0; i < count; i++)
+      SdList_SetAt(node, i + 2, SdList_GetAt(items, i));
+   SdList_Delete(items);
+   SdList_MakeReadOnly(node);
+   return SdEnv_BoxList(env, node);
+}
+
+static SdValue_r SdHashmap_New(SdEnv_r env, SdValue_r root, int count) {
+   SdList* header = NULL;
+
+   SdAssert(env);
+   SdAssert(root);
+   header = SdList_NewWithLength(2);
+   SdList_SetAt(header, 0, root);
+   SdList_SetAt(header, 1, SdEnv_BoxInt(env, count));
+   SdList_MakeReadOnly(header);
+   return SdEnv_BoxHashmap(env, header);
+}
+
+static SdValue_r SdHashmap_NewEmpty(SdEnv_r env) {
+   SdAssert(env);
+   return SdHashmap_New(env, SdHashmap_NewNode(env, 0, 0, SdList_New()), 0);
+}
+
+static size_t SdHashmap_Count(SdValue_r self) {
+   SdAssert(SdValue_Type(self) == SdType_HASHMAP);
+   return (size_t)SdValue_GetInt(SdList_GetAt(SdValue_GetList(self), 1));
+}
+
+static unsigned int SdHashmap_NodeDatamap(SdList_r node) {
+   return (unsigned int)SdValue_GetInt(SdList_GetAt(node, 0));
+}
+
+static unsigned int SdHashmap_NodeNodemap(SdList_r node) {
+   return (unsigned int)SdValue_GetInt(SdList_GetAt(node, 1));
+}
+
+static unsigned int SdHashmap_Fragment(unsigned int hash, int shift) {
+   return (hash >> shift) & SdHashmap_MASK;
+}
+
+static SdValue_r SdHashmap_NodeGet(SdValue_r node_val, int shift, unsigned int hash, SdValue_r key) {
+   SdList_r node = NULL;
+   unsigned int datamap = 0, nodemap = 0, bit = 0;
+   size_t i = 0, count = 0;
+
+   while (SdTrue) {
+      node = SdValue_GetList(node_val);
+      if (shift > SdHashmap_MAX_SHIFT) { /* collision bucket */
+         count = SdList_Count(node);
+         for (i = 2; i < count; i += 2)
+            if (SdValue_Equals(SdList_GetAt(node, i), key))
+               return SdList_GetAt(node, i + 1);
+         return NULL;
+      }
+
+      datamap = SdHashmap_NodeDatamap(node);
+      nodemap = SdHashmap_NodeNodemap(node);
+      bit = 1u << SdHashmap_Fragment(hash, shift);
+      if (datamap & bit) {
+         i = 2 + 2 * SdHashmap_PopCount(datamap & (bit - 1));
+         return SdValue_Equals(SdList_GetAt(node, i), key) ? SdList_GetAt(node, i + 1) : NULL;
+      } else if (nodemap & bit) {
+         i = 2 + 2 * SdHashmap_PopCount(datamap) + SdHashmap_PopCount(nodemap & (bit - 1));
+         node_val = SdList_GetAt(node, i);
+         shift += SdHashmap_BITS;
+      } else {
+         return NULL;
+      }
+   }
+}
+
+static SdValue_r SdHashmap_Get(SdValue_r self, SdValue_r key) {
+   SdAssert(self);
+   SdAssert(key);
+   return SdHashmap_NodeGet(SdList_GetAt(SdValue_GetList(self), 0), 0, (unsigned int)SdValue_Hash(key), key);
+}
+
+/* builds the smallest subtree that holds two pairs whose hashes agree on every fragment before shift. */
+static SdValue_r SdHashmap_MergePairs(SdEnv_r env, int shift, unsigned int hash1, SdValue_r key1, SdValue_r value1, 
+   unsigned int hash2, SdValue_r key2, SdValue_r value2) {
+   SdList* items = NULL;
+   unsigned int fragment1 = 0, fragment2 = 0;
+
+   items = SdList_NewWithCapacity(4);
+   if (shift > SdHashmap_MAX_SHIFT) {
+      SdList_Append(items, key1);
+      SdList_Append(items, value1);
+      SdList_Append(items, key2);
+      SdList_Append(items, value2);
+      return SdHashmap_NewNode(env, 0, 0, items);
+   }
+
+   fragment1 = SdHashmap_Fragment(hash1, shift);
+   fragment2 = SdHashmap_Fragment(hash2, shift);
+   if (fragment1 == fragment2) {
+      SdList_Append(items, SdHashmap_MergePairs(env, shift + SdHashmap_BITS, hash1, key1, value1, hash2, key2, 
+         value2));
+      return SdHashmap_NewNode(env, 0, 1u << fragment1, items);
+   } else if (fragment1 < fragment2) {
+      SdList_Append(items, key1);
+      SdList_Append(items, value1);
+      SdList_Append(items, key2);
+      SdList_Append(items, value2);
+   } else {
+      SdList_Append(items, key2);
+      SdList_Append(items, value2);
+      SdList_Append(items, key1);
+      SdList_Append(items, value1);
+   }
+   return SdHashmap_NewNode(env, (1u << fragment1) | (1u << fragment2), 0, items);
+}
+
+static SdList* SdHashmap_CopyItems(SdList_r node) {
+   SdList* items = NULL;
+   size_t i = 0, count = 0;
+
+   count = SdList_Count(node);
+   items = SdList_NewWithCapacity(count);
+   for (i = 2; i < count; i++)
+      SdList_Append(items, SdList_GetAt(node, i));
+   return items;
+}
+
+static SdValue_r SdHashmap_NodeSet(SdEnv_r env, SdValue_r node_val, int shift, unsigned int hash, SdValue_r key, 
+   SdValue_r value, SdBool* out_added) {
+   SdList_r node = NULL;
+   SdList* items = NULL;
+   unsigned int datamap = 0, nodemap = 0, bit = 0;
+   size_t i = 0, count = 0;
+
+   node = SdValue_GetList(node_val);
+   items = SdHashmap_CopyItems(node);
+   if (shift > SdHashmap_MAX_SHIFT) { /* collision bucket */
+      count = SdList_Count(items);
+      for (i = 0; i < count; i += 2) {
+         if (SdValue_Equals(SdList_GetAt(items, i), key)) {
+            SdList_SetAt(items, i + 1, value);
+            *out_added = SdFalse;
+            return SdHashmap_NewNode(env, 0, 0, items);
+         }
+      }
+      SdList_Append(items, key);
+      SdList_Append(items, value);
+      *out_added = SdTrue;
+      return SdHashmap_NewNode(env, 0, 0, items);
+   }
+
+   datamap = SdHashmap_NodeDatamap(node);
+   nodemap = SdHashmap_NodeNodemap(node);
+   bit = 1u << SdHashmap_Fragment(hash, shift);
+   if (datamap & bit) {
+      SdValue_r existing_key = NULL, existing_value = NULL;
+
+      i = 2 * SdHashmap_PopCount(datamap & (bit - 1));
+      existing_key = SdList_GetAt(items, i);
+      existing_value = SdList_GetAt(items, i + 1);
+      if (SdValue_Equals(existing_key, key)) {
+         SdList_SetAt(items, i + 1, value);
+         *out_added = SdFalse;
+         return SdHashmap_NewNode(env, datamap, nodemap, items);
+      } else {
+         /* two different keys share this fragment, so push both of them down into a new child node. */
+         SdValue_r child = SdHashmap_MergePairs(env, shift + SdHashmap_BITS, 
+            (unsigned int)SdValue_Hash(existing_key), existing_key, existing_value, hash, key, value);
+         SdList_RemoveAt(items, i);
+         SdList_RemoveAt(items, i);
+         datamap &= ~bit;
+         nodemap |= bit;
+         SdList_InsertAt(items, 2 * SdHashmap_PopCount(datamap) + SdHashmap_PopCount(nodemap & (bit - 1)), child);
+         *out_added = SdTrue;
+         return SdHashmap_NewNode(env, datamap, nodemap, items);
+      }
+   } else if (nodemap & bit) {
+      i = 2 * SdHashmap_PopCount(datamap) + SdHashmap_PopCount(nodemap & (bit - 1));
+      SdList_SetAt(items, i, SdHashmap_NodeSet(env, SdList_GetAt(items, i), shift + SdHashmap_BITS, hash, key, value,
+         out_added));
+      return SdHashmap_NewNode(env, datamap, nodemap, items);
+   } else {
+      i = 2 * SdHashmap_PopCount(datamap & (bit - 1));
+      SdList_InsertAt(items, i, value);
+      SdList_InsertAt(items, i, key);
+      *out_added = SdTrue;
+      return SdHashmap_NewNode(env, datamap | bit, nodemap, items);
+   }
+}
+
+static SdValue_r SdHashmap_Set(SdEnv_r env, SdValue_r self, SdValue_r key, SdValue_r value) {
+   SdValue_r root = NULL;
+   SdBool added = SdFalse;
+
+   SdAssert(env);
+   SdAssert(self);
+   SdAssert(key);
+   SdAssert(value);
+   root = SdHashmap_NodeSet(env, SdList_GetAt(SdValue_GetList(self), 0), 0, (unsigned int)SdValue_Hash(key), key,
+      value, &added);
+   return SdHashmap_New(env, root, (int)SdHashmap_Count(self) + (added ? 1 : 0));
+}
+
+/* returns NULL if the key was not found. otherwise returns the new node, which may be left holding just one pair and no
+   children; the caller then inlines that pair into its own node so the trie stays as shallow as possible. */
+static SdValue_r SdHashmap_NodeRemove(SdEnv_r env, SdValue_r node_val, int shift, unsigned int hash, SdValue_r key) {
+   SdList_r node = NULL;
+   SdList* items = NULL;
+   unsigned int datamap = 0, nodemap = 0, bit = 0;
+   size_t i = 0, count = 0;
+
+   node = SdValue_GetList(node_val);
+   if (shift > SdHashmap_MAX_SHIFT) { /* collision bucket */
+      count = SdList_Count(node);
+      for (i = 2; i < count; i += 2) {
+         if (SdValue_Equals(SdList_GetAt(node, i), key)) {
+            items = SdHashmap_CopyItems(node);
+            SdList_RemoveAt(items, i - 2);
+            SdList_RemoveAt(items, i - 2);
+            return SdHashmap_NewNode(env, 0, 0, items);
+         }
+      }
+      return NULL;
+   }
+
+   datamap = SdHashmap_NodeDatamap(node);
+   nodemap = SdHashmap_NodeNodemap(node);
+   bit = 1u << SdHashmap_Fragment(hash, shift);
+   if (datamap & bit) {
+      i = 2 * SdHashmap_PopCount(datamap & (bit - 1));
+      if (!SdValue_Equals(SdList_GetAt(node, i + 2), key))
+         return NULL;
+      items = SdHashmap_CopyItems(node);
+      SdList_RemoveAt(items, i);
+      SdList_RemoveAt(items, i);
+      return SdHashmap_NewNode(env, datamap & ~bit, nodemap, items);
+   } else if (nodemap & bit) {
+      SdValue_r new_child = NULL;
+      SdList_r new_child_list = NULL;
+
+      i = 2 * SdHashmap_PopCount(datamap) + SdHashmap_PopCount(nodemap & (bit - 1));
+      new_child = SdHashmap_NodeRemove(env, SdList_GetAt(node, i + 2), shift + SdHashmap_BITS, hash, key);
+      if (!new_child)
+         return NULL;
+
+      items = SdHashmap_CopyItems(node);
+      new_child_list = SdValue_GetList(new_child);
+      if (SdList_Count(new_child_list) == 4 && SdHashmap_NodeNodemap(new_child_list) == 0) {
+         /* the child shrank to a single pair, so pull the pair up into this node in place of the child. */
+         SdValue_r child_key = SdList_GetAt(new_child_list, 2);
+         SdValue_r child_value = SdList_GetAt(new_child_list, 3);
+         SdList_RemoveAt(items, i);
+         nodemap &= ~bit;
+         datamap |= bit;
+         i = 2 * SdHashmap_PopCount(datamap & (bit - 1));
+         SdList_InsertAt(items, i, child_value);
+         SdList_InsertAt(items, i, child_key);
+      } else {
+         SdList_SetAt(items, i, new_child);
+      }
+      return SdHashmap_NewNode(env, datamap, nodemap, items);
+   } else {
+      return NULL;
+   }
+}
+
+static SdValue_r SdHashmap_Remove(SdEnv_r env, SdValue_r self, SdValue_r key) {
+   SdValue_r root = NULL;
+
+   SdAssert(env);
+   SdAssert(self);
+   SdAssert(key);
+   root = SdHashmap_NodeRemove(env, SdList_GetAt(SdValue_GetList(self), 0), 0, (unsigned int)SdValue_Hash(key), key);
+   if (!root)
+      return self; /* the key wasn't there, so the map is unchanged */
+   return SdHashmap_New(env, root, (int)SdHashmap_Count(self) - 1);
+}
+
+static void SdHashmap_NodeAppendPairs(SdEnv_r env, SdValue_r node_val, int shift, SdList_r pairs) {
+   SdList_r node = NULL;
+   size_t i = 0, count = 0, num_data_items = 0;
+
+   node = SdValue_GetList(node_val);
+   count = SdList_Count(node);
+   if (shift > SdHashmap_MAX_SHIFT)
+      num_data_items = count - 2;
+   else
+      num_data_items = 2 * SdHashmap_PopCount(SdHashmap_NodeDatamap(node));
+
+   for (i = 0; i < num_data_items; i += 2) {
+      SdList* pair = SdList_NewWithLength(2);
+      SdList_SetAt(pair, 0, SdList_GetAt(node, i + 2));
+      SdList_SetAt(pair, 1, SdList_GetAt(node, i + 3));
+      SdList_MakeReadOnly(pair);
+      SdList_Append(pairs, SdEnv_BoxList(env, pair));
+   }
+
+   for (i = num_data_items + 2; i < count; i++)
+      SdHashmap_NodeAppendPairs(env, SdList_GetAt(node, i), shift + SdHashmap_BITS, pairs);
+}
+
+static SdList* SdHashmap_ToList(SdEnv_r env, SdValue_r self) {
+   SdList* pairs = NULL;
+
+   SdAssert(env);
+   SdAssert(self);
+   pairs = SdList_NewWithCapacity(SdHashmap_Count(self));
+   SdHashmap_NodeAppendPairs(env, SdList_GetAt(SdValue_GetList(self), 0), 0, pairs);
+   return pairs;
+}
+
+static void SdHashmap_NodeHash(SdValue_r node_val, int shift, int* hash) {
+   SdList_r node = NULL;
+   size_t i = 0, count = 0, num_data_items = 0;
+
+   node = SdValue_GetList(node_val);
+   count = SdList_Count(node);
+   if (shift > SdHashmap_MAX_SHIFT)
+      num_data_items = count - 2;
+   else
+      num_data_items = 2 * SdHashmap_PopCount(SdHashmap_NodeDatamap(node));
+
+   /* combine with xor so that the result doesn't depend on the trie's shape */
+   for (i = 0; i < num_data_items; i += 2)
+      *hash ^= (int)((unsigned int)SdValue_Hash(SdList_GetAt(node, i + 2)) * 31u + 
+         (unsigned int)SdValue_Hash(SdList_GetAt(node, i + 3)));
+
+   for (i = num_data_items + 2; i < count; i++)
+      SdHashmap_NodeHash(SdList_GetAt(node, i), shift + SdHashmap_BITS, hash);
+}
+
+static int SdHashmap_Hash(SdValue_r self) {
+   int hash = 0;
+
+   SdAssert(self);
+   SdHashmap_NodeHash(SdList_GetAt(SdValue_GetList(self), 0), 0, &hash);
+   return hash ^ (int)SdHashmap_Count(self);
+}
+
+static SdBool SdHashmap_NodeIsSubsetOf(SdValue_r node_val, int shift, SdValue_r other) {
+   SdList_r node = NULL;
+   size_t i = 0, count = 0, num_data_items = 0;
+
+   node = SdValue_GetList(node_val);
+   count = SdList_Count(node);
+   if (shift > SdHashmap_MAX_SHIFT)
+      num_data_items = count - 2;
+   else
+      num_data_items = 2 * SdHashmap_PopCount(SdHashmap_NodeDatamap(node));
+
+   for (i = 0; i < num_data_items; i += 2) {
+      SdValue_r other_value = SdHashmap_Get(other, SdList_GetAt(node, i + 2));
+      if (!other_value || !SdValue_Equals(other_value, SdList_GetAt(node, i + 3)))
+         return SdFalse;
+   }
+
+   for (i = num_data_items + 2; i < count; i++)
+      if (!SdHashmap_NodeIsSubsetOf(SdList_GetAt(node, i), shift + SdHashmap_BITS, other))
+         return SdFalse;
+
+   return SdTrue;
+}
+
+static SdBool SdHashmap_Equals(SdValue_r a, SdValue_r b) {
+   SdAssert(a);
+   SdAssert(b);
+   if (SdHashmap_Count(a) != SdHashmap_Count(b))
+      return SdFalse;
+   return SdHashmap_NodeIsSubsetOf(SdList_GetAt(SdValue_GetList(a), 0), 0, b);
+}
+
+/* SdSharedMap *******************************************************************************************************/
+/* a mutable table that outlives any one interpreter, so that several Sad instances in the same process, on the same or
+   separate threads, can share a deduplication set or a set of counters without merging afterwards. its keys and values
+   are copied out of the caller's SdEnv, which is why they are limited to plain values that can be copied without
+   reference to the heap. the keys are split among stripes by hash, each behind its own lock, so that threads working
+   on different keys rarely wait for each other. */
+#define SdSharedMap_INITIAL_BUCKET_COUNT 4
+
+SdSharedMap* SdSharedMap_New(void) {
+   SdSharedMap* self = NULL;
+   size_t i = 0;
+
+   self = SdAlloc(sizeof(SdSharedMap));
+   for (i = 0; i < SdSharedMap_STRIPE_COUNT; i++) {
+      SdSharedMapStripe_r stripe = &self->stripes[i];
+      SdMutex_Init(&stripe->lock);
+      stripe->bucket_count = SdSharedMap_INITIAL_BUCKET_COUNT;
+      stripe->buckets = SdAlloc(stripe->bucket_count * sizeof(SdSharedEntry*));
+   }
+   SdMutex_Init(&self->ref_lock);
+   self->ref_count = 1;
+   return self;
+}
+
+void SdSharedMap_Delete(SdSharedMap* self) {
+   size_t i = 0, j = 0;
+   SdBool is_last = SdFalse;
+
+   SdAssert(self);
+   SdMutex_Lock(&self->ref_lock);
+   SdAssert(self->ref_count > 0);
+   is_last = --self->ref_count == 0;
+   SdMutex_Unlock(&self->ref_lock);
+   if (!is_last)
+      return;
+
+   for (i = 0; i < SdSharedMap_STRIPE_COUNT; i++) {
+      SdSharedMapStripe_r stripe = &self->stripes[i];
+      for (j = 0; j < stripe->bucket_count; j++) {
+         SdSharedEntry* entry = stripe->buckets[j];
+         while (entry) {
+            SdSharedEntry* next = entry->next;
+            SdSharedValue_Release(&entry->key);
+            SdSharedValue_Release(&entry->value);
+            SdFree(entry);
+            entry = next;
+         }
+      }
+      SdFree(stripe->buckets);
+      SdMutex_Destroy(&stripe->lock);
+   }
+   SdMutex_Destroy(&self->ref_lock);
+   SdFree(self);
+}
+
+static void SdSharedMap_Retain(SdSharedMap_r self) {
+   SdAssert(self);
+   SdMutex_Lock(&self->ref_lock);
+   self->ref_count++;
+   SdMutex_Unlock(&self->ref_lock);
+}
+
+/* each stripe is locked in turn, so other threads can change the map while it is being counted */
+size_t SdSharedMap_Count(SdSharedMap_r self) {
+   size_t i = 0, count = 0;
+
+   SdAssert(self);
+   for (i = 0; i < SdSharedMap_STRIPE_COUNT; i++) {
+      SdMutex_Lock(&self->stripes[i].lock);
+      count += self->stripes[i].count;
+      SdMutex_Unlock(&self->stripes[i].lock);
+   }
+   return count;
+}
+
+/* the low bits of the hash pick the stripe and the rest pick the bucket within it */
+static SdSharedMapStripe_r SdSharedMap_Lock(SdSharedMap_r self, unsigned int hash) {
+   SdSharedMapStripe_r stripe = NULL;
+
+   SdAssert(self);
+   stripe = &self->stripes[hash & (SdSharedMap_STRIPE_COUNT - 1)];
+   SdMutex_Lock(&stripe->lock);
+   return stripe;
+}
+
+static void SdSharedMap_Get(SdSharedMap_r self, SdValue_r key, SdSharedValue_r out_value) {
+   unsigned int hash = 0;
+   SdSharedMapStripe_r stripe = NULL;
+   SdSharedEntry_r entry = NULL;
+
+   SdAssert(self);
+   SdAssert(key);
+   SdAssert(out_value);
+   hash = (unsigned int)SdValue_Hash(key);
+   stripe = SdSharedMap_Lock(self, hash);
+   entry = SdSharedMapStripe_Find(stripe, hash, key);
+   if (entry)
+      SdSharedValue_Copy(&entry->value, out_value);
+   else
+      out_value->type = SdType_NIL;
+   SdMutex_Unlock(&stripe->lock);
+}
+
+static void SdSharedMap_Set(SdSharedMap_r self, SdValue_r key, SdValue_r value) {
+   unsigned int hash = 0;
+   SdSharedMapStripe_r stripe = NULL;
+   SdSharedEntry_r entry = NULL;
+   SdSharedValue frozen, old;
+
+   SdAssert(self);
+   SdAssert(key);
+   SdAssert(value);
+   hash = (unsigned int)SdValue_Hash(key);
+   SdSharedValue_Freeze(value, &frozen); /* copied before locking, and the old value is freed after */
+   stripe = SdSharedMap_Lock(self, hash);
+   entry = SdSharedMapStripe_Find(stripe, hash, key);
+   if (!entry)
+      entry = SdSharedMapStripe_Insert(stripe, hash, key);
+   old = entry->value;
+   entry->value = frozen;
+   SdMutex_Unlock(&stripe->lock);
+   SdSharedValue_Release(&old);
+}
+
+static SdBool SdSharedMap_Add(SdSharedMap_r self, SdValue_r key) {
+   unsigned int hash = 0;
+   SdSharedMapStripe_r stripe = NULL;
+   SdBool is_new = SdFalse;
+
+   SdAssert(self);
+   SdAssert(key);
+   hash = (unsigned int)SdValue_Hash(key);
+   stripe = SdSharedMap_Lock(self, hash);
+   is_new = !SdSharedMapStripe_Find(stripe, hash, key);
+   if (is_new)
+      SdSharedMapStripe_Insert(stripe, hash, key);
+   SdMutex_Unlock(&stripe->lock);
+   return is_new;
+}
+
+/* the read and the write happen under one lock, so concurrent increments are never lost. a count that would overflow
+   is left as it was. */
+static SdResult SdSharedMap_Increment(SdSharedMap_r self, SdValue_r key, int delta, int* out_count) {
+   SdResult result = SdResult_SUCCESS;
+   unsigned int hash = 0;
+   SdSharedMapStripe_r stripe = NULL;
+   SdSharedEntry_r entry = NULL;
+   int count = 0;
+
+   SdAssert(self);
+   SdAssert(key);
+   SdAssert(out_count);
+   hash = (unsigned int)SdValue_Hash(key);
+   stripe = SdSharedMap_Lock(self, hash);
+   entry = SdSharedMapStripe_Find(stripe, hash, key);
+   if (!entry)
+      entry = SdSharedMapStripe_Insert(stripe, hash, key);
+   if (entry->value.type == SdType_NIL) {
+      entry->value.type = SdType_INT;
+      entry->value.payload.int_value = 0;
+   }
+   count = entry->value.payload.int_value;
+   if (entry->value.type != SdType_INT)
+      result = SdFail(SdErr_TYPE_MISMATCH, "The shared value to increment must be an int.");
+   else if ((delta > 0 && count > INT_MAX - delta) || (delta < 0 && count < INT_MIN - delta))
+      result = SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "The shared count would overflow.");
+   else
+      *out_count = entry->value.payload.int_value = count + delta;
+   SdMutex_Unlock(&stripe->lock);
+   return result;
+}
+
+static SdBool SdSharedValue_CanStore(SdValue_r value) {
+   SdAssert(value);
+   switch (SdValue_Type(value)) {
+      case SdType_NIL: case SdType_INT: case SdType_DOUBLE: case SdType_BOOL: case SdType_STRING:
+         return SdTrue;
+      default:
+         return SdFalse;
+   }
+}
+
+static void SdSharedValue_Freeze(SdValue_r value, SdSharedValue_r out_frozen) {
+   SdAssert(value);
+   SdAssert(out_frozen);
+   SdAssert(SdSharedValue_CanStore(value));
+   out_frozen->type = SdValue_Type(value);
+   out_frozen->payload = value->payload;
+   if (out_frozen->type == SdType_STRING)
+      out_frozen->payload.string_value = SdSharedValue_CopyString(SdValue_GetString(value));
+}
+
+static void SdSharedValue_Copy(SdSharedValue_r frozen, SdSharedValue_r out_copy) {
+   SdAssert(frozen);
+   SdAssert(out_copy);
+   *out_copy = *frozen;
+   if (out_copy->type == SdType_STRING)
+      out_copy->payload.string_value = SdSharedValue_CopyString(frozen->payload.string_value);
+}
+
+static SdValue_r SdSharedValue_Box(SdEnv_r env, SdSharedValue_r frozen) {
+   SdAssert(env);
+   SdAssert(frozen);
+   switch (frozen->type) {
+      case SdType_INT: return SdEnv_BoxInt(env, frozen->payload.int_value);
+      case SdType_DOUBLE: return SdEnv_BoxDouble(env, frozen->payload.double_value);
+      case SdType_BOOL: return SdEnv_BoxBool(env, frozen->payload.bool_value);
+      case SdType_STRING: return SdEnv_BoxString(env, frozen->payload.string_value);
+      default: return SdEnv_BoxNil(env);
+   }
+}
+
+/* a standalone copy; a substring view would keep the other SdEnv's append buffer alive */
+static SdString* SdSharedValue_CopyString(SdString_r str) {
+   SdString* copy = NULL;
+
+   SdAssert(str);
+   copy = SdString_NewWithLength(SdString_Length(str));
+   memcpy(copy->buffer, SdString_Chars(str), SdString_Length(str));
+   return copy;
+}
+
+static void SdSharedValue_Release(SdSharedValue_r frozen) {
+   SdAssert(frozen);
+   if (frozen->type == SdType_STRING)
+      SdString_Delete(frozen->payload.string_value);
+   frozen->type = SdType_NIL;
+}
+
+static SdBool SdSharedValue_Matches(SdSharedValue_r frozen, SdValue_r value) {
+   SdAssert(frozen);
+   SdAssert(value);
+   if (frozen->type != SdValue_Type(value))
+      return SdFalse;
+   switch (frozen->type) {
+      case SdType_INT: return frozen->payload.int_value == SdValue_GetInt(value);
+      case SdType_DOUBLE: return frozen->payload.double_value == SdValue_GetDouble(value);
+      case SdType_BOOL: return frozen->payload.bool_value == SdValue_GetBool(value);
+      case SdType_STRING: return SdString_Equals(frozen->payload.string_value, SdValue_GetString(value));
+      default: return SdTrue;
+   }
+}
+
+/* the stripe's lock must be held for these */
+static SdSharedEntry_r SdSharedMapStripe_Find(SdSharedMapStripe_r self, unsigned int hash, SdValue_r key) {
+   SdSharedEntry_r entry = NULL;
+
+   SdAssert(self);
+   SdAssert(key);
+   for (entry = self->buckets[(hash / SdSharedMap_STRIPE_COUNT) & (self->bucket_count - 1)]; entry; 
+        entry = entry->next)
+      if (entry->hash == hash && SdSharedValue_Matches(&entry->key, key))
+         return entry;
+   return NULL;
+}
+
+static SdSharedEntry_r SdSharedMapStripe_Insert(SdSharedMapStripe_r self, unsigned int hash, SdValue_r key) {
+   SdSharedEntry* entry = NULL;
+   size_t bucket = 0;
+
+   SdAssert(self);
+   SdAssert(key);
+   SdAssert(!SdSharedMapStripe_Find(self, hash, key));
+   if (self->count >= self->bucket_count)
+      SdSharedMapStripe_Grow(self);
+   entry = SdAlloc(sizeof(SdSharedEntry));
+   entry->hash = hash;
+   SdSharedValue_Freeze(key, &entry->key);
+   entry->value.type = SdType_NIL;
+   bucket = (hash / SdSharedMap_STRIPE_COUNT) & (self->bucket_count - 1);
+   entry->next = self->buckets[bucket];
+   self->buckets[bucket] = entry;
+   self->count++;
+   return entry;
+}
+
+static void SdSharedMapStripe_Grow(SdSharedMapStripe_r self) {
+   SdSharedEntry** old_buckets = NULL;
+   size_t old_bucket_count = 0, i = 0;
+
+   SdAssert(self);
+   old_buckets = self->buckets;
+   old_bucket_count = self->bucket_count;
+   self->bucket_count *= 2;
+   self->buckets = SdAlloc(self->bucket_count * sizeof(SdSharedEntry*));
+   for (i = 0; i < old_bucket_count; i++) {
+      SdSharedEntry* entry = old_buckets[i];
+      while (entry) {
+         SdSharedEntry* next = entry->next;
+         size_t bucket = (entry->hash / SdSharedMap_STRIPE_COUNT) & (self->bucket_count - 1);
+         entry->next = self->buckets[bucket];
+         self->buckets[bucket] = entry;
+         entry = next;
+      }
+   }
+   SdFree(old_buckets);
+}
+
+/* SdArray ***********************************************************************************************************/
+/* a packed array of unboxed ints or doubles. the elements live in one contiguous buffer and only become SdValues when
+   they're read out; the buffer grows geometrically like SdList. */
+static SdArray* SdArray_New(SdType element_type, size_t length) {
+   SdArray* self = NULL;
+
+   SdAssert(element_type == SdType_INT || element_type == SdType_DOUBLE);
+   self = SdAlloc(sizeof(SdArray));
+   self->element_type = element_type;
+   SdArray_Reserve(self, length);
+   self->count = length; /* SdAlloc zero-fills, so the new elements are all 0 or 0.0 */
+   return self;
+}
+
+static void SdArray_Delete(SdArray* self) {
+   SdAssert(self);
+   if (self->element_type == SdType_INT)
+      SdFree(self->elements.ints);
+   else
+      SdFree(self->elements.doubles);
+   SdFree(self);
+}
+
+static size_t SdArray_ElementSize(SdArray_r self) {
+   SdAssert(self);
+   return self->element_type == SdType_INT ? sizeof(int) : sizeof(double);
+}
+
+static void SdArray_Reserve(SdArray_r self, size_t capacity) {
+   size_t element_size = 0;
+   void* elements = NULL;
+
+   SdAssert(self);
+   if (capacity <= self->capacity)
+      return;
+
+   element_size = SdArray_ElementSize(self);
+   if (self->capacity == 0) {
+      elements = SdAlloc(capacity * element_size);
+   } else {
+      elements = self->element_type == SdType_INT ? (void*)self->elements.ints : (void*)self->elements.doubles;
+      elements = SdRealloc(elements, capacity * element_size, self->capacity * element_size);
+      memset((char*)elements + self->capacity * element_size, 0, (capacity - self->capacity) * element_size);
+   }
+
+   if (self->element_type == SdType_INT)
+      self->elements.ints = elements;
+   else
+      self->elements.doubles = elements;
+   self->capacity = capacity;
+}
+
+static size_t SdArray_Count(SdArray_r self) {
+   SdAssert(self);
+   return self->count;
+}
+
+static SdType SdArray_ElementType(SdArray_r self) {
+   SdAssert(self);
+   return self->element_type;
+}
+
+static int SdArray_GetInt(SdArray_r self, size_t index) {
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_INT);
+   SdAssert(index < self->count);
+   return self->elements.ints[index];
+}
+
+static double SdArray_GetDouble(SdArray_r self, size_t index) {
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_DOUBLE);
+   SdAssert(index < self->count);
+   return self->elements.doubles[index];
+}
+
+static void SdArray_SetInt(SdArray_r self, size_t index, int x) {
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_INT);
+   SdAssert(index < self->count);
+   self->elements.ints[index] = x;
+}
+
+static void SdArray_SetDouble(SdArray_r self, size_t index, double x) {
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_DOUBLE);
+   SdAssert(index < self->count);
+   self->elements.doubles[index] = x;
+}
+
+static void SdArray_Grow(SdArray_r self) {
+   SdAssert(self);
+   if (self->count == self->capacity)
+      SdArray_Reserve(self, self->capacity < 4 ? 4 : self->capacity * 2);
+}
+
+static void SdArray_AppendInt(SdArray_r self, int x) {
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_INT);
+   SdArray_Grow(self);
+   self->elements.ints[self->count++] = x;
+}
+
+static void SdArray_AppendDouble(SdArray_r self, double x) {
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_DOUBLE);
+   SdArray_Grow(self);
+   self->elements.doubles[self->count++] = x;
+}
+
+static SdBool SdArray_Equals(SdArray_r a, SdArray_r b) {
+   size_t i = 0;
+
+   SdAssert(a);
+   SdAssert(b);
+   if (a->element_type != b->element_type || a->count != b->count)
+      return SdFalse;
+
+   if (a->element_type == SdType_INT) {
+      for (i = 0; i < a->count; i++)
+         if (a->elements.ints[i] != b->elements.ints[i])
+            return SdFalse;
+   } else {
+      for (i = 0; i < a->count; i++)
+         if (a->elements.doubles[i] != b->elements.doubles[i])
+            return SdFalse;
+   }
+   return SdTrue;
+}
+
+/* the bulk kernels below run a whole-array operation in one native loop rather than one interpreted call per element.
+   when SSE2 is available at compile time (it is part of the x86-64 baseline) the loops handle two doubles or four ints
+   per instruction. on x86 compilers that can target AVX2 per function, the CPU is also checked at runtime and the AVX2
+   loops handle four doubles or eight ints at a time. whatever is left over is finished by the plain loops. */
+#ifdef SD_SIMD_AVX2
+static SdBool SdCpu_HasAvx2(void) {
+   static int has_avx2 = -1; /* not yet checked */
+
+   if (has_avx2 < 0) {
+#ifdef _MSC_VER
+      int info[4];
+      has_avx2 = 0;
+      __cpuid(info, 0);
+      if (info[0] >= 7) {
+         __cpuid(info, 1);
+         /* the OS must save the AVX registers (OSXSAVE, then XCR0 bits 1 and 2) before the CPU bit means anything */
+         if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            has_avx2 = (info[1] & (1 << 5)) != 0;
+         }
+      }
+#else
+      __builtin_cpu_init();
+      has_avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+   }
+   return has_avx2 != 0;
+}
+
+/* each of these handles the largest prefix that fills whole AVX2 registers and returns how many elements it did */
+SD_AVX2_TARGET static size_t SdArray_ElementwiseDoubleAvx2(SdArrayOp op, const double* x, const double* y, double* z,
+   size_t n) {
+   size_t i = 0;
+
+   for (; i + 4 <= n; i += 4) {
+      __m256d a = _mm256_loadu_pd(&x[i]), b = _mm256_loadu_pd(&y[i]), c;
+      switch (op) {
+         case SdArrayOp_ADD: c = _mm256_add_pd(a, b); break;
+         case SdArrayOp_SUBTRACT: c = _mm256_sub_pd(a, b); break;
+         case SdArrayOp_MULTIPLY: c = _mm256_mul_pd(a, b); break;
+         default: c = _mm256_div_pd(a, b); break;
+      }
+      _mm256_storeu_pd(&z[i], c);
+   }
+   return i;
+}
+
+SD_AVX2_TARGET static size_t SdArray_ElementwiseIntAvx2(SdArrayOp op, const int* x, const int* y, int* z, size_t n) {
+   size_t i = 0;
+
+   if (op == SdArrayOp_DIVIDE) /* there is no packed integer divide */
+      return 0;
+   for (; i + 8 <= n; i += 8) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)&x[i]), b = _mm256_loadu_si256((const __m256i*)&y[i]), c;
+      switch (op) {
+         case SdArrayOp_ADD: c = _mm256_add_epi32(a, b); break;
+         case SdArrayOp_SUBTRACT: c = _mm256_sub_epi32(a, b); break;
+         default: c = _mm256_mullo_epi32(a, b); break;
+      }
+      _mm256_storeu_si256((__m256i*)&z[i], c);
+   }
+   return i;
+}
+
+/* y may be null, in which case this sums x instead of taking the dot product */
+SD_AVX2_TARGET static size_t SdArray_DotDoubleAvx2(const double* x, const double* y, size_t n, double* out_total) {
+   __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+   double lanes[4];
+   size_t i = 0;
+
+   for (; i + 8 <= n; i += 8) {
+      __m256d a0 = _mm256_loadu_pd(&x[i]), a1 = _mm256_loadu_pd(&x[i + 4]);
+      if (y) {
+         a0 = _mm256_mul_pd(a0, _mm256_loadu_pd(&y[i]));
+         a1 = _mm256_mul_pd(a1, _mm256_loadu_pd(&y[i + 4]));
+      }
+      acc0 = _mm256_add_pd(acc0, a0);
+      acc1 = _mm256_add_pd(acc1, a1);
+   }
+   _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+   *out_total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+   return i;
+}
+
+SD_AVX2_TARGET static size_t SdArray_SumIntAvx2(const int* x, size_t n, unsigned int* out_total) {
+   __m256i acc = _mm256_setzero_si256();
+   unsigned int lanes[8];
+   size_t i = 0, j = 0;
+
+   for (; i + 8 <= n; i += 8)
+      acc = _mm256_add_epi32(acc, _mm256_loadu_si256((const __m256i*)&x[i]));
+   _mm256_storeu_si256((__m256i*)lanes, acc);
+   *out_total = 0;
+   for (j = 0; j < 8; j++)
+      *out_total += lanes[j];
+   return i;
+}
+
+/* sets *out_has_nan if any NaN was seen; otherwise *out_extreme is the min or max of the elements processed */
+SD_AVX2_TARGET static size_t SdArray_ExtremeDoubleAvx2(const double* x, size_t n, SdBool is_max, double* out_extreme,
+   SdBool* out_has_nan) {
+   __m256d acc, nan_mask;
+   double lanes[4];
+   size_t i = 0, j = 0;
+
+   if (n < 4)
+      return 0;
+   acc = _mm256_loadu_pd(x);
+   nan_mask = _mm256_cmp_pd(acc, acc, _CMP_UNORD_Q);
+   for (i = 4; i + 4 <= n; i += 4) {
+      __m256d a = _mm256_loadu_pd(&x[i]);
+      nan_mask = _mm256_or_pd(nan_mask, _mm256_cmp_pd(a, a, _CMP_UNORD_Q));
+      acc = is_max ? _mm256_max_pd(acc, a) : _mm256_min_pd(acc, a);
+   }
+   *out_has_nan = _mm256_movemask_pd(nan_mask) != 0;
+   _mm256_storeu_pd(lanes, acc);
+   *out_extreme = lanes[0];
+   for (j = 1; j < 4; j++)
+      if (is_max ? lanes[j] > *out_extreme : lanes[j] < *out_extreme)
+         *out_extreme = lanes[j];
+   return i;
+}
+#endif
+
+static SdArray* SdArray_Elementwise(SdArrayOp op, SdArray_r a, SdArray_r b) {
+   SdArray* out = NULL;
+   size_t i = 0, n = 0;
+
+   SdAssert(a);
+   SdAssert(b);
+   SdAssert(a->element_type == b->element_type);
+   SdAssert(a->count == b->count);
+   n = a->count;
+   out = SdArray_New(a->element_type, n);
+
+   if (a->element_type == SdType_DOUBLE) {
+      const double* x = a->elements.doubles;
+      const double* y = b->elements.doubles;
+      double* z = out->elements.doubles;
+
+#ifdef SD_SIMD_AVX2
+      if (SdCpu_HasAvx2())
+         i = SdArray_ElementwiseDoubleAvx2(op, x, y, z, n);
+#endif
+      switch (op) {
+         case SdArrayOp_ADD:
+#ifdef SD_SIMD_SSE2
+            for (; i + 2 <= n; i += 2)
+               _mm_storeu_pd(&z[i], _mm_add_pd(_mm_loadu_pd(&x[i]), _mm_loadu_pd(&y[i])));
+#endif
+            for (; i < n; i++)
+               z[i] = x[i] + y[i];
+            break;
+         case SdArrayOp_SUBTRACT:
+#ifdef SD_SIMD_SSE2
+            for (; i + 2 <= n; i += 2)
+               _mm_storeu_pd(&z[i], _mm_sub_pd(_mm_loadu_pd(&x[i]), _mm_loadu_pd(&y[i])));
+#endif
+            for (; i < n; i++)
+               z[i] = x[i] - y[i];
+            break;
+         case SdArrayOp_MULTIPLY:
+#ifdef SD_SIMD_SSE2
+            for (; i + 2 <= n; i += 2)
+               _mm_storeu_pd(&z[i], _mm_mul_pd(_mm_loadu_pd(&x[i]), _mm_loadu_pd(&y[i])));
+#endif
+            for (; i < n; i++)
+               z[i] = x[i] * y[i];
+            break;
+         case SdArrayOp_DIVIDE:
+#ifdef SD_SIMD_SSE2
+            for (; i + 2 <= n; i += 2)
+               _mm_storeu_pd(&z[i], _mm_div_pd(_mm_loadu_pd(&x[i]), _mm_loadu_pd(&y[i])));
+#endif
+            for (; i < n; i++)
+               z[i] = x[i] / y[i];
+            break;
+      }
+   } else {
+      const int* x = a->elements.ints;
+      const int* y = b->elements.ints;
+      int* z = out->elements.ints;
+
+#ifdef SD_SIMD_AVX2
+      if (SdCpu_HasAvx2())
+         i = SdArray_ElementwiseIntAvx2(op, x, y, z, n);
+#endif
+      /* int arithmetic is done unsigned so that overflow wraps the same way in the scalar and SIMD loops */
+      switch (op) {
+         case SdArrayOp_ADD:
+#ifdef SD_SIMD_SSE2
+            for (; i + 4 <= n; i += 4)
+               _mm_storeu_si128((__m128i*)&z[i],
+                  _mm_add_epi32(_mm_loadu_si128((const __m128i*)&x[i]), _mm_loadu_si128((const __m128i*)&y[i])));
+#endif
+            for (; i < n; i++)
+               z[i] = (int)((unsigned int)x[i] + (unsigned int)y[i]);
+            break;
+         case SdArrayOp_SUBTRACT:
+#ifdef SD_SIMD_SSE2
+            for (; i + 4 <= n; i += 4)
+               _mm_storeu_si128((__m128i*)&z[i],
+                  _mm_sub_epi32(_mm_loadu_si128((const __m128i*)&x[i]), _mm_loadu_si128((const __m128i*)&y[i])));
+#endif
+            for (; i < n; i++)
+               z[i] = (int)((unsigned int)x[i] - (unsigned int)y[i]);
+            break;
+         case SdArrayOp_MULTIPLY: /* SSE2 has no packed 32-bit multiply */
+            for (; i < n; i++)
+               z[i] = (int)((unsigned int)x[i] * (unsigned int)y[i]);
+            break;
+         case SdArrayOp_DIVIDE: /* the caller has already rejected zero divisors and INT_MIN / -1 */
+            for (; i < n; i++)
+               z[i] = x[i] / y[i];
+            break;
+      }
+   }
+
+   return out;
+}
+
+static SdArray* SdArray_MapDouble(SdArray_r self, double (*func)(double)) {
+   SdArray* out = NULL;
+   size_t i = 0;
+
+   SdAssert(self);
+   SdAssert(func);
+   SdAssert(self->element_type == SdType_DOUBLE);
+   out = SdArray_New(SdType_DOUBLE, self->count);
+   for (i = 0; i < self->count; i++)
+      out->elements.doubles[i] = func(self->elements.doubles[i]);
+   return out;
+}
+
+/* y may be null, in which case this sums x instead of taking the dot product */
+static double SdArray_DotDoubles(const double* x, const double* y, size_t n) {
+   double total = 0;
+   size_t i = 0;
+#ifdef SD_SIMD_SSE2
+   __m128d acc0, acc1;
+   double lanes[2];
+#endif
+
+#ifdef SD_SIMD_AVX2
+   if (SdCpu_HasAvx2())
+      i = SdArray_DotDoubleAvx2(x, y, n, &total);
+#endif
+#ifdef SD_SIMD_SSE2
+   /* two accumulators so that consecutive adds don't wait on each other */
+   acc0 = _mm_setzero_pd();
+   acc1 = _mm_setzero_pd();
+   for (; i + 4 <= n; i += 4) {
+      __m128d a0 = _mm_loadu_pd(&x[i]), a1 = _mm_loadu_pd(&x[i + 2]);
+      if (y) {
+         a0 = _mm_mul_pd(a0, _mm_loadu_pd(&y[i]));
+         a1 = _mm_mul_pd(a1, _mm_loadu_pd(&y[i + 2]));
+      }
+      acc0 = _mm_add_pd(acc0, a0);
+      acc1 = _mm_add_pd(acc1, a1);
+   }
+   _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+   total += lanes[0] + lanes[1];
+#endif
+   for (; i < n; i++)
+      total += y ? x[i] * y[i] : x[i];
+   return total;
+}
+
+static double SdArray_SumDouble(SdArray_r self) {
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_DOUBLE);
+   return SdArray_DotDoubles(self->elements.doubles, NULL, self->count);
+}
+
+static double SdArray_DotDouble(SdArray_r a, SdArray_r b) {
+   SdAssert(a);
+   SdAssert(b);
+   SdAssert(a->element_type == SdType_DOUBLE && b->element_type == SdType_DOUBLE);
+   SdAssert(a->count == b->count);
+   return SdArray_DotDoubles(a->elements.doubles, b->elements.doubles, a->count);
+}
+
+static int SdArray_SumInt(SdArray_r self) {
+   const int* x = NULL;
+   unsigned int total = 0; /* unsigned so that overflow wraps instead of being undefined */
+   size_t i = 0, n = 0;
+#ifdef SD_SIMD_SSE2
+   __m128i acc;
+   unsigned int lanes[4];
+#endif
+
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_INT);
+   x = self->elements.ints;
+   n = self->count;
+#ifdef SD_SIMD_AVX2
+   if (SdCpu_HasAvx2())
+      i = SdArray_SumIntAvx2(x, n, &total);
+#endif
+#ifdef SD_SIMD_SSE2
+   acc = _mm_setzero_si128();
+   for (; i + 4 <= n; i += 4)
+      acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i*)&x[i]));
+   _mm_storeu_si128((__m128i*)lanes, acc);
+   total += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+   for (; i < n; i++)
+      total += (unsigned int)x[i];
+   return (int)total;
+}
+
+static int SdArray_DotInt(SdArray_r a, SdArray_r b) {
+   const int* x = NULL;
+   const int* y = NULL;
+   unsigned int total = 0;
+   size_t i = 0, n = 0;
+
+   SdAssert(a);
+   SdAssert(b);
+   SdAssert(a->element_type == SdType_INT && b->element_type == SdType_INT);
+   SdAssert(a->count == b->count);
+   x = a->elements.ints;
+   y = b->elements.ints;
+   n = a->count;
+   for (i = 0; i < n; i++)
+      total += (unsigned int)x[i] * (unsigned int)y[i];
+   return (int)total;
+}
+
+/* returns the smallest element, or the largest if is_max is true. if any element is NaN then the result is NaN, in
+   every build; the SIMD min/max instructions don't propagate NaN on their own so it is tracked separately. the array
+   must not be empty. */
+static double SdArray_ExtremeDouble(SdArray_r self, SdBool is_max) {
+   const double* x = NULL;
+   double result = 0;
+   size_t i = 1, n = 0;
+   SdBool has_nan = SdFalse;
+#ifdef SD_SIMD_SSE2
+   __m128d acc, nan_mask;
+   double lanes[2];
+#endif
+
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_DOUBLE);
+   SdAssert(self->count > 0);
+   x = self->elements.doubles;
+   n = self->count;
+   result = x[0];
+   has_nan = x[0] != x[0];
+#ifdef SD_SIMD_AVX2
+   if (SdCpu_HasAvx2() && n >= 4)
+      i = SdArray_ExtremeDoubleAvx2(x, n, is_max, &result, &has_nan);
+#endif
+#ifdef SD_SIMD_SSE2
+   if (i == 1 && n >= 2) {
+      acc = _mm_loadu_pd(x);
+      nan_mask = _mm_cmpunord_pd(acc, acc);
+      for (i = 2; i + 2 <= n; i += 2) {
+         __m128d a = _mm_loadu_pd(&x[i]);
+         nan_mask = _mm_or_pd(nan_mask, _mm_cmpunord_pd(a, a));
+         acc = is_max ? _mm_max_pd(acc, a) : _mm_min_pd(acc, a);
+      }
+      has_nan = _mm_movemask_pd(nan_mask) != 0;
+      _mm_storeu_pd(lanes, acc);
+      result = (is_max ? lanes[1] > lanes[0] : lanes[1] < lanes[0]) ? lanes[1] : lanes[0];
+   }
+#endif
+   for (; i < n && !has_nan; i++) {
+      if (x[i] != x[i])
+         has_nan = SdTrue;
+      else if (is_max ? x[i] > result : x[i] < result)
+         result = x[i];
+   }
+   return has_nan ? SdArray_NaN() : result;
+}
+
+static int SdArray_ExtremeInt(SdArray_r self, SdBool is_max) {
+   const int* x = NULL;
+   int result = 0;
+   size_t i = 0;
+
+   SdAssert(self);
+   SdAssert(self->element_type == SdType_INT);
+   SdAssert(self->count > 0);
+   x = self->elements.ints;
+   result = x[0];
+   for (i = 1; i < self->count; i++)
+      if (is_max ? x[i] > result : x[i] < result)
+         result = x[i];
+   return result;
+}
+
+static double SdArray_NaN(void) {
+   double zero = 0;
+   return zero / zero;
+}
+
+/* SdStream **********************************************************************************************************/
+/* a stream is a read-only list: (list source kind-1 argument-1 kind-2 argument-2 ...). the source is a list, vector, 
+   hashmap, packed array, range, string, stream function, or Iterator. each stage is an SdStreamStage followed by its 
+   argument, which is a function for MAP and FILTER and an int for TAKE and SKIP. adding a stage to a stream copies the 
+   stage list and never nests streams, so an iterator sees the whole pipeline at once. an Iterator source is consumed 
+   as the stream is read, so such a stream can only be read once. */
+static SdBool SdStream_IsStreamable(SdValue_r value) {
+   switch (SdValue_Type(value)) {
+      case SdType_STRING:
+      case SdType_LIST:
+      case SdType_MUTALIST:
+      case SdType_VECTOR:
+      case SdType_HASHMAP:
+      case SdType_INT_ARRAY:
+      case SdType_DOUBLE_ARRAY:
+      case SdType_FUNCTION:
+      case SdType_STREAM:
+      case SdType_ITERATOR:
+      case SdType_RANGE:
+         return SdTrue;
+      default:
+         return SdFalse;
+   }
+}
+
+static SdValue_r SdStream_AddStage(SdEnv_r env, SdValue_r source, SdStreamStage kind, SdValue_r argument) {
+   SdList* items = NULL;
+
+   SdAssert(env);
+   SdAssert(source);
+   SdAssert(argument);
+   if (SdValue_Type(source) == SdType_STREAM) {
+      items = SdList_Clone(SdValue_GetList(source));
+   } else {
+      items = SdList_NewWithCapacity(3);
+      SdList_Append(items, source);
+   }
+   SdList_Append(items, SdEnv_BoxInt(env, (int)kind));
+   SdList_Append(items, argument);
+   SdList_MakeReadOnly(items);
+   return SdEnv_BoxStream(env, items);
+}
+
+static SdValue_r SdStream_Source(SdValue_r self) {
+   SdAssertValue(self, SdType_STREAM);
+   return SdList_GetAt(SdValue_GetList(self), 0);
+}
+
+static size_t SdStream_StageCount(SdValue_r self) {
+   SdAssertValue(self, SdType_STREAM);
+   return (SdList_Count(SdValue_GetList(self)) - 1) / 2;
+}
+
+static SdStreamStage SdStream_StageKind(SdValue_r self, size_t stage) {
+   SdAssertValue(self, SdType_STREAM);
+   return (SdStreamStage)SdValue_GetInt(SdList_GetAt(SdValue_GetList(self), 1 + stage * 2));
+}
+
+static SdValue_r SdStream_StageArgument(SdValue_r self, size_t stage) {
+   SdAssertValue(self, SdType_STREAM);
+   return SdList_GetAt(SdValue_GetList(self), 2 + stage * 2);
+}
+
+/* SdFile ************************************************************************************************************/
+/* the size in bytes, or -1 if the file can't seek. the position is left at the start. in text mode on some platforms
+   this overestimates the number of characters that fread will return, which is harmless. */
+static long SdFile_Size(FILE* fp) {
+   long size = 0;
+
+   SdAssert(fp);
+   if (fseek(fp, 0, SEEK_END) != 0)
+      return -1;
+   size = ftell(fp);
+   if (fseek(fp, 0, SEEK_SET) != 0)
+      return -1;
+   return size;
+}
+
+SdResult SdFile_WriteAllText(SdString_r file_path, SdString_r text) {
+   SdResult result = SdResult_SUCCESS;
+   FILE* fp = NULL;
+   size_t count = 0;
+
+   SdAssert(file_path);
+   SdAssert(text);
+   fp = fopen(SdString_CStr(file_path), "w");
+   if (!fp) {
+      result = SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to open the file.");
+      goto end;
+   }
+
+   count = SdString_Length(text);
+   if (fwrite(SdString_CStr(text), sizeof(char), count, fp) != count) {
+      result = SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to write to the file.");
+      goto end;
+   }
+
+end:
+   if (fp) fclose(fp);
+   return result;
+}
+
+/* reads straight into the buffer that becomes the string. when the file's size is known, that is a single fread into
+   a single allocation; pipes and other files that can't seek are read in growing chunks. */
+SdResult SdFile_ReadAllText(SdString_r file_path, SdString** out_text) {
+   SdResult result = SdResult_SUCCESS;
+   SdStringBuf* buf = NULL;
+   FILE* fp = NULL;
+   long size = 0;
+
+   SdAssert(file_path);
+   SdAssert(out_text);
+   fp = fopen(SdString_CStr(file_path), "r");
+   if (!fp) {
+      result = SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to open the file.");
+      goto end;
+   }
+
+   buf = SdStringBuf_New();
+   size = SdFile_Size(fp);
+   if (size > 0)
+      SdStringBuf_Reserve(buf, (size_t)size + 1); /* one spare byte, so that the first read can see the end of file */
+   for (;;) {
+      size_t room = 0, count = 0;
+
+      if (buf->len + 1 == buf->capacity)
+         SdStringBuf_Grow(buf, buf->len + 1);
+      room = buf->capacity - buf->len - 1;
+      count = fread(&buf->str[buf->len], sizeof(char), room, fp);
+      buf->len += count;
+      if (count < room)
+         break;
+   }
+   buf->str[buf->len] = 0;
+   if (ferror(fp)) {
+      result = SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to read the file.");
+      goto end;
+   }
+
+   *out_text = SdStringBuf_ToString(buf);
+   buf = NULL;
+end:
+   if (buf) SdStringBuf_Delete(buf);
+   if (fp) fclose(fp);
+   return result;
+}
+
+static SdLineReader* SdLineReader_Open(SdString_r file_path) {
+   SdLineReader* self = NULL;
+   FILE* fp = NULL;
+
+   SdAssert(file_path);
+   fp = fopen(SdString_CStr(file_path), "r");
+   if (!fp)
+      return NULL;
+   self = SdAlloc(sizeof(SdLineReader));
+   self->file = fp;
+   self->capacity = SdLineReader_BUFFER_SIZE;
+   self->buffer = SdAlloc(self->capacity);
+   return self;
+}
+
+static void SdLineReader_Close(SdLineReader* self) {
+   SdAssert(self);
+   fclose(self->file);
+   SdFree(self->buffer);
+   SdFree(self);
+}
+
+/* the line excludes its "\n" or "\r\n". a last line without a newline is still a line, but the empty string after a
+   final newline is not. */
+static SdResult SdLineReader_Next(SdLineReader_r self, SdString** out_line) {
+   SdAssert(self);
+   SdAssert(out_line);
+   *out_line = NULL;
+   for (;;) {
+      const char* newline = memchr(&self->buffer[self->scanned], '\n', self->end - self->scanned);
+      size_t line_end = 0, count = 0;
+
+      if (newline || (self->at_eof && self->start < self->end)) {
+         line_end = newline ? (size_t)(newline - self->buffer) : self->end;
+         self->scanned = newline ? line_end + 1 : self->end;
+         if (line_end > self->start && self->buffer[line_end - 1] == '\r')
+            line_end--;
+         *out_line = SdString_NewWithLength(line_end - self->start);
+         memcpy((*out_line)->buffer, &self->buffer[self->start], line_end - self->start);
+         self->start = self->scanned;
+         return SdResult_SUCCESS;
+      } else if (self->at_eof) {
+         return SdResult_SUCCESS;
+      }
+
+      /* move the partial line to the front and fill the rest, growing only if the line already fills the buffer */
+      self->scanned = self->end;
+      if (self->start > 0) {
+         memmove(self->buffer, &self->buffer[self->start], self->end - self->start);
+         self->end -= self->start;
+         self->scanned -= self->start;
+         self->start = 0;
+      }
+      if (self->end == self->capacity) {
+         self->buffer = SdRealloc(self->buffer, self->capacity * 2, self->capacity);
+         self->capacity *= 2;
+      }
+      count = fread(&self->buffer[self->end], sizeof(char), self->capacity - self->end, self->file);
+      self->end += count;
+      if (count == 0) {
+         if (ferror(self->file))
+            return SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to read the file.");
+         self->at_eof = SdTrue;
+      }
+   }
+}
+
+/* SdEnv *************************************************************************************************************/
+/* list is (list (list <unrelated> name1:str ...) (list <unrelated> name2:str ...) ...) 
+The objects are sorted by name.  If an exact match is found, then its index is returned.  Otherwise the next highest 
+match is returned.  The index may be one past the end of the list indicating that the search_name is higher than any 
+name in the list. */
+static SdSearchResult SdEnv_BinarySearchByName(SdList_r list, SdString_r search_name) {
+   SdAssert(list);
+   SdAssert(search_name);
+   return SdList_Search(list, SdEnv_BinarySearchByName_CompareFunc, search_name);
+}
+
+/* Assume lhs is a list, and compare by the string at index 1 (the name). */
+static int SdEnv_BinarySearchByName_CompareFunc(SdValue_r lhs, void* context) {
+   SdString_r search_name = NULL, pivot_name = NULL;
+   SdList_r pivot_item = NULL;
+
+   SdAssert(lhs);
+   SdAssert(context);
+   search_name = context;
    pivot_item = SdValue_GetList(lhs);
    pivot_name = SdValue_GetString(SdList_GetAt(pivot_item, 1));
    return SdString_Compare(pivot_name, search_name);
@@ -2164,7 +5560,9 @@ static SdValue_r SdEnv_AddToGc(SdEnv_r self, SdValue* value) {
 
 static SdEnv* SdEnv_New(void) {
    SdEnv* env = SdAlloc(sizeof(SdEnv));
+   SdHash_Init();
    env->values_chain = SdChain_New(); /* must be done before calling SdEnv_Root_New */
+   env->interned_strings = SdInternTable_New(); /* same */
    env->root = SdEnv_Root_New(env);
    env->active_frames = SdValueSet_New();
    env->call_stack = SdChain_New();
@@ -2180,7 +5578,9 @@ static void SdEnv_Delete(SdEnv* self) {
    self->active_frames = NULL;
    SdEnv_CollectGarbage(self);
    SdAssert(SdChain_Count(self->values_chain) == 0); /* shouldn't be anything left */
+   SdAssert(self->interned_strings->count == 0);
    SdChain_Delete(self->values_chain);
+   SdInternTable_Delete(self->interned_strings);
    SdChain_Delete(self->call_stack);
    SdChain_Delete(self->protected_values);
    SdFree(self);
@@ -2267,6 +5667,7 @@ static void SdEnv_CollectGarbage(SdEnv_r self) {
    }
 
    /* sweep unmarked values */
+   SdEnv_PruneInternedStrings(self);
    value_node = SdChain_Head(self->values_chain);
    while (value_node) {
       SdChainNode_r next_node = NULL;
@@ -2297,7 +5698,10 @@ static void SdEnv_CollectGarbage_MarkConnectedValues(SdValue_r root) {
          if (SdValue_Type(node) == SdType_MUTALIST || 
              SdValue_Type(node) == SdType_LIST ||
              SdValue_Type(node) == SdType_FUNCTION ||
-             SdValue_Type(node) == SdType_ERROR) {
+             SdValue_Type(node) == SdType_ERROR ||
+             SdValue_Type(node) == SdType_VECTOR ||
+             SdValue_Type(node) == SdType_HASHMAP ||
+             SdValue_Type(node) == SdType_STREAM) {
             SdList_r list = NULL;
             size_t i = 0, count = 0;
 
@@ -2306,6 +5710,8 @@ static void SdEnv_CollectGarbage_MarkConnectedValues(SdValue_r root) {
             for (i = 0; i < count; i++) {
                SdChain_Push(stack, SdList_GetAt(list, i));
             }
+         } else if (SdValue_Type(node) == SdType_ITERATOR) {
+            SdChain_Push(stack, SdValue_GetIterator(node)->roots);
          }
       }
    }
@@ -2450,6 +5856,15 @@ static void SdEnv_EndFrame(SdEnv_r self, SdValue_r frame) {
    }
 }
 
+/* makes a frame that was ended while its generator was suspended active again */
+static void SdEnv_ResumeFrame(SdEnv_r self, SdValue_r frame) {
+   SdAssert(self);
+   SdAssert(frame);
+   if (!SdValueSet_Add(self->active_frames, frame)) {
+      SdAssert(SdFalse); /* frame was not supposed to be there, but was */
+   }
+}
+
 static void SdEnv_PushCall(SdEnv_r self, SdValue_r calling_frame, SdValue_r name, SdValue_r arguments) {
    SdAssert(self);
    SdAssert(name);
@@ -2527,6 +5942,47 @@ static SdValue_r SdEnv_BoxString(SdEnv_r env, SdString* x) {
    return SdEnv_AddToGc(env, SdValue_NewString(x));
 }
 
+/* Like SdEnv_BoxString, but returns the env's canonical boxed string with these contents, so that all identifiers
+   and literals spelled the same way share one SdString and compare equal by pointer. x is deleted if an equal 
+   string was already interned. */
+static SdValue_r SdEnv_InternString(SdEnv_r env, SdString* x) {
+   SdValue_r interned = NULL;
+
+   SdAssert(env);
+   SdAssert(x);
+   interned = SdInternTable_Find(env->interned_strings, x);
+   if (interned) {
+      SdString_Delete(x);
+      return interned;
+   }
+   return SdEnv_InternValue(env, SdEnv_BoxString(env, x));
+}
+
+/* Returns the canonical boxed string equal to value, making value itself the canonical one if there isn't one yet.
+   The table is weak: the GC drops strings from it when nothing else refers to them. */
+static SdValue_r SdEnv_InternValue(SdEnv_r env, SdValue_r value) {
+   SdValue_r interned = NULL;
+   SdString_r str = NULL;
+
+   SdAssert(env);
+   SdAssertValue(value, SdType_STRING);
+   str = SdValue_GetString(value);
+   if (str->is_interned)
+      return value;
+   interned = SdInternTable_Find(env->interned_strings, str);
+   if (interned)
+      return interned;
+   SdInternTable_Add(env->interned_strings, value);
+   str->is_interned = SdTrue;
+   return value;
+}
+
+/* Called during garbage collection after marking; removes the interned strings that are about to be deleted. */
+static void SdEnv_PruneInternedStrings(SdEnv_r self) {
+   SdAssert(self);
+   SdInternTable_RemoveUnmarked(self->interned_strings);
+}
+
 static SdValue_r SdEnv_BoxList(SdEnv_r env, SdList* x) {
    SdAssert(env);
    SdAssert(x);
@@ -2545,6 +6001,47 @@ static SdValue_r SdEnv_BoxError(SdEnv_r env, SdList* x) {
    return SdEnv_AddToGc(env, SdValue_NewError(x));
 }
 
+static SdValue_r SdEnv_BoxVector(SdEnv_r env, SdList* x) {
+   SdAssert(env);
+   SdAssert(x);
+   return SdEnv_AddToGc(env, SdValue_NewVector(x));
+}
+
+static SdValue_r SdEnv_BoxHashmap(SdEnv_r env, SdList* x) {
+   SdAssert(env);
+   SdAssert(x);
+   return SdEnv_AddToGc(env, SdValue_NewHashmap(x));
+}
+
+static SdValue_r SdEnv_BoxStream(SdEnv_r env, SdList* x) {
+   SdAssert(env);
+   SdAssert(x);
+   return SdEnv_AddToGc(env, SdValue_NewStream(x));
+}
+
+static SdValue_r SdEnv_BoxIterator(SdEnv_r env, SdIterator* x) {
+   SdAssert(env);
+   SdAssert(x);
+   return SdEnv_AddToGc(env, SdValue_NewIterator(x));
+}
+
+static SdValue_r SdEnv_BoxRange(SdEnv_r env, int low, int high) {
+   SdAssert(env);
+   return SdEnv_AddToGc(env, SdValue_NewRange(low, high));
+}
+
+static SdValue_r SdEnv_BoxSharedMap(SdEnv_r env, SdSharedMap_r x) {
+   SdAssert(env);
+   SdAssert(x);
+   return SdEnv_AddToGc(env, SdValue_NewSharedMap(x));
+}
+
+static SdValue_r SdEnv_BoxArray(SdEnv_r env, SdArray* x) {
+   SdAssert(env);
+   SdAssert(x);
+   return SdEnv_AddToGc(env, SdValue_NewArray(x));
+}
+
 static SdValue_r SdEnv_BoxType(SdEnv_r env, SdType x) {
    SdAssert(env);
    return SdEnv_AddToGc(env, SdValue_NewType(x));
@@ -2553,20 +6050,27 @@ static SdValue_r SdEnv_BoxType(SdEnv_r env, SdType x) {
 static SdValue_r SdEnv_Root_New(SdEnv_r env) {
    SdValue_r frame = NULL;
    SdList* root_list = NULL;
+   SdList* pinned_names = NULL;
 
    SdAssert(env);
    frame = SdEnv_Frame_New(env, NULL);
-   root_list = SdList_NewWithLength(4);
+   env->type_of_name = SdEnv_InternString(env, SdString_FromCStr("type-of"));
+   env->error_message_name = SdEnv_InternString(env, SdString_FromCStr("error.message"));
+   pinned_names = SdList_New();
+   SdList_Append(pinned_names, env->type_of_name);
+   SdList_Append(pinned_names, env->error_message_name);
+   root_list = SdList_NewWithLength(5);
    SdList_SetAt(root_list, 0, SdEnv_BoxInt(env, SdNodeType_ROOT));
    SdList_SetAt(root_list, 1, SdEnv_BoxList(env, SdList_New())); /* functions */
    SdList_SetAt(root_list, 2, SdEnv_BoxList(env, SdList_New())); /* statements */
    SdList_SetAt(root_list, 3, frame); /* bottom frame */
+   SdList_SetAt(root_list, 4, SdEnv_BoxList(env, pinned_names)); /* interned names that the engine holds onto */
    return SdEnv_BoxList(env, root_list);
 }
 
 /* SdAst *************************************************************************************************************/
 /* A simple macro-based DSL for implementing the AST node functions. */
-#define SdAst_MAX_NODE_VALUES 7
+#define SdAst_MAX_NODE_VALUES 8
 #define SdAst_BEGIN(node_type) \
    SdValue_r values[SdAst_MAX_NODE_VALUES]; \
    int i = 0; \
@@ -2580,7 +6084,7 @@ static SdValue_r SdEnv_Root_New(SdEnv_r env) {
 #define SdAst_BOOL(x) \
    values[i++] = SdEnv_BoxBool(env, x);
 #define SdAst_STRING(x) \
-   values[i++] = SdEnv_BoxString(env, x);
+   values[i++] = SdEnv_InternString(env, x);
 #define SdAst_LIST(x) \
    values[i++] = SdEnv_BoxList(env, x);
 #define SdAst_NIL() \
@@ -2668,6 +6172,7 @@ SdAst_LIST_GETTER(SdAst_Program_Statements, SdNodeType_PROGRAM, 2)
 
 static SdValue_r SdAst_Function_New(SdEnv_r env, SdString* function_name, SdList* parameters, SdValue_r body,
    SdBool is_imported, SdBool has_var_args, SdList* return_types) {
+   SdBool is_generator = SdFalse;
    SdAst_BEGIN(SdNodeType_FUNCTION)
 
    SdAssert(env);
@@ -2675,6 +6180,7 @@ static SdValue_r SdAst_Function_New(SdEnv_r env, SdString* function_name, SdList
    SdAssertAllNodesOfType(parameters, SdNodeType_PARAMETER);
    SdAssertNode(body, SdNodeType_BODY);
    SdAssertAllNodesOfType(return_types, SdNodeType_VAR_REF);
+   is_generator = SdAst_Body_ContainsYield(body);
 
    SdAst_STRING(function_name)
    SdAst_LIST(parameters)
@@ -2682,6 +6188,7 @@ static SdValue_r SdAst_Function_New(SdEnv_r env, SdString* function_name, SdList
    SdAst_BOOL(is_imported)
    SdAst_BOOL(has_var_args)
    SdAst_LIST(return_types)
+   SdAst_BOOL(is_generator)
    SdAst_END
 }
 SdAst_VALUE_GETTER(SdAst_Function_Name, SdNodeType_FUNCTION, 1)
@@ -2690,6 +6197,7 @@ SdAst_VALUE_GETTER(SdAst_Function_Body, SdNodeType_FUNCTION, 3)
 SdAst_BOOL_GETTER(SdAst_Function_IsImported, SdNodeType_FUNCTION, 4)
 SdAst_BOOL_GETTER(SdAst_Function_HasVariableLengthArgumentList, SdNodeType_FUNCTION, 5)
 SdAst_LIST_GETTER(SdAst_Function_ReturnTypes, SdNodeType_FUNCTION, 6)
+SdAst_BOOL_GETTER(SdAst_Function_IsGenerator, SdNodeType_FUNCTION, 7)
 
 static SdValue_r SdAst_Parameter_New(SdEnv_r env, SdString* identifier, SdList* type_var_refs) {
    SdAst_BEGIN(SdNodeType_PARAMETER)
@@ -2949,6 +6457,73 @@ static SdValue_r SdAst_Die_New(SdEnv_r env, SdValue_r expr) {
 }
 SdAst_VALUE_GETTER(SdAst_Die_Expr, SdNodeType_DIE, 1)
 
+static SdValue_r SdAst_Yield_New(SdEnv_r env, SdValue_r expr) {
+   SdAst_BEGIN(SdNodeType_YIELD)
+
+   SdAssert(env);
+   SdAssertExpr(expr);
+
+   SdAst_VALUE(expr)
+   SdAst_END
+}
+SdAst_VALUE_GETTER(SdAst_Yield_Expr, SdNodeType_YIELD, 1)
+
+/* a function is a generator if a yield appears anywhere in its own body. the bodies of nested closures are not 
+   searched, since a yield inside a closure makes that closure the generator instead. */
+static SdBool SdAst_Body_ContainsYield(SdValue_r body) {
+   SdList_r statements = NULL, children = NULL;
+   size_t i = 0, j = 0, count = 0;
+
+   SdAssertNode(body, SdNodeType_BODY);
+   statements = SdAst_Body_Statements(body);
+   count = SdList_Count(statements);
+   for (i = 0; i < count; i++) {
+      SdValue_r statement = SdList_GetAt(statements, i);
+      switch (SdAst_NodeType(statement)) {
+         case SdNodeType_YIELD:
+            return SdTrue;
+         case SdNodeType_IF:
+            if (SdAst_Body_ContainsYield(SdAst_If_TrueBody(statement)) || 
+                SdAst_Body_ContainsYield(SdAst_If_ElseBody(statement)))
+               return SdTrue;
+            children = SdAst_If_ElseIfs(statement);
+            for (j = 0; j < SdList_Count(children); j++) {
+               if (SdAst_Body_ContainsYield(SdAst_ElseIf_Body(SdList_GetAt(children, j))))
+                  return SdTrue;
+            }
+            break;
+         case SdNodeType_FOR:
+            if (SdAst_Body_ContainsYield(SdAst_For_Body(statement)))
+               return SdTrue;
+            break;
+         case SdNodeType_FOREACH:
+            if (SdAst_Body_ContainsYield(SdAst_ForEach_Body(statement)))
+               return SdTrue;
+            break;
+         case SdNodeType_WHILE:
+            if (SdAst_Body_ContainsYield(SdAst_While_Body(statement)))
+               return SdTrue;
+            break;
+         case SdNodeType_DO:
+            if (SdAst_Body_ContainsYield(SdAst_Do_Body(statement)))
+               return SdTrue;
+            break;
+         case SdNodeType_SWITCH:
+            if (SdAst_Body_ContainsYield(SdAst_Switch_DefaultBody(statement)))
+               return SdTrue;
+            children = SdAst_Switch_Cases(statement);
+            for (j = 0; j < SdList_Count(children); j++) {
+               if (SdAst_Body_ContainsYield(SdAst_SwitchCase_ThenBody(SdList_GetAt(children, j))))
+                  return SdTrue;
+            }
+            break;
+         default:
+            break;
+      }
+   }
+   return SdFalse;
+}
+
 static SdValue_r SdAst_IntLit_New(SdEnv_r env, int value) {
    SdAst_BEGIN(SdNodeType_INT_LIT)
 
@@ -3129,6 +6704,7 @@ static SdValue_r SdEnv_Closure_CopyWithPartialArguments(SdValue_r self, SdEnv_r
 
    partial_arguments = SdList_Clone(SdValue_GetList(SdEnv_Closure_PartialArguments(self)));
    count = SdList_Count(arguments);
+   SdList_Reserve(partial_arguments, SdList_Count(partial_arguments) + count);
    for (i = 0; i < count; i++)
       SdList_Append(partial_arguments, SdList_GetAt(arguments, i));
 
@@ -3217,6 +6793,86 @@ static SdList_r SdValueSet_GetList(SdValueSet_r self) {
    return self->list;
 }
 
+/* SdInternTable *****************************************************************************************************/
+#define SdInternTable_MIN_CAPACITY 64
+
+static SdInternTable* SdInternTable_New(void) {
+   SdInternTable* self = SdAlloc(sizeof(SdInternTable));
+   self->capacity = SdInternTable_MIN_CAPACITY;
+   self->slots = SdAlloc(self->capacity * sizeof(SdValue_r));
+   return self;
+}
+
+static void SdInternTable_Delete(SdInternTable* self) {
+   SdAssert(self);
+   SdFree(self->slots);
+   SdFree(self);
+}
+
+static SdValue_r SdInternTable_Find(SdInternTable_r self, SdString_r str) {
+   size_t mask = 0, i = 0;
+
+   SdAssert(self);
+   SdAssert(str);
+   mask = self->capacity - 1;
+   for (i = SdString_Hash(str) & mask; self->slots[i]; i = (i + 1) & mask) {
+      SdString_r candidate = SdValue_GetString(self->slots[i]);
+      if (SdString_Hash(candidate) == SdString_Hash(str) && SdString_Equals(candidate, str))
+         return self->slots[i];
+   }
+   return NULL;
+}
+
+static void SdInternTable_Add(SdInternTable_r self, SdValue_r value) {
+   size_t mask = 0, i = 0;
+
+   SdAssert(self);
+   SdAssertValue(value, SdType_STRING);
+   if ((self->count + 1) * 2 > self->capacity)
+      SdInternTable_Rebuild(self, self->capacity * 2, SdFalse);
+   mask = self->capacity - 1;
+   for (i = SdString_Hash(SdValue_GetString(value)) & mask; self->slots[i]; i = (i + 1) & mask)
+      SdAssert(self->slots[i] != value);
+   self->slots[i] = value;
+   self->count++;
+}
+
+/* rebuilds the table from the strings that the garbage collector marked, since emptying a slot in the middle of a 
+   probe sequence would cut off the entries after it. shrinks the table when most of it went unused. */
+static void SdInternTable_RemoveUnmarked(SdInternTable_r self) {
+   size_t i = 0, kept = 0, capacity = 0;
+
+   SdAssert(self);
+   for (i = 0; i < self->capacity; i++) {
+      if (self->slots[i] && SdValue_IsGcMarked(self->slots[i]))
+         kept++;
+   }
+   if (kept == self->count)
+      return;
+
+   capacity = self->capacity;
+   while (capacity > SdInternTable_MIN_CAPACITY && kept * 8 < capacity)
+      capacity /= 2;
+   SdInternTable_Rebuild(self, capacity, SdTrue);
+}
+
+static void SdInternTable_Rebuild(SdInternTable_r self, size_t capacity, SdBool marked_only) {
+   SdValue_r* old_slots = NULL;
+   size_t old_capacity = 0, i = 0;
+
+   SdAssert(self);
+   old_slots = self->slots;
+   old_capacity = self->capacity;
+   self->slots = SdAlloc(capacity * sizeof(SdValue_r));
+   self->capacity = capacity;
+   self->count = 0;
+   for (i = 0; i < old_capacity; i++) {
+      if (old_slots[i] && (!marked_only || SdValue_IsGcMarked(old_slots[i])))
+         SdInternTable_Add(self, old_slots[i]);
+   }
+   SdFree(old_slots);
+}
+
 /* SdChain ***********************************************************************************************************/
 static SdChain* SdChain_New(void) {
    return SdAlloc(sizeof(SdChain));
@@ -3635,6 +7291,10 @@ static SdTokenType SdScanner_ClassifyToken(const char* text) {
          if (strcmp(text, "while") == 0) return SdTokenType_WHILE;
          break;
 
+      case 'y':
+         if (strcmp(text, "yield") == 0) return SdTokenType_YIELD;
+         break;
+
       case '0':
       case '1':
       case '2':
@@ -3847,6 +7507,7 @@ static const char* SdParser_TypeString(SdTokenType type) {
       case SdTokenType_DEFAULT: return "default";
       case SdTokenType_RETURN: return "return";
       case SdTokenType_DIE: return "die";
+      case SdTokenType_YIELD: return "yield";
       case SdTokenType_IMPORT: return "import";
       case SdTokenType_NIL: return "nil";
       case SdTokenType_LAMBDA: return "\\";
@@ -4222,6 +7883,7 @@ static SdResult SdParser_ParseStatement(SdEnv_r env, SdScanner_r scanner, SdValu
       case SdTokenType_SWITCH: return SdParser_ParseSwitch(env, scanner, out_node);
       case SdTokenType_RETURN: return SdParser_ParseReturn(env, scanner, out_node);
       case SdTokenType_DIE: return SdParser_ParseDie(env, scanner, out_node);
+      case SdTokenType_YIELD: return SdParser_ParseYield(env, scanner, out_node);
       case SdTokenType_NONE: return SdParser_FailEof();
       default: {
          SdToken_r token = NULL;
@@ -4689,6 +8351,21 @@ end:
    return result;
 }
 
+static SdResult SdParser_ParseYield(SdEnv_r env, SdScanner_r scanner, SdValue_r* out_node) {
+   SdToken_r token = NULL;
+   SdResult result = SdResult_SUCCESS;
+   SdValue_r expr = NULL;
+
+   SdAssert(env);
+   SdAssert(scanner);
+   SdAssert(out_node);
+   SdParser_READ_EXPECT_TYPE(SdTokenType_YIELD);
+   SdParser_READ_EXPR(expr);
+   *out_node = SdAst_Yield_New(env, expr);
+end:
+   return result;
+}
+
 /* SdEngine **********************************************************************************************************/
 #define SdEngine_INTRINSIC_START_ARGS1(name) \
    static SdResult name(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) { \
@@ -4797,19 +8474,106 @@ end:
       *out_return = expr; \
    } while (0); \
    SdEngine_INTRINSIC_END
+#define SdEngine_INTRINSIC_ORDER2(name, expr) \
+   SdEngine_INTRINSIC_START_ARGS2(name) \
+   do { \
+      int order = 0; \
+      SdBool unordered = SdFalse; \
+      if (SdFailed(result = SdEngine_CompareOperands(a_val, b_val, &order, &unordered))) \
+         return result; \
+      *out_return = SdEnv_BoxBool(self->env, !unordered && (expr)); \
+   } while (0); \
+   SdEngine_INTRINSIC_END
+#define SdEngine_INTRINSIC_COMPARE2(name, expr) \
+   SdEngine_INTRINSIC_START_ARGS2(name) \
+   do { \
+      int order = 0; \
+      if (SdFailed(result = SdValue_Compare(a_val, b_val, &order))) \
+         return result; \
+      *out_return = expr; \
+   } while (0); \
+   SdEngine_INTRINSIC_END
 
-static SdEngine* SdEngine_New(SdEnv_r env) {
+static SdEngine* SdEngine_New(SdEnv_r env, SdOutput_r output) {
    SdEngine* self = NULL;
    
    SdAssert(env);
+   SdAssert(output);
    self = SdAlloc(sizeof(SdEngine));
    self->env = env;
+   self->output = output;
    return self;
 }
 
-static void SdEngine_Delete(SdEngine* self) {
+static void SdEngine_Delete(SdEngine* self) {
+   SdSharedMapBinding* binding = NULL;
+
+   SdAssert(self);
+   binding = self->shared_maps;
+   while (binding) {
+      SdSharedMapBinding* next = binding->next;
+      SdString_Delete(binding->name);
+      SdSharedMap_Delete(binding->map);
+      SdFree(binding);
+      binding = next;
+   }
+   SdFree(self);
+}
+
+static SdSharedMapBinding_r SdEngine_FindSharedMap(SdEngine_r self, SdString_r name) {
+   SdSharedMapBinding_r binding = NULL;
+
+   SdAssert(self);
+   SdAssert(name);
+   for (binding = self->shared_maps; binding; binding = binding->next)
+      if (SdString_Equals(binding->name, name))
+         return binding;
+   return NULL;
+}
+
+/* replaces whatever map was bound to the name. values already holding the old map keep it alive. */
+static void SdEngine_BindSharedMap(SdEngine_r self, SdString* name, SdSharedMap_r map) {
+   SdSharedMapBinding* binding = NULL;
+
    SdAssert(self);
-   SdFree(self);
+   SdAssert(name);
+   SdAssert(map);
+   SdSharedMap_Retain(map);
+   binding = SdEngine_FindSharedMap(self, name);
+   if (binding) {
+      SdString_Delete(name);
+      SdSharedMap_Delete(binding->map);
+   } else {
+      binding = SdAlloc(sizeof(SdSharedMapBinding));
+      binding->name = name;
+      binding->next = self->shared_maps;
+      self->shared_maps = binding;
+   }
+   binding->map = map;
+}
+
+/* the order used by <, <=, > and >=. unlike compare and list.sort, which need a total order, these follow IEEE 754:
+   every comparison with a NaN is false. they also refuse to order an int against a double, which = never considers
+   equal. inside lists and other containers, the total order of SdValue_Compare applies. */
+static SdResult SdEngine_CompareOperands(SdValue_r a, SdValue_r b, int* out_order, SdBool* out_unordered) {
+   SdType a_type = SdType_NIL, b_type = SdType_NIL;
+
+   SdAssert(a);
+   SdAssert(b);
+   SdAssert(out_order);
+   SdAssert(out_unordered);
+   a_type = SdValue_Type(a);
+   b_type = SdValue_Type(b);
+   *out_unordered = SdFalse;
+   if ((a_type == SdType_INT && b_type == SdType_DOUBLE) || (a_type == SdType_DOUBLE && b_type == SdType_INT))
+      return SdFail(SdErr_TYPE_MISMATCH, "Cannot order an Int against a Double. Convert one with int.to-double.");
+   if (a_type == SdType_DOUBLE && b_type == SdType_DOUBLE && 
+       (SdValue_GetDouble(a) != SdValue_GetDouble(a) || SdValue_GetDouble(b) != SdValue_GetDouble(b))) {
+      *out_unordered = SdTrue;
+      *out_order = 0;
+      return SdResult_SUCCESS;
+   }
+   return SdValue_Compare(a, b, out_order);
 }
 
 static SdResult SdEngine_ExecuteProgram(SdEngine_r self) {
@@ -4868,18 +8632,61 @@ static SdResult SdEngine_Call(SdEngine_r self, SdValue_r frame, SdValue_r var_re
       return SdFailWithStringSuffix(SdErr_UNDECLARED_VARIABLE, "Function not found: ", function_name);
 
    closure = SdEnv_VariableSlot_Value(closure_slot);
+   if (SdValue_Type(closure) == SdType_RANGE || SdValue_Type(closure) == SdType_ITERATOR)
+      return SdEngine_CallStreamValue(self, closure, arguments, out_return);
    if (SdValue_Type(closure) != SdType_FUNCTION)
       return SdFailWithStringSuffix(SdErr_TYPE_MISMATCH, "Not a function: ", function_name);
 
    return SdEngine_CallClosure(self, frame, closure, arguments, out_return);
 }
 
+/* called where every live value is reachable from a frame or the protected stack: on entry to a function, and between
+   the iterations of a foreach loop, which may run without calling any functions at all */
+static void SdEngine_CollectGarbageIfNeeded(SdEngine_r self) {
+   SdBool gc_needed = SdFalse;
+
+   SdAssert(self);
+#if defined(SD_DEBUG_ALL) || defined(SD_DEBUG_GC)
+   /* when running the memory leak detection, collect garbage before every statement to fish for bugs */
+   gc_needed = SdTrue;
+#else
+   gc_needed = SdHeap_Get()->bytes_allocated_since_last_gc > SdEngine_ALLOCATED_BYTES_PER_GC;
+#endif
+   if (gc_needed) {
+      SdEnv_CollectGarbage(self->env);
+      SdHeap_Get()->bytes_allocated_since_last_gc = 0;
+   }
+}
+
+/* ranges and iterators keep the stream function protocol that (... low high) followed when it was a closure: calling a
+   range opens an Iterator over it, and calling an Iterator returns its next value, or nil at the end */
+static SdResult SdEngine_CallStreamValue(SdEngine_r self, SdValue_r value, SdList_r arguments, SdValue_r* out_return) {
+   SdResult result = SdResult_SUCCESS;
+   SdValue_r next = NULL;
+
+   SdAssert(self);
+   SdAssert(value);
+   SdAssert(arguments);
+   SdAssert(out_return);
+
+   if (SdList_Count(arguments) != 0)
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "Expected 0 arguments.");
+   if (SdValue_Type(value) == SdType_RANGE)
+      return SdEngine_Iterator_Box(self, value, out_return);
+
+   SdAssertValue(value, SdType_ITERATOR);
+   if (SdFailed(result = SdEngine_Iterator_Next(SdValue_GetIterator(value), &next)))
+      return result;
+   *out_return = next ? next : SdEnv_BoxNil(self->env);
+   return SdResult_SUCCESS;
+}
+
 static SdResult SdEngine_CallClosure(SdEngine_r self, SdValue_r frame, SdValue_r closure, SdList_r arguments, 
    SdValue_r* out_return) {
    SdResult result = SdResult_SUCCESS;
    SdValue_r function = NULL, call_frame = NULL, total_arguments_value = NULL, actual_function_name = NULL;
    SdList_r parameters = NULL, partial_arguments = NULL, total_arguments = NULL, return_types = NULL;
-   SdBool has_var_args = SdFalse, in_call = SdFalse, gc_needed = SdFalse;
+   SdBool has_var_args = SdFalse, in_call = SdFalse;
    size_t i = 0, count = 0, partial_arguments_count = 0, total_arguments_count = 0;
 
    SdAssert(self);
@@ -4910,8 +8717,7 @@ static SdResult SdEngine_CallClosure(SdEngine_r self, SdValue_r frame, SdValue_r
    /* if any of the arguments are errors, then immediately return that error so that it propagates up the call chain,
       rather than executing the function. exception: type-of and error.message; these two functions are needed to
       actually handle errors. */
-   if (!SdString_EqualsCStr(SdValue_GetString(actual_function_name), "type-of") && 
-       !SdString_EqualsCStr(SdValue_GetString(actual_function_name), "error.message")) {
+   if (actual_function_name != self->env->type_of_name && actual_function_name != self->env->error_message_name) {
       count = SdList_Count(arguments);
       for (i = 0; i < count; i++) {
          SdValue_r argument = SdList_GetAt(arguments, i);
@@ -5008,17 +8814,14 @@ static SdResult SdEngine_CallClosure(SdEngine_r self, SdValue_r frame, SdValue_r
       }
    }
 
-#if defined(SD_DEBUG_ALL) || defined(SD_DEBUG_GC)
-   /* when running the memory leak detection, collect garbage before every statement to fish for bugs */
-   gc_needed = SdTrue;
-#else
-   gc_needed = SdAlloc_BytesAllocatedSinceLastGc > SdEngine_ALLOCATED_BYTES_PER_GC;
-#endif
-   if (gc_needed) {
-      SdEnv_CollectGarbage(self->env);
-      SdAlloc_BytesAllocatedSinceLastGc = 0;
+   /* a generator's body doesn't run until something pulls a value from the Iterator it returns */
+   if (SdAst_Function_IsGenerator(function)) {
+      *out_return = SdEngine_Generator_New(self, closure, call_frame, total_arguments_value);
+      goto end;
    }
 
+   SdEngine_CollectGarbageIfNeeded(self);
+
    /* execute the function body using the frame we just constructed */
    result = SdEngine_ExecuteBody(self, call_frame, SdAst_Function_Body(function), out_return);
 
@@ -5257,13 +9060,18 @@ static SdResult SdEngine_ExecuteBody(SdEngine_r self, SdValue_r frame, SdValue_r
    body_frame = SdEnv_BeginFrame(self->env, frame);
 
    count = SdList_Count(statements);
-   for (i = 0; i < count; i++) {
+   if (SdEngine_IsResuming(self))
+      i = SdEngine_RestoreResumeIndex(self);
+   for (; i < count; i++) {
       statement = SdList_GetAt(statements, i);
       *out_return = NULL;
       if (SdFailed(result = SdEngine_ExecuteStatement(self, frame, statement, out_return)))
          goto end;
-      if (*out_return) /* a return statement breaks the body */
+      if (*out_return) { /* a return or yield statement breaks the body */
+         if (SdEngine_IsSuspending(self))
+            SdEngine_SaveResumeIndex(self, i);
          goto end;
+      }
    }
 
 end:
@@ -5302,6 +9110,7 @@ static SdResult SdEngine_ExecuteStatement(SdEngine_r self, SdValue_r frame, SdVa
       case SdNodeType_SWITCH: return SdEngine_ExecuteSwitch(self, frame, statement, out_return);
       case SdNodeType_RETURN: return SdEngine_ExecuteReturn(self, frame, statement, out_return);
       case SdNodeType_DIE: return SdEngine_ExecuteDie(self, frame, statement);
+      case SdNodeType_YIELD: return SdEngine_ExecuteYield(self, frame, statement, out_return);
       default: return SdFail(SdErr_UNEXPECTED_TOKEN, "Unexpected node type; expected a statement type.");
    }
 }
@@ -5458,9 +9267,9 @@ static SdResult SdEngine_ExecuteMultiSet(SdEngine_r self, SdValue_r frame, SdVal
 
 static SdResult SdEngine_ExecuteIf(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return) {
    SdResult result = SdResult_SUCCESS;
-   SdValue_r elseif = NULL, expr = NULL, value = NULL;
+   SdValue_r elseif = NULL, expr = NULL, value = NULL, body = NULL;
    SdList_r elseifs = NULL;
-   size_t i = 0, count = 0;
+   size_t i = 0, count = 0, branch = 0;
 
    SdAssert(self);
    SdAssert(frame);
@@ -5469,6 +9278,14 @@ static SdResult SdEngine_ExecuteIf(SdEngine_r self, SdValue_r frame, SdValue_r s
    SdAssertNode(frame, SdNodeType_FRAME);
    SdAssert(SdAst_NodeType(statement) == SdNodeType_IF);
 
+   /* branches are numbered IF = 0, ELSEIFs from 1, then ELSE, so that a generator can pick the same one back up */
+   elseifs = SdAst_If_ElseIfs(statement);
+   count = SdList_Count(elseifs);
+   if (SdEngine_IsResuming(self)) {
+      branch = SdEngine_RestoreResumeIndex(self);
+      goto execute;
+   }
+
    /* try the IF condition */
    expr = SdAst_If_ConditionExpr(statement);
    if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, expr, &value)))
@@ -5476,11 +9293,9 @@ static SdResult SdEngine_ExecuteIf(SdEngine_r self, SdValue_r frame, SdValue_r s
    if (SdValue_Type(value) != SdType_BOOL)
       return SdFail(SdErr_TYPE_MISMATCH, "IF condition expression does not evaluate to a Boolean.");
    if (SdValue_GetBool(value))
-      return SdEngine_ExecuteBody(self, frame, SdAst_If_TrueBody(statement), out_return);
+      goto execute;
 
    /* try the ELSEIF conditions */
-   elseifs = SdAst_If_ElseIfs(statement);
-   count = SdList_Count(elseifs);
    for (i = 0; i < count; i++) {
       elseif = SdList_GetAt(elseifs, i);
       expr = SdAst_ElseIf_ConditionExpr(elseif);
@@ -5488,72 +9303,583 @@ static SdResult SdEngine_ExecuteIf(SdEngine_r self, SdValue_r frame, SdValue_r s
          return result;
       if (SdValue_Type(value) != SdType_BOOL)
          return SdFail(SdErr_TYPE_MISMATCH, "ELSEIF condition expression does not evaluate to a Boolean.");
-      if (SdValue_GetBool(value))
-         return SdEngine_ExecuteBody(self, frame, SdAst_ElseIf_Body(elseif), out_return);
+      if (SdValue_GetBool(value)) {
+         branch = i + 1;
+         goto execute;
+      }
+   }
+
+   /* all conditions were false, so execute the ELSE block */
+   branch = count + 1;
+
+execute:
+   if (branch == 0)
+      body = SdAst_If_TrueBody(statement);
+   else if (branch <= count)
+      body = SdAst_ElseIf_Body(SdList_GetAt(elseifs, branch - 1));
+   else
+      body = SdAst_If_ElseBody(statement);
+   result = SdEngine_ExecuteBody(self, frame, body, out_return);
+   if (!SdFailed(result) && *out_return && SdEngine_IsSuspending(self))
+      SdEngine_SaveResumeIndex(self, branch);
+   return result;
+}
+
+static SdResult SdEngine_ExecuteFor(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return) {
+   SdResult result = SdResult_SUCCESS;
+   SdValue_r iter_name = NULL, start_expr = NULL, start_value = NULL, stop_expr = NULL, stop_value = NULL, 
+      body = NULL, loop_frame = NULL;
+   int i = 0, start = 0, stop = 0;
+   size_t offset = 0;
+
+   SdAssert(self);
+   SdAssert(frame);
+   SdAssert(statement);
+   SdAssert(out_return);
+   SdAssertNode(frame, SdNodeType_FRAME);
+   SdAssert(SdAst_NodeType(statement) == SdNodeType_FOR);
+
+   iter_name = SdAst_For_VariableName(statement);
+   start_expr = SdAst_For_StartExpr(statement);
+   stop_expr = SdAst_For_StopExpr(statement);
+   body = SdAst_For_Body(statement);
+
+   /* a resumed generator picks up in the middle of the same iteration, in the same frame */
+   if (SdEngine_IsResuming(self)) {
+      offset = SdEngine_RestoreResumeIndex(self);
+      stop_value = SdEngine_RestoreResumeValue(self);
+      start_value = SdEngine_RestoreResumeValue(self);
+      loop_frame = SdEngine_ResumeFrame(self);
+      start = SdValue_GetInt(start_value);
+      stop = SdValue_GetInt(stop_value);
+      goto loop;
+   }
+
+   /* evaluate the FROM expression */
+   if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, start_expr, &start_value)))
+      return result;
+   if (SdValue_Type(start_value) != SdType_INT)
+      return SdFail(SdErr_TYPE_MISMATCH, "FOR...FROM expression does not evaluate to an Integer.");
+   start = SdValue_GetInt(start_value);
+
+   /* evaluate the TO expression */
+   if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, stop_expr, &stop_value)))
+      return result;
+   if (SdValue_Type(stop_value) != SdType_INT)
+      return SdFail(SdErr_TYPE_MISMATCH, "FOR...TO expression does not evaluate to an Integer.");
+   stop = SdValue_GetInt(stop_value);
+
+loop:
+   /* execute the body in a new frame for each iteration */
+   for (i = start + (int)offset; i <= stop; i++) {
+      if (!loop_frame) {
+         loop_frame = SdEnv_BeginFrame(self->env, frame);
+         if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, iter_name, SdEnv_BoxInt(self->env, (int)i))))
+            goto end;
+      }
+      *out_return = NULL;
+      if (SdFailed(result = SdEngine_ExecuteBody(self, loop_frame, body, out_return)))
+         goto end;
+      if (*out_return) { /* a return statement inside the loop will break from the loop */
+         if (SdEngine_IsSuspending(self)) {
+            SdEngine_SuspendFrame(self, loop_frame);
+            loop_frame = NULL;
+            SdEngine_SaveResumeValue(self, start_value);
+            SdEngine_SaveResumeValue(self, stop_value);
+            SdEngine_SaveResumeIndex(self, (size_t)(i - start));
+         }
+         goto end;
+      }
+      SdEnv_EndFrame(self->env, loop_frame);
+      loop_frame = NULL;
+   }
+
+end:
+   if (loop_frame) SdEnv_EndFrame(self->env, loop_frame);
+   return result;
+}
+
+static size_t SdEngine_IndexableCount(SdValue_r haystack) {
+   switch (SdValue_Type(haystack)) {
+      case SdType_VECTOR: return SdVector_Count(haystack);
+      case SdType_RANGE: return SdRange_Count(SdValue_GetRange(haystack));
+      case SdType_INT_ARRAY: case SdType_DOUBLE_ARRAY: return SdArray_Count(SdValue_GetArray(haystack));
+      default: return SdList_Count(SdValue_GetList(haystack));
+   }
+}
+
+/* elements of packed arrays and ranges are boxed here, as they are read out into the loop variable */
+static SdValue_r SdEngine_IndexableGetAt(SdEngine_r self, SdValue_r haystack, size_t index) {
+   switch (SdValue_Type(haystack)) {
+      case SdType_VECTOR: return SdVector_GetAt(haystack, index);
+      case SdType_RANGE: 
+         return SdEnv_BoxInt(self->env, (int)((unsigned int)SdValue_GetRange(haystack).low + (unsigned int)index));
+      case SdType_INT_ARRAY: return SdEnv_BoxInt(self->env, SdArray_GetInt(SdValue_GetArray(haystack), index));
+      case SdType_DOUBLE_ARRAY: return SdEnv_BoxDouble(self->env, SdArray_GetDouble(SdValue_GetArray(haystack), index));
+      default: return SdList_GetAt(SdValue_GetList(haystack), index);
+   }
+}
+
+/* opens an iterator over a stream or any iterable source. on success the iterator's roots are protected until 
+   SdEngine_Iterator_End is called. */
+static SdResult SdEngine_Iterator_Begin(SdEngine_r self, SdValue_r frame, SdValue_r value, SdIterator_r out_iterator) {
+   SdResult result = SdResult_SUCCESS;
+   SdList_r roots = NULL;
+   SdValue_r source = value, closure_iterator = NULL;
+
+   SdAssert(self);
+   SdAssertNode(frame, SdNodeType_FRAME);
+   SdAssert(value);
+   SdAssert(out_iterator);
+   if (!SdStream_IsStreamable(value))
+      return SdFail(SdErr_TYPE_MISMATCH, "Expected a list or stream.");
+
+   memset(out_iterator, 0, sizeof(SdIterator));
+   out_iterator->engine = self;
+   out_iterator->frame = frame;
+   if (SdValue_Type(value) == SdType_STREAM) {
+      out_iterator->stream = value;
+      out_iterator->num_stages = SdStream_StageCount(value);
+      source = SdStream_Source(value);
+   }
+   out_iterator->counts = SdAlloc((out_iterator->num_stages + 1) * sizeof(int));
+   out_iterator->arguments = SdList_New();
+   out_iterator->roots = SdEnv_BoxList(self->env, SdList_NewWithLength(4));
+   roots = SdValue_GetList(out_iterator->roots);
+   SdEnv_PushProtectedValue(self->env, out_iterator->roots);
+   SdList_SetAt(roots, 0, source);
+   if (out_iterator->stream)
+      SdList_SetAt(roots, 3, out_iterator->stream);
+
+   switch (SdValue_Type(source)) {
+      case SdType_STRING:
+         out_iterator->kind = SdIteratorKind_STRING;
+         out_iterator->count = SdString_Length(SdValue_GetString(source));
+         break;
+
+      case SdType_HASHMAP:
+         out_iterator->kind = SdIteratorKind_HASHMAP;
+         out_iterator->hashmap_depth = 1;
+         out_iterator->hashmap_nodes[0] = SdList_GetAt(SdValue_GetList(source), 0);
+         out_iterator->hashmap_positions[0] = 2; /* skip the two bitmaps */
+         break;
+
+      case SdType_FUNCTION: /* a stream function returns a fresh iterator function or Iterator each time */
+         if (SdFailed(result = SdEngine_CallClosure(self, frame, source, out_iterator->arguments, &closure_iterator)))
+            goto end;
+         if (SdValue_Type(closure_iterator) == SdType_FUNCTION) {
+            out_iterator->kind = SdIteratorKind_FUNCTION;
+         } else if (SdValue_Type(closure_iterator) == SdType_ITERATOR) {
+            out_iterator->kind = SdIteratorKind_ITERATOR;
+         } else {
+            result = SdFail(SdErr_TYPE_MISMATCH, "A stream function must return an iterator function.");
+            goto end;
+         }
+         SdList_SetAt(roots, 1, closure_iterator);
+         break;
+
+      case SdType_ITERATOR:
+         out_iterator->kind = SdIteratorKind_ITERATOR;
+         SdList_SetAt(roots, 1, source);
+         break;
+
+      default:
+         out_iterator->kind = SdIteratorKind_INDEXABLE;
+         out_iterator->count = SdEngine_IndexableCount(source);
+         break;
+   }
+
+end:
+   if (SdFailed(result))
+      SdEngine_Iterator_End(out_iterator);
+   return result;
+}
+
+/* depth-first walk of the trie that yields the same pairs in the same order as hashmap.to-list */
+static SdValue_r SdEngine_Iterator_NextHashmapPair(SdIterator_r self) {
+   SdAssert(self);
+   while (self->hashmap_depth > 0) {
+      int top = self->hashmap_depth - 1;
+      SdList_r node = SdValue_GetList(self->hashmap_nodes[top]);
+      size_t count = SdList_Count(node), position = self->hashmap_positions[top], num_data_items = 0;
+
+      if (top * SdHashmap_BITS > SdHashmap_MAX_SHIFT)
+         num_data_items = count - 2;
+      else
+         num_data_items = 2 * SdHashmap_PopCount(SdHashmap_NodeDatamap(node));
+
+      if (position < 2 + num_data_items) {
+         SdList* pair = SdList_NewWithLength(2);
+         SdList_SetAt(pair, 0, SdList_GetAt(node, position));
+         SdList_SetAt(pair, 1, SdList_GetAt(node, position + 1));
+         SdList_MakeReadOnly(pair);
+         self->hashmap_positions[top] += 2;
+         return SdEnv_BoxList(self->engine->env, pair);
+      } else if (position < count) {
+         SdAssert(self->hashmap_depth < SdIterator_MAX_HASHMAP_DEPTH);
+         self->hashmap_positions[top]++;
+         self->hashmap_nodes[self->hashmap_depth] = SdList_GetAt(node, position);
+         self->hashmap_positions[self->hashmap_depth] = 2;
+         self->hashmap_depth++;
+      } else {
+         self->hashmap_depth--;
+      }
+   }
+   return NULL;
+}
+
+static SdResult SdEngine_Iterator_NextFromSource(SdIterator_r self, SdValue_r* out_value) {
+   SdResult result = SdResult_SUCCESS;
+   SdList_r roots = NULL;
+   SdValue_r source = NULL, value = NULL;
+
+   SdAssert(self);
+   SdAssert(out_value);
+   *out_value = NULL;
+   roots = SdValue_GetList(self->roots);
+   source = SdList_GetAt(roots, 0);
+
+   switch (self->kind) {
+      case SdIteratorKind_INDEXABLE: /* a mutalist may shrink inside the loop, so check its current length too */
+         if (self->index < self->count && self->index < SdEngine_IndexableCount(source))
+            *out_value = SdEngine_IndexableGetAt(self->engine, source, self->index++);
+         break;
+
+      case SdIteratorKind_STRING:
+         if (self->index < self->count) {
+            char ch = SdString_Chars(SdValue_GetString(source))[self->index++];
+            *out_value = SdEnv_BoxString(self->engine->env, SdString_FromChar(ch));
+         }
+         break;
+
+      case SdIteratorKind_HASHMAP:
+         *out_value = SdEngine_Iterator_NextHashmapPair(self);
+         break;
+
+      case SdIteratorKind_FUNCTION:
+         SdList_Clear(self->arguments);
+         if (SdFailed(result = SdEngine_CallClosure(self->engine, self->frame, SdList_GetAt(roots, 1), 
+            self->arguments, &value)))
+            return result;
+         if (SdValue_Type(value) != SdType_NIL)
+            *out_value = value;
+         break;
+
+      case SdIteratorKind_ITERATOR:
+         return SdEngine_Iterator_Next(SdValue_GetIterator(SdList_GetAt(roots, 1)), out_value);
+
+      case SdIteratorKind_GENERATOR:
+         return SdEngine_Generator_Resume(self, out_value);
+
+      case SdIteratorKind_FILE_LINES: {
+         SdString* line = NULL;
+
+         if (!self->lines)
+            break;
+         if (SdFailed(result = SdLineReader_Next(self->lines, &line)))
+            return result;
+         if (line) {
+            *out_value = SdEnv_BoxString(self->engine->env, line);
+         } else { /* close the file now rather than whenever the Iterator is collected */
+            SdLineReader_Close(self->lines);
+            self->lines = NULL;
+         }
+         break;
+      }
+   }
+
+   return result;
+}
+
+/* pulls values from the source until one makes it through every stage, or sets *out_value to null at the end. as 
+   with iterator functions, a nil from the source or from a MAP stage ends the stream. errors pass through MAP and 
+   FILTER without calling the stage function. */
+static SdResult SdEngine_Iterator_Next(SdIterator_r self, SdValue_r* out_value) {
+   SdResult result = SdResult_SUCCESS;
+   SdList_r roots = NULL;
+   size_t i = 0;
+
+   SdAssert(self);
+   SdAssert(out_value);
+   *out_value = NULL;
+   roots = SdValue_GetList(self->roots);
+
+   while (!self->done) {
+      SdValue_r value = NULL;
+
+      /* a full TAKE stage ends the stream before anything upstream of it is pulled */
+      for (i = 0; i < self->num_stages; i++) {
+         if (SdStream_StageKind(self->stream, i) == SdStreamStage_TAKE &&
+             self->counts[i] >= SdValue_GetInt(SdStream_StageArgument(self->stream, i)))
+            self->done = SdTrue;
+      }
+      if (self->done)
+         break;
+
+      if (SdFailed(result = SdEngine_Iterator_NextFromSource(self, &value)))
+         return result;
+      if (!value) {
+         self->done = SdTrue;
+         break;
+      }
+
+      for (i = 0; value && i < self->num_stages; i++) {
+         SdStreamStage kind = SdStream_StageKind(self->stream, i);
+         SdValue_r argument = SdStream_StageArgument(self->stream, i), output = NULL;
+
+         SdList_SetAt(roots, 2, value); /* keep the value alive while the stage function runs */
+         switch (kind) {
+            case SdStreamStage_MAP:
+            case SdStreamStage_FILTER:
+               if (SdValue_Type(value) == SdType_ERROR)
+                  break;
+               SdList_Clear(self->arguments);
+               SdList_Append(self->arguments, value);
+               if (SdFailed(result = SdEngine_CallClosure(self->engine, self->frame, argument, self->arguments, 
+                  &output)))
+                  return result;
+               if (kind == SdStreamStage_MAP) {
+                  value = output;
+                  if (SdValue_Type(output) == SdType_NIL) {
+                     self->done = SdTrue;
+                     value = NULL;
+                  }
+               } else if (SdValue_Type(output) == SdType_ERROR) {
+                  value = output;
+               } else if (SdValue_Type(output) != SdType_BOOL) {
+                  return SdFail(SdErr_TYPE_MISMATCH, "A filter predicate must return a Boolean.");
+               } else if (!SdValue_GetBool(output)) {
+                  value = NULL;
+               }
+               break;
+
+            case SdStreamStage_TAKE:
+               self->counts[i]++;
+               break;
+
+            case SdStreamStage_SKIP:
+               if (self->counts[i] < SdValue_GetInt(argument)) {
+                  self->counts[i]++;
+                  value = NULL;
+               }
+               break;
+         }
+      }
+
+      if (value) {
+         SdList_SetAt(roots, 2, value);
+         *out_value = value;
+         return SdResult_SUCCESS;
+      }
+   }
+
+   SdList_SetAt(roots, 2, SdEnv_BoxNil(self->engine->env));
+   return result;
+}
+
+static void SdEngine_Iterator_End(SdIterator_r self) {
+   SdAssert(self);
+   SdEnv_PopProtectedValue(self->engine->env);
+   SdIterator_FreeContents(self);
+}
+
+/* calling a generator function returns one of these Iterators instead of running the body. the call frame stays
+   reachable through the Iterator's roots, but is only an active frame while the body is running. */
+static SdValue_r SdEngine_Generator_New(SdEngine_r self, SdValue_r closure, SdValue_r call_frame, SdValue_r arguments) {
+   SdIterator* iterator = NULL;
+   SdList_r roots = NULL;
+
+   SdAssert(self);
+   SdAssertValue(closure, SdType_FUNCTION);
+   SdAssertNode(call_frame, SdNodeType_FRAME);
+   SdAssertList(arguments);
+
+   iterator = SdAlloc(sizeof(SdIterator));
+   iterator->engine = self;
+   iterator->frame = SdEnv_Root_BottomFrame(SdEnv_Root(self->env));
+   iterator->kind = SdIteratorKind_GENERATOR;
+   iterator->counts = SdAlloc(sizeof(int));
+   iterator->arguments = SdList_New();
+   iterator->roots = SdEnv_BoxList(self->env, SdList_NewWithLength(6));
+   roots = SdValue_GetList(iterator->roots);
+   SdList_SetAt(roots, 0, call_frame);
+   SdList_SetAt(roots, 1, closure);
+   SdList_SetAt(roots, 4, SdEnv_BoxList(self->env, SdList_New()));
+   SdList_SetAt(roots, 5, arguments);
+   return SdEnv_BoxIterator(self->env, iterator);
+}
+
+/* file.lines returns one of these Iterators. only the open file and its buffer are held, so any size file can be
+   streamed in constant memory. */
+static SdValue_r SdEngine_FileLines_New(SdEngine_r self, SdLineReader* reader) {
+   SdIterator* iterator = NULL;
+
+   SdAssert(self);
+   SdAssert(reader);
+   iterator = SdAlloc(sizeof(SdIterator));
+   iterator->engine = self;
+   iterator->frame = SdEnv_Root_BottomFrame(SdEnv_Root(self->env));
+   iterator->kind = SdIteratorKind_FILE_LINES;
+   iterator->counts = SdAlloc(sizeof(int));
+   iterator->arguments = SdList_New();
+   iterator->roots = SdEnv_BoxList(self->env, SdList_NewWithLength(4));
+   iterator->lines = reader;
+   return SdEnv_BoxIterator(self->env, iterator);
+}
+
+/* runs the generator's body until the next yield, which sets *out_value, or until the body ends, which leaves it null.
+   a yield unwinds like a return, except that each statement it passes through saves its position with 
+   SdEngine_SaveResumeIndex and friends. the next resume walks back down the same path, restoring those positions
+   instead of evaluating anything, until it reaches the yield and carries on from there. */
+static SdResult SdEngine_Generator_Resume(SdIterator_r self, SdValue_r* out_value) {
+   SdResult result = SdResult_SUCCESS;
+   SdEngine_r engine = NULL;
+   SdIterator_r previous_generator = NULL;
+   SdList_r roots = NULL;
+   SdValue_r call_frame = NULL, function = NULL, value = NULL;
+
+   SdAssert(self);
+   SdAssert(self->kind == SdIteratorKind_GENERATOR);
+   SdAssert(out_value);
+   *out_value = NULL;
+   if (self->running)
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "A generator cannot resume itself.");
+
+   engine = self->engine;
+   roots = SdValue_GetList(self->roots);
+   call_frame = SdList_GetAt(roots, 0);
+   function = SdEnv_Closure_FunctionNode(SdList_GetAt(roots, 1));
+
+   previous_generator = engine->generator;
+   engine->generator = self;
+   self->running = SdTrue;
+   self->resuming = self->num_resume_indices > 0;
+   SdEnv_ResumeFrame(engine->env, call_frame);
+   SdEnv_PushCall(engine->env, self->frame, SdAst_Function_Name(function), SdList_GetAt(roots, 5));
+
+   result = SdEngine_ExecuteBody(engine, call_frame, SdAst_Function_Body(function), &value);
+
+   SdEnv_PopCall(engine->env);
+   SdEnv_EndFrame(engine->env, call_frame);
+   self->running = SdFalse;
+   engine->generator = previous_generator;
+
+   if (!SdFailed(result) && self->suspending) {
+      SdAssert(!self->resuming);
+      self->suspending = SdFalse;
+      *out_value = value;
+   } else { /* the body finished or failed, so let go of its frames */
+      self->done = SdTrue;
+      self->resuming = SdFalse;
+      self->suspending = SdFalse;
+      self->num_resume_indices = 0;
+      SdList_Clear(SdValue_GetList(SdList_GetAt(roots, 4)));
+   }
+   return result;
+}
+
+static SdBool SdEngine_IsResuming(SdEngine_r self) {
+   return self->generator && self->generator->resuming;
+}
+
+static SdBool SdEngine_IsSuspending(SdEngine_r self) {
+   return self->generator && self->generator->suspending;
+}
+
+static void SdEngine_SaveResumeIndex(SdEngine_r self, size_t index) {
+   SdIterator_r generator = NULL;
+
+   SdAssert(self);
+   SdAssert(SdEngine_IsSuspending(self));
+   generator = self->generator;
+   if (generator->num_resume_indices == generator->resume_indices_capacity) {
+      size_t new_capacity = generator->resume_indices_capacity ? generator->resume_indices_capacity * 2 : 8;
+      generator->resume_indices = SdRealloc(generator->resume_indices, new_capacity * sizeof(size_t),
+         generator->resume_indices_capacity * sizeof(size_t));
+      generator->resume_indices_capacity = new_capacity;
    }
+   generator->resume_indices[generator->num_resume_indices++] = index;
+}
+
+static size_t SdEngine_RestoreResumeIndex(SdEngine_r self) {
+   SdAssert(self);
+   SdAssert(SdEngine_IsResuming(self));
+   SdAssert(self->generator->num_resume_indices > 0);
+   return self->generator->resume_indices[--self->generator->num_resume_indices];
+}
+
+static void SdEngine_SaveResumeValue(SdEngine_r self, SdValue_r value) {
+   SdAssert(self);
+   SdAssert(SdEngine_IsSuspending(self));
+   SdList_Append(SdValue_GetList(SdList_GetAt(SdValue_GetList(self->generator->roots), 4)), value);
+}
+
+static SdValue_r SdEngine_RestoreResumeValue(SdEngine_r self) {
+   SdList_r values = NULL;
 
-   /* all conditions were false, so execute the ELSE block */
-   return SdEngine_ExecuteBody(self, frame, SdAst_If_ElseBody(statement), out_return);
+   SdAssert(self);
+   SdAssert(SdEngine_IsResuming(self));
+   values = SdValue_GetList(SdList_GetAt(SdValue_GetList(self->generator->roots), 4));
+   SdAssert(SdList_Count(values) > 0);
+   return SdList_RemoveAt(values, SdList_Count(values) - 1);
 }
 
-static SdResult SdEngine_ExecuteFor(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return) {
+/* a suspended frame is not active; the resume values keep it reachable until the generator picks it back up */
+static void SdEngine_SuspendFrame(SdEngine_r self, SdValue_r frame) {
+   SdEnv_EndFrame(self->env, frame);
+   SdEngine_SaveResumeValue(self, frame);
+}
+
+static SdValue_r SdEngine_ResumeFrame(SdEngine_r self) {
+   SdValue_r frame = SdEngine_RestoreResumeValue(self);
+   SdEnv_ResumeFrame(self->env, frame);
+   return frame;
+}
+
+/* runs the loop body once in a fresh frame with the iteration variables declared. a resumed generator carries on in
+   the frame it suspended in, so iter_value is null then. */
+static SdResult SdEngine_ExecuteForEachIteration(SdEngine_r self, SdValue_r frame, SdValue_r statement, 
+   SdValue_r iter_value, size_t index, SdValue_r* out_return) {
    SdResult result = SdResult_SUCCESS;
-   SdValue_r iter_name = NULL, start_expr = NULL, start_value = NULL, stop_expr = NULL, stop_value = NULL, 
-      body = NULL, loop_frame = NULL;
-   int i = 0, start = 0, stop = 0;
+   SdValue_r index_name = NULL, loop_frame = NULL;
 
    SdAssert(self);
-   SdAssert(frame);
+   SdAssertNode(frame, SdNodeType_FRAME);
    SdAssert(statement);
    SdAssert(out_return);
-   SdAssertNode(frame, SdNodeType_FRAME);
-   SdAssert(SdAst_NodeType(statement) == SdNodeType_FOR);
-
-   iter_name = SdAst_For_VariableName(statement);
-   start_expr = SdAst_For_StartExpr(statement);
-   stop_expr = SdAst_For_StopExpr(statement);
-   body = SdAst_For_Body(statement);
-
-   /* evaluate the FROM expression */
-   if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, start_expr, &start_value)))
-      return result;
-   if (SdValue_Type(start_value) != SdType_INT)
-      return SdFail(SdErr_TYPE_MISMATCH, "FOR...FROM expression does not evaluate to an Integer.");
-   start = SdValue_GetInt(start_value);
-
-   /* evaluate the TO expression */
-   if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, stop_expr, &stop_value)))
-      return result;
-   if (SdValue_Type(stop_value) != SdType_INT)
-      return SdFail(SdErr_TYPE_MISMATCH, "FOR...TO expression does not evaluate to an Integer.");
-   stop = SdValue_GetInt(stop_value);
 
-   /* execute the body in a new frame for each iteration */
-   for (i = start; i <= stop; i++) {
+   *out_return = NULL;
+   if (SdEngine_IsResuming(self)) {
+      loop_frame = SdEngine_ResumeFrame(self);
+   } else {
+      SdAssert(iter_value);
+      index_name = SdAst_ForEach_IndexName(statement);
       loop_frame = SdEnv_BeginFrame(self->env, frame);
-      if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, iter_name, SdEnv_BoxInt(self->env, (int)i))))
-         goto end;
-      *out_return = NULL;
-      if (SdFailed(result = SdEngine_ExecuteBody(self, loop_frame, body, out_return)))
-         goto end;
-      if (*out_return) /* a return statement inside the loop will break from the loop */
+      if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, SdAst_ForEach_IterName(statement), iter_value)))
          goto end;
-      SdEnv_EndFrame(self->env, loop_frame);
-      loop_frame = NULL;
+      if (SdValue_Type(index_name) != SdType_NIL) { /* user may not have specified an indexer variable */
+         if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, index_name, 
+            SdEnv_BoxInt(self->env, (int)index))))
+            goto end;
+      }
    }
+   result = SdEngine_ExecuteBody(self, loop_frame, SdAst_ForEach_Body(statement), out_return);
 
 end:
-   if (loop_frame) SdEnv_EndFrame(self->env, loop_frame);
+   if (!SdFailed(result) && *out_return && SdEngine_IsSuspending(self))
+      SdEngine_SuspendFrame(self, loop_frame);
+   else
+      SdEnv_EndFrame(self->env, loop_frame);
    return result;
 }
 
 static SdResult SdEngine_ExecuteForEach(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return) {
    SdResult result = SdResult_SUCCESS;
-   SdValue_r iter_name = NULL, index_name = NULL, haystack_expr = NULL, haystack_value = NULL, body = NULL, 
-      loop_frame = NULL;
-   SdList_r haystack = NULL;
-   SdList* empty_list = NULL;
-   size_t i = 0, count = 0, num_protected_values = 0;
+   SdValue_r haystack_value = NULL;
+   SdIterator local_iterator;
+   SdIterator_r iterator = NULL;
+   SdBool resumed = SdFalse;
+   size_t i = 0;
 
    SdAssert(self);
    SdAssert(frame);
@@ -5562,88 +9888,62 @@ static SdResult SdEngine_ExecuteForEach(SdEngine_r self, SdValue_r frame, SdValu
    SdAssertNode(frame, SdNodeType_FRAME);
    SdAssert(SdAst_NodeType(statement) == SdNodeType_FOREACH);
 
-   iter_name = SdAst_ForEach_IterName(statement);
-   index_name = SdAst_ForEach_IndexName(statement);
-   haystack_expr = SdAst_ForEach_HaystackExpr(statement);
-   body = SdAst_ForEach_Body(statement);
-
-   /* evaluate the IN expression */
-   if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, haystack_expr, &haystack_value)))
+   /* evaluate the IN expression, unless a resumed generator is picking up where it left off; it saved its place as an
+      Iterator value */
+   if (SdEngine_IsResuming(self)) {
+      i = SdEngine_RestoreResumeIndex(self);
+      haystack_value = SdEngine_RestoreResumeValue(self);
+      resumed = SdTrue;
+   } else if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, SdAst_ForEach_HaystackExpr(statement), 
+      &haystack_value))) {
       return result;
-   
-   if (SdValue_Type(haystack_value) == SdType_LIST || SdValue_Type(haystack_value) == SdType_MUTALIST) {
-      haystack = SdValue_GetList(haystack_value);
-
-      /* enumerate the list */
-      count = SdList_Count(haystack);
-      for (i = 0; i < count; i++) {
-         SdValue_r iter_value = NULL;
-
-         iter_value = SdList_GetAt(haystack, i);
-         loop_frame = SdEnv_BeginFrame(self->env, frame);
-         if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, iter_name, iter_value)))
-            goto end;
-         if (SdValue_Type(index_name) != SdType_NIL) { /* user may not have specified an indexer variable */
-            if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, index_name, SdEnv_BoxInt(self->env, (int)i))))
-               goto end;
-         }
-         *out_return = NULL;
-         if (SdFailed(result = SdEngine_ExecuteBody(self, loop_frame, body, out_return)))
-            goto end;
-         if (*out_return) /* a return statement inside the loop will break from the loop */
-            goto end;
-         SdEnv_EndFrame(self->env, loop_frame);
-         loop_frame = NULL;
-      }
-   } else if (SdValue_Type(haystack_value) == SdType_FUNCTION) { /* haystack_value is a stream */
-      SdValue_r stream_func = haystack_value, iterator_func = NULL;
-      empty_list = SdList_New();
-
-      SdEnv_PushProtectedValue(self->env, stream_func);
-      num_protected_values++;
+   }
 
-      /* call stream_func to get an iterator_func */
-      if (SdFailed(result = SdEngine_CallClosure(self, frame, stream_func, empty_list, &iterator_func)))
-         goto end;
-      if (SdValue_Type(iterator_func) != SdType_FUNCTION) {
-         result = SdFail(SdErr_TYPE_MISMATCH, "FOREACH expected a list or stream.");
-         goto end;
-      }
+   /* the haystack may not be reachable from any variable, so keep it alive while the body runs */
+   SdEnv_PushProtectedValue(self->env, haystack_value);
 
-      SdEnv_PushProtectedValue(self->env, iterator_func);
-      num_protected_values++;
+   /* an Iterator value carries its own state; anything else gets a fresh iterator for the length of the loop */
+   if (SdValue_Type(haystack_value) == SdType_ITERATOR) {
+      iterator = SdValue_GetIterator(haystack_value);
+   } else if (!SdStream_IsStreamable(haystack_value)) {
+      result = SdFail(SdErr_TYPE_MISMATCH, "FOREACH expected a list or stream.");
+   } else if (!SdFailed(result = SdEngine_Iterator_Begin(self, frame, haystack_value, &local_iterator))) {
+      iterator = &local_iterator;
+   }
 
-      /* repeatedly call iterator_func to get values */
-      for (i = 0; SdTrue; i++) {
-         SdValue_r iter_value = NULL;
+   for (; iterator; i++) {
+      SdValue_r iter_value = NULL;
 
-         if (SdFailed(result = SdEngine_CallClosure(self, frame, iterator_func, empty_list, &iter_value)))
-            goto end;
-         if (SdValue_Type(iter_value) == SdType_NIL)
+      if (resumed) { /* the iteration was already under way */
+         resumed = SdFalse;
+      } else {
+         SdEngine_CollectGarbageIfNeeded(self);
+         if (SdFailed(result = SdEngine_Iterator_Next(iterator, &iter_value)) || !iter_value)
             break;
+      }
+      if (SdFailed(result = SdEngine_ExecuteForEachIteration(self, frame, statement, iter_value, i, out_return)))
+         break;
+      if (*out_return) /* a return statement inside the loop will break from the loop */
+         break;
+   }
 
-         loop_frame = SdEnv_BeginFrame(self->env, frame);
-         if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, iter_name, iter_value)))
-            goto end;
-         if (SdValue_Type(index_name) != SdType_NIL) { /* user may not have specified an indexer variable */
-            if (SdFailed(result = SdEnv_DeclareVar(self->env, loop_frame, index_name, SdEnv_BoxInt(self->env, (int)i))))
-               goto end;
-         }
-         *out_return = NULL;
-         if (SdFailed(result = SdEngine_ExecuteBody(self, loop_frame, body, out_return)))
-            goto end;
-         if (*out_return) /* a return statement inside the loop will break from the loop */
-            goto end;
-         SdEnv_EndFrame(self->env, loop_frame);
-         loop_frame = NULL;
+   if (!SdFailed(result) && *out_return && SdEngine_IsSuspending(self)) {
+      /* the generator needs the iterator after this call returns, so a local one moves into an Iterator value, which
+         keeps its roots reachable from then on */
+      if (iterator == &local_iterator) {
+         SdIterator* suspended_iterator = SdAlloc(sizeof(SdIterator));
+         *suspended_iterator = local_iterator;
+         haystack_value = SdEnv_BoxIterator(self->env, suspended_iterator);
+         SdEnv_PopProtectedValue(self->env);
+         iterator = NULL;
       }
+      SdEngine_SaveResumeValue(self, haystack_value);
+      SdEngine_SaveResumeIndex(self, i);
    }
 
-end:
-   while (num_protected_values-- > 0)
-      SdEnv_PopProtectedValue(self->env);
-   if (empty_list) SdList_Delete(empty_list);
-   if (loop_frame) SdEnv_EndFrame(self->env, loop_frame);
+   if (iterator == &local_iterator)
+      SdEngine_Iterator_End(iterator);
+   SdEnv_PopProtectedValue(self->env);
    return result;
 }
 
@@ -5662,19 +9962,28 @@ static SdResult SdEngine_ExecuteWhile(SdEngine_r self, SdValue_r frame, SdValue_
    body = SdAst_While_Body(statement);
 
    while (SdTrue) {
-      if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, expr, &value)))
-         return result;
-      if (SdValue_Type(value) != SdType_BOOL)
-         return SdFail(SdErr_TYPE_MISMATCH, "WHILE expression does not evaluate to a Boolean.");
-      if (!SdValue_GetBool(value))
-         break;
+      if (SdEngine_IsResuming(self)) { /* a resumed generator is already inside the body */
+         loop_frame = SdEngine_ResumeFrame(self);
+      } else {
+         if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, expr, &value)))
+            return result;
+         if (SdValue_Type(value) != SdType_BOOL)
+            return SdFail(SdErr_TYPE_MISMATCH, "WHILE expression does not evaluate to a Boolean.");
+         if (!SdValue_GetBool(value))
+            break;
+         loop_frame = SdEnv_BeginFrame(self->env, frame);
+      }
 
-      loop_frame = SdEnv_BeginFrame(self->env, frame);
       *out_return = NULL;
       if (SdFailed(result = SdEngine_ExecuteBody(self, loop_frame, body, out_return)))
          goto end;
-      if (*out_return) /* a return statement inside the loop will break from the loop */
+      if (*out_return) { /* a return statement inside the loop will break from the loop */
+         if (SdEngine_IsSuspending(self)) {
+            SdEngine_SuspendFrame(self, loop_frame);
+            loop_frame = NULL;
+         }
          goto end;
+      }
       SdEnv_EndFrame(self->env, loop_frame);
       loop_frame = NULL;
    }
@@ -5699,12 +10008,20 @@ static SdResult SdEngine_ExecuteDo(SdEngine_r self, SdValue_r frame, SdValue_r s
    body = SdAst_Do_Body(statement);
 
    while (SdTrue) {
-      loop_frame = SdEnv_BeginFrame(self->env, frame);
+      if (SdEngine_IsResuming(self))
+         loop_frame = SdEngine_ResumeFrame(self);
+      else
+         loop_frame = SdEnv_BeginFrame(self->env, frame);
       *out_return = NULL;
       if (SdFailed(result = SdEngine_ExecuteBody(self, loop_frame, body, out_return)))
          goto end;
-      if (*out_return) /* a return statement inside the loop will break from the loop */
+      if (*out_return) { /* a return statement inside the loop will break from the loop */
+         if (SdEngine_IsSuspending(self)) {
+            SdEngine_SuspendFrame(self, loop_frame);
+            loop_frame = NULL;
+         }
          goto end;
+      }
 
       if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, expr, &value)))
          goto end;
@@ -5725,7 +10042,7 @@ end:
 
 static SdResult SdEngine_ExecuteSwitch(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return) {
    SdResult result = SdResult_SUCCESS;
-   SdValue_r cas = NULL, default_body = NULL, case_frame = NULL;
+   SdValue_r cas = NULL;
    SdList_r exprs = NULL, cases = NULL;
    SdValue_r* exprs_values = NULL;
    SdValue_r* case_exprs_values = NULL;
@@ -5740,7 +10057,10 @@ static SdResult SdEngine_ExecuteSwitch(SdEngine_r self, SdValue_r frame, SdValue
 
    exprs = SdAst_Switch_Exprs(statement);
    cases = SdAst_Switch_Cases(statement);
-   default_body = SdAst_Switch_DefaultBody(statement);
+
+   /* a resumed generator goes straight back into the case it was in */
+   if (SdEngine_IsResuming(self))
+      return SdEngine_ExecuteSwitchBranch(self, frame, statement, SdEngine_RestoreResumeIndex(self), out_return);
 
    if (SdList_Count(exprs) == 0) { /* we're matching the function arguments */
       SdValue_r trace = SdEnv_GetCurrentCallTrace(self->env);
@@ -5796,12 +10116,7 @@ static SdResult SdEngine_ExecuteSwitch(SdEngine_r self, SdValue_r frame, SdValue
       }
 
       if (is_match) {
-         SdValue_r case_body = NULL;
-
-         case_body = SdAst_SwitchCase_ThenBody(cas);
-         case_frame = SdEnv_BeginFrame(self->env, frame);
-         result = SdEngine_ExecuteBody(self, case_frame, case_body, out_return);
-         SdEnv_EndFrame(self->env, case_frame);
+         result = SdEngine_ExecuteSwitchBranch(self, frame, statement, i, out_return);
          goto end;
       }
 
@@ -5809,15 +10124,45 @@ static SdResult SdEngine_ExecuteSwitch(SdEngine_r self, SdValue_r frame, SdValue
       case_exprs_values = NULL;
    }
 
-   case_frame = SdEnv_BeginFrame(self->env, frame);
-   result = SdEngine_ExecuteBody(self, case_frame, default_body, out_return);
-   SdEnv_EndFrame(self->env, case_frame);
+   result = SdEngine_ExecuteSwitchBranch(self, frame, statement, cases_count, out_return);
 end:
    if (exprs_values) SdFree(exprs_values);
    if (case_exprs_values) SdFree(case_exprs_values);
    return result;
 }
 
+/* runs a case body in its own frame. branches are numbered by case, with the default body last. */
+static SdResult SdEngine_ExecuteSwitchBranch(SdEngine_r self, SdValue_r frame, SdValue_r statement, size_t branch,
+   SdValue_r* out_return) {
+   SdResult result = SdResult_SUCCESS;
+   SdList_r cases = NULL;
+   SdValue_r body = NULL, case_frame = NULL;
+
+   SdAssert(self);
+   SdAssertNode(frame, SdNodeType_FRAME);
+   SdAssert(SdAst_NodeType(statement) == SdNodeType_SWITCH);
+   SdAssert(out_return);
+
+   cases = SdAst_Switch_Cases(statement);
+   if (branch < SdList_Count(cases))
+      body = SdAst_SwitchCase_ThenBody(SdList_GetAt(cases, branch));
+   else
+      body = SdAst_Switch_DefaultBody(statement);
+
+   if (SdEngine_IsResuming(self))
+      case_frame = SdEngine_ResumeFrame(self);
+   else
+      case_frame = SdEnv_BeginFrame(self->env, frame);
+   result = SdEngine_ExecuteBody(self, case_frame, body, out_return);
+   if (!SdFailed(result) && *out_return && SdEngine_IsSuspending(self)) {
+      SdEngine_SuspendFrame(self, case_frame);
+      SdEngine_SaveResumeIndex(self, branch);
+   } else {
+      SdEnv_EndFrame(self->env, case_frame);
+   }
+   return result;
+}
+
 static SdResult SdEngine_ExecuteReturn(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return) {
    SdAssert(self);
    SdAssert(frame);
@@ -5848,6 +10193,33 @@ static SdResult SdEngine_ExecuteDie(SdEngine_r self, SdValue_r frame, SdValue_r
    return SdFail(SdErr_DIED, SdString_CStr(SdValue_GetString(value)));
 }
 
+/* a yield hands its value out through *out_return as if it were a return, and sets the generator's suspending flag so 
+   that the statements it unwinds through save their positions. when the generator resumes, this is where the restored
+   positions lead, and execution carries on with the next statement. */
+static SdResult SdEngine_ExecuteYield(SdEngine_r self, SdValue_r frame, SdValue_r statement, SdValue_r* out_return) {
+   SdResult result = SdResult_SUCCESS;
+
+   SdAssert(self);
+   SdAssert(frame);
+   SdAssert(statement);
+   SdAssert(out_return);
+   SdAssertNode(frame, SdNodeType_FRAME);
+   SdAssert(SdAst_NodeType(statement) == SdNodeType_YIELD);
+
+   if (!self->generator)
+      return SdFail(SdErr_UNEXPECTED_TOKEN, "YIELD can only be used inside a function.");
+   if (self->generator->resuming) {
+      SdAssert(self->generator->num_resume_indices == 0);
+      self->generator->resuming = SdFalse;
+      return result;
+   }
+
+   if (SdFailed(result = SdEngine_EvaluateExpr(self, frame, SdAst_Yield_Expr(statement), out_return)))
+      return result;
+   self->generator->suspending = SdTrue;
+   return result;
+}
+
 static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_r arguments, SdValue_r* out_return) {
    const char* cstr = NULL;
    
@@ -5861,6 +10233,10 @@ static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_
 #define INTRINSIC(f_name, f) do { if (strcmp(cstr, f_name) == 0) return f(self, arguments, out_return); } while (0)
 
    switch (cstr[0]) {
+      case '.':
+         INTRINSIC("...", SdEngine_Intrinsic_Range);
+         break;
+
       case 'a':
          INTRINSIC("asin", SdEngine_Intrinsic_ASin);
          INTRINSIC("acos", SdEngine_Intrinsic_ACos);
@@ -5881,11 +10257,42 @@ static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_
          INTRINSIC("ceil", SdEngine_Intrinsic_Ceil);
          INTRINSIC("cos", SdEngine_Intrinsic_Cos);
          INTRINSIC("cosh", SdEngine_Intrinsic_CosH);
+         INTRINSIC("clock", SdEngine_Intrinsic_Clock);
+         INTRINSIC("compare", SdEngine_Intrinsic_Compare);
          break;
 
       case 'd':
          INTRINSIC("double.<", SdEngine_Intrinsic_DoubleLessThan);
          INTRINSIC("double.to-int", SdEngine_Intrinsic_DoubleToInt);
+         INTRINSIC("double-array", SdEngine_Intrinsic_DoubleArray);
+         INTRINSIC("double-array.new", SdEngine_Intrinsic_DoubleArrayNew);
+         INTRINSIC("double-array.length", SdEngine_Intrinsic_ArrayLength);
+         INTRINSIC("double-array.get-at", SdEngine_Intrinsic_ArrayGetAt);
+         INTRINSIC("double-array.set-at!", SdEngine_Intrinsic_ArraySetAt);
+         INTRINSIC("double-array.append!", SdEngine_Intrinsic_ArrayAppend);
+         INTRINSIC("double-array.add", SdEngine_Intrinsic_ArrayAdd);
+         INTRINSIC("double-array.subtract", SdEngine_Intrinsic_ArraySubtract);
+         INTRINSIC("double-array.multiply", SdEngine_Intrinsic_ArrayMultiply);
+         INTRINSIC("double-array.divide", SdEngine_Intrinsic_ArrayDivide);
+         INTRINSIC("double-array.sum", SdEngine_Intrinsic_ArraySum);
+         INTRINSIC("double-array.dot", SdEngine_Intrinsic_ArrayDot);
+         INTRINSIC("double-array.min", SdEngine_Intrinsic_ArrayMin);
+         INTRINSIC("double-array.max", SdEngine_Intrinsic_ArrayMax);
+         INTRINSIC("double-array.sin", SdEngine_Intrinsic_ArraySin);
+         INTRINSIC("double-array.cos", SdEngine_Intrinsic_ArrayCos);
+         INTRINSIC("double-array.tan", SdEngine_Intrinsic_ArrayTan);
+         INTRINSIC("double-array.asin", SdEngine_Intrinsic_ArrayASin);
+         INTRINSIC("double-array.acos", SdEngine_Intrinsic_ArrayACos);
+         INTRINSIC("double-array.atan", SdEngine_Intrinsic_ArrayATan);
+         INTRINSIC("double-array.sinh", SdEngine_Intrinsic_ArraySinH);
+         INTRINSIC("double-array.cosh", SdEngine_Intrinsic_ArrayCosH);
+         INTRINSIC("double-array.tanh", SdEngine_Intrinsic_ArrayTanH);
+         INTRINSIC("double-array.exp", SdEngine_Intrinsic_ArrayExp);
+         INTRINSIC("double-array.log", SdEngine_Intrinsic_ArrayLog);
+         INTRINSIC("double-array.log10", SdEngine_Intrinsic_ArrayLog10);
+         INTRINSIC("double-array.sqrt", SdEngine_Intrinsic_ArraySqrt);
+         INTRINSIC("double-array.ceil", SdEngine_Intrinsic_ArrayCeil);
+         INTRINSIC("double-array.floor", SdEngine_Intrinsic_ArrayFloor);
          break;
 
       case 'e':
@@ -5896,6 +10303,8 @@ static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_
 
       case 'f':
          INTRINSIC("floor", SdEngine_Intrinsic_Floor);
+         INTRINSIC("flush", SdEngine_Intrinsic_Flush);
+         INTRINSIC("file.lines", SdEngine_Intrinsic_FileLines);
          break;
 
       case 'g':
@@ -5904,11 +10313,33 @@ static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_
 
       case 'h':
          INTRINSIC("hash", SdEngine_Intrinsic_Hash);
+         INTRINSIC("hashmap", SdEngine_Intrinsic_Hashmap);
+         INTRINSIC("hashmap.count", SdEngine_Intrinsic_HashmapCount);
+         INTRINSIC("hashmap.get", SdEngine_Intrinsic_HashmapGet);
+         INTRINSIC("hashmap.has?", SdEngine_Intrinsic_HashmapHas);
+         INTRINSIC("hashmap.set", SdEngine_Intrinsic_HashmapSet);
+         INTRINSIC("hashmap.remove", SdEngine_Intrinsic_HashmapRemove);
+         INTRINSIC("hashmap.to-list", SdEngine_Intrinsic_HashmapToList);
          break;
 
       case 'i':
          INTRINSIC("int.<", SdEngine_Intrinsic_IntLessThan);
          INTRINSIC("int.to-double", SdEngine_Intrinsic_IntToDouble);
+         INTRINSIC("iterator.next!", SdEngine_Intrinsic_IteratorNext);
+         INTRINSIC("int-array", SdEngine_Intrinsic_IntArray);
+         INTRINSIC("int-array.new", SdEngine_Intrinsic_IntArrayNew);
+         INTRINSIC("int-array.length", SdEngine_Intrinsic_ArrayLength);
+         INTRINSIC("int-array.get-at", SdEngine_Intrinsic_ArrayGetAt);
+         INTRINSIC("int-array.set-at!", SdEngine_Intrinsic_ArraySetAt);
+         INTRINSIC("int-array.append!", SdEngine_Intrinsic_ArrayAppend);
+         INTRINSIC("int-array.add", SdEngine_Intrinsic_ArrayAdd);
+         INTRINSIC("int-array.subtract", SdEngine_Intrinsic_ArraySubtract);
+         INTRINSIC("int-array.multiply", SdEngine_Intrinsic_ArrayMultiply);
+         INTRINSIC("int-array.divide", SdEngine_Intrinsic_ArrayDivide);
+         INTRINSIC("int-array.sum", SdEngine_Intrinsic_ArraySum);
+         INTRINSIC("int-array.dot", SdEngine_Intrinsic_ArrayDot);
+         INTRINSIC("int-array.min", SdEngine_Intrinsic_ArrayMin);
+         INTRINSIC("int-array.max", SdEngine_Intrinsic_ArrayMax);
          break;
 
       case 'l':
@@ -5920,6 +10351,9 @@ static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_
          INTRINSIC("list.set-at!", SdEngine_Intrinsic_ListSetAt);
          INTRINSIC("list.insert-at!", SdEngine_Intrinsic_ListInsertAt);
          INTRINSIC("list.remove-at!", SdEngine_Intrinsic_ListRemoveAt);
+         INTRINSIC("list.sort", SdEngine_Intrinsic_ListSort);
+         INTRINSIC("list.binary-search", SdEngine_Intrinsic_ListBinarySearch);
+         INTRINSIC("list.to-vector", SdEngine_Intrinsic_ListToVector);
          break;
 
       case 'm':
@@ -5938,23 +10372,59 @@ static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_
          INTRINSIC("print", SdEngine_Intrinsic_Print);
          break;
 
+      case 'r':
+         INTRINSIC("range.length", SdEngine_Intrinsic_RangeLength);
+         INTRINSIC("range.get-at", SdEngine_Intrinsic_RangeGetAt);
+         break;
+
       case 's':
          INTRINSIC("sin", SdEngine_Intrinsic_Sin);
          INTRINSIC("sinh", SdEngine_Intrinsic_SinH);
          INTRINSIC("sqrt", SdEngine_Intrinsic_Sqrt);
+         INTRINSIC("shared-map", SdEngine_Intrinsic_SharedMap);
+         INTRINSIC("shared-map.get", SdEngine_Intrinsic_SharedMapGet);
+         INTRINSIC("shared-map.set!", SdEngine_Intrinsic_SharedMapSet);
+         INTRINSIC("shared-map.add!", SdEngine_Intrinsic_SharedMapAdd);
+         INTRINSIC("shared-map.increment!", SdEngine_Intrinsic_SharedMapIncrement);
+         INTRINSIC("shared-map.count", SdEngine_Intrinsic_SharedMapCount);
          INTRINSIC("string.length", SdEngine_Intrinsic_StringLength);
          INTRINSIC("string.get-at", SdEngine_Intrinsic_StringGetAt);
+         INTRINSIC("string.intern", SdEngine_Intrinsic_StringIntern);
+         INTRINSIC("string.substring", SdEngine_Intrinsic_StringSubstring);
+         INTRINSIC("string.split", SdEngine_Intrinsic_StringSplit);
+         INTRINSIC("string.find", SdEngine_Intrinsic_StringFind);
+         INTRINSIC("string.starts-with?", SdEngine_Intrinsic_StringStartsWith);
+         INTRINSIC("string.index-of", SdEngine_Intrinsic_StringIndexOf);
+         INTRINSIC("string.count", SdEngine_Intrinsic_StringCount);
+         INTRINSIC("string.replace", SdEngine_Intrinsic_StringReplace);
          INTRINSIC("string.<", SdEngine_Intrinsic_StringLessThan);
          INTRINSIC("string.join", SdEngine_Intrinsic_StringJoin);
+         INTRINSIC("stream.map", SdEngine_Intrinsic_StreamMap);
+         INTRINSIC("stream.filter", SdEngine_Intrinsic_StreamFilter);
+         INTRINSIC("stream.take", SdEngine_Intrinsic_StreamTake);
+         INTRINSIC("stream.skip", SdEngine_Intrinsic_StreamSkip);
+         INTRINSIC("stream.reduce", SdEngine_Intrinsic_StreamReduce);
+         INTRINSIC("stream.to-list", SdEngine_Intrinsic_StreamToList);
          break;
 
       case 't':
          INTRINSIC("tan", SdEngine_Intrinsic_Tan);
          INTRINSIC("tanh", SdEngine_Intrinsic_TanH);
          INTRINSIC("to-string", SdEngine_Intrinsic_ToString);
+         INTRINSIC("to-iterator", SdEngine_Intrinsic_ToIterator);
          INTRINSIC("type-of", SdEngine_Intrinsic_TypeOf);
          break;
 
+      case 'v':
+         INTRINSIC("vector", SdEngine_Intrinsic_Vector);
+         INTRINSIC("vector.length", SdEngine_Intrinsic_VectorLength);
+         INTRINSIC("vector.get-at", SdEngine_Intrinsic_VectorGetAt);
+         INTRINSIC("vector.set-at", SdEngine_Intrinsic_VectorSetAt);
+         INTRINSIC("vector.append", SdEngine_Intrinsic_VectorAppend);
+         INTRINSIC("vector.slice", SdEngine_Intrinsic_VectorSlice);
+         INTRINSIC("vector.to-list", SdEngine_Intrinsic_VectorToList);
+         break;
+
       case '+':
          INTRINSIC("+", SdEngine_Intrinsic_Add);
          break;
@@ -5979,6 +10449,16 @@ static SdResult SdEngine_CallIntrinsic(SdEngine_r self, SdString_r name, SdList_
       case '=':
          INTRINSIC("=", SdEngine_Intrinsic_Equals);
          break;
+
+      case '<':
+         INTRINSIC("<", SdEngine_Intrinsic_LessThan);
+         INTRINSIC("<=", SdEngine_Intrinsic_LessThanEquals);
+         break;
+
+      case '>':
+         INTRINSIC(">", SdEngine_Intrinsic_GreaterThan);
+         INTRINSIC(">=", SdEngine_Intrinsic_GreaterThanEquals);
+         break;
    }
    
 #undef INTRINSIC
@@ -6041,7 +10521,8 @@ SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_TypeOf)
 SdEngine_INTRINSIC_END
 
 SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_Hash)
-   *out_return = SdEnv_BoxInt(self->env, SdValue_Hash(a_val));
+   /* non-negative so that scripts can take it modulo a bucket count */
+   *out_return = SdEnv_BoxInt(self->env, SdValue_Hash(a_val) & INT_MAX);
 SdEngine_INTRINSIC_END
 
 SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_ToString)
@@ -6050,14 +10531,14 @@ SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_ToString)
          *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(nil)"));
          break;
       case SdType_INT: {
-         char buf[30] = { 0 };
-         sprintf(buf, "%d", SdValue_GetInt(a_val));
+         char buf[SdFormat_INT_BUFFER_SIZE];
+         SdFormat_Int(buf, SdValue_GetInt(a_val));
          *out_return = SdEnv_BoxString(self->env, SdString_FromCStr(buf));
          break;
       }
       case SdType_DOUBLE: {
-         char buf[500] = { 0 };
-         sprintf(buf, "%f", SdValue_GetDouble(a_val));
+         char buf[SdFormat_DOUBLE_BUFFER_SIZE];
+         SdFormat_Double(buf, SdValue_GetDouble(a_val));
          *out_return = SdEnv_BoxString(self->env, SdString_FromCStr(buf));
          break;
       }
@@ -6082,6 +10563,30 @@ SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_ToString)
       case SdType_TYPE:
          *out_return = SdEnv_BoxString(self->env, SdString_FromCStr(SdType_Name(SdValue_GetInt(a_val))));
          break;
+      case SdType_VECTOR:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(vector)"));
+         break;
+      case SdType_HASHMAP:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(hashmap)"));
+         break;
+      case SdType_INT_ARRAY:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(int-array)"));
+         break;
+      case SdType_DOUBLE_ARRAY:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(double-array)"));
+         break;
+      case SdType_STREAM:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(stream)"));
+         break;
+      case SdType_ITERATOR:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(iterator)"));
+         break;
+      case SdType_RANGE:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(range)"));
+         break;
+      case SdType_SHARED_MAP:
+         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr("(shared-map)"));
+         break;
       default:
          return SdFail(SdErr_INTERPRETER_BUG, "Unexpected type.");
    }
@@ -6097,14 +10602,9 @@ SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_Add)
       case SdType_DOUBLE:
          *out_return = SdEnv_BoxDouble(self->env, SdValue_GetDouble(a_val) + SdValue_GetDouble(b_val));
          break;
-      case SdType_STRING: {
-         SdStringBuf* buf = SdStringBuf_New();
-         SdStringBuf_AppendString(buf, SdValue_GetString(a_val));
-         SdStringBuf_AppendString(buf, SdValue_GetString(b_val));
-         *out_return = SdEnv_BoxString(self->env, SdString_FromCStr(SdStringBuf_CStr(buf)));
-         SdStringBuf_Delete(buf);
+      case SdType_STRING:
+         *out_return = SdEnv_BoxString(self->env, SdString_Concat(SdValue_GetString(a_val), SdValue_GetString(b_val)));
          break;
-      }
       case SdType_MUTALIST:
       case SdType_LIST: {
          SdList* list = NULL;
@@ -6126,14 +10626,52 @@ SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_Add)
          *out_return = SdEnv_BoxList(self->env, list);
          break;
       }
+      case SdType_VECTOR: {
+         SdValue_r vector = NULL;
+         size_t i = 0, b_count = 0;
+
+         vector = a_val;
+         b_count = SdVector_Count(b_val);
+         for (i = 0; i < b_count; i++)
+            vector = SdVector_Append(self->env, vector, SdVector_GetAt(b_val, i));
+         *out_return = vector;
+         break;
+      }
       default: {}
    }
 SdEngine_INTRINSIC_END
 
 SdEngine_INTRINSIC_INTDOUBLE2(SdEngine_Intrinsic_Subtract, a - b)
 SdEngine_INTRINSIC_INTDOUBLE2(SdEngine_Intrinsic_Multiply, a * b)
-SdEngine_INTRINSIC_INTDOUBLE2(SdEngine_Intrinsic_Divide, a / b)
-SdEngine_INTRINSIC_INT2(SdEngine_Intrinsic_Modulus, a % b)
+/* integer division traps on the CPU for a zero divisor and for the one quotient that overflows */
+static SdResult SdEngine_CheckIntDivision(int a, int b) {
+   if (b == 0)
+      return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Division by zero.");
+   if (a == INT_MIN && b == -1)
+      return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Integer division overflow.");
+   return SdResult_SUCCESS;
+}
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_Divide)
+   if (a_type == SdType_DOUBLE && b_type == SdType_DOUBLE) {
+      *out_return = SdEnv_BoxDouble(self->env, SdValue_GetDouble(a_val) / SdValue_GetDouble(b_val));
+   } else if (a_type == SdType_INT && b_type == SdType_INT) {
+      int a = SdValue_GetInt(a_val), b = SdValue_GetInt(b_val);
+      if (SdFailed(result = SdEngine_CheckIntDivision(a, b)))
+         return result;
+      *out_return = SdEnv_BoxInt(self->env, a / b);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_Modulus)
+   if (a_type == SdType_INT && b_type == SdType_INT) {
+      int a = SdValue_GetInt(a_val), b = SdValue_GetInt(b_val);
+      if (SdFailed(result = SdEngine_CheckIntDivision(a, b)))
+         return result;
+      *out_return = SdEnv_BoxInt(self->env, a % b);
+   }
+SdEngine_INTRINSIC_END
+
 SdEngine_INTRINSIC_INT2(SdEngine_Intrinsic_BitwiseAnd, a & b)
 SdEngine_INTRINSIC_INT2(SdEngine_Intrinsic_BitwiseOr, a | b)
 SdEngine_INTRINSIC_INT2(SdEngine_Intrinsic_BitwiseXor, a ^ b)
@@ -6158,6 +10696,11 @@ SdEngine_INTRINSIC_BOOL2(SdEngine_Intrinsic_And, a && b)
 SdEngine_INTRINSIC_BOOL2(SdEngine_Intrinsic_Or, a || b)
 SdEngine_INTRINSIC_BOOL1(SdEngine_Intrinsic_Not, !a)
 SdEngine_INTRINSIC_VALUE2(SdEngine_Intrinsic_Equals, SdEnv_BoxBool(self->env, SdValue_Equals(a, b)))
+SdEngine_INTRINSIC_ORDER2(SdEngine_Intrinsic_LessThan, order < 0)
+SdEngine_INTRINSIC_ORDER2(SdEngine_Intrinsic_LessThanEquals, order <= 0)
+SdEngine_INTRINSIC_ORDER2(SdEngine_Intrinsic_GreaterThan, order > 0)
+SdEngine_INTRINSIC_ORDER2(SdEngine_Intrinsic_GreaterThanEquals, order >= 0)
+SdEngine_INTRINSIC_COMPARE2(SdEngine_Intrinsic_Compare, SdEnv_BoxInt(self->env, order))
 SdEngine_INTRINSIC_INT2(SdEngine_Intrinsic_ShiftLeft, a << b)
 SdEngine_INTRINSIC_INT2(SdEngine_Intrinsic_ShiftRight, a >> b)
 
@@ -6216,6 +10759,155 @@ SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_ListRemoveAt)
    }
 SdEngine_INTRINSIC_END
 
+/* decorate-sort-undecorate: the key selector is called exactly once per element, then the keys are sorted natively */
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_ListSort)
+   if (a_type == SdType_FUNCTION && (b_type == SdType_LIST || b_type == SdType_MUTALIST)) {
+      SdList* items = NULL;
+      SdList* keys = NULL;
+      SdList* sorted = NULL;
+      SdValue_r items_value = NULL, keys_value = NULL, frame = NULL;
+      size_t* indices = NULL;
+      size_t* scratch = NULL;
+      size_t i = 0, count = 0;
+
+      /* copy the items first in case the key selector modifies a mutalist out from under us */
+      items = SdList_Clone(SdValue_GetList(b_val));
+      items_value = SdEnv_BoxList(self->env, items);
+      count = SdList_Count(items);
+      keys = SdList_NewWithCapacity(count);
+      keys_value = SdEnv_BoxList(self->env, keys);
+      SdEnv_PushProtectedValue(self->env, items_value);
+      SdEnv_PushProtectedValue(self->env, keys_value);
+
+      frame = SdEnv_Root_BottomFrame(SdEnv_Root(self->env));
+      for (i = 0; i < count && !SdFailed(result); i++) {
+         SdList* arguments = SdList_New();
+         SdValue_r key = NULL;
+
+         SdList_Append(arguments, SdList_GetAt(items, i));
+         if (!SdFailed(result = SdEngine_CallClosure(self, frame, a_val, arguments, &key)))
+            SdList_Append(keys, key);
+         SdList_Delete(arguments);
+      }
+
+      if (!SdFailed(result)) {
+         indices = SdAlloc((count + 1) * sizeof(size_t));
+         scratch = SdAlloc((count + 1) * sizeof(size_t));
+         for (i = 0; i < count; i++)
+            indices[i] = i;
+         result = SdList_SortIndices(keys, indices, scratch, count);
+      }
+
+      if (!SdFailed(result)) {
+         sorted = SdList_NewWithLength(count);
+         for (i = 0; i < count; i++)
+            SdList_SetAt(sorted, i, SdList_GetAt(items, indices[i]));
+         SdList_MakeReadOnly(sorted);
+         *out_return = SdEnv_BoxList(self->env, sorted);
+      }
+
+      SdFree(indices);
+      SdFree(scratch);
+      SdEnv_PopProtectedValue(self->env);
+      SdEnv_PopProtectedValue(self->env);
+      if (SdFailed(result))
+         return result;
+   }
+SdEngine_INTRINSIC_END
+
+/* SdList_Search can't report failure from its compare callback, so a failed comparison is stashed in the context and
+   reported as a match to end the search early */
+static int SdEngine_BinarySearch_CompareFunc(SdValue_r lhs, void* context) {
+   SdEngineSearch* search = context;
+   SdValue_r key = lhs, order_value = NULL;
+   int order = 0;
+
+   SdAssert(lhs);
+   SdAssert(search);
+   if (SdFailed(search->result))
+      return 0;
+
+   if (SdValue_Type(search->key_selector) == SdType_INT) {
+      int index = SdValue_GetInt(search->key_selector);
+      SdType type = SdValue_Type(lhs);
+      if ((type != SdType_LIST && type != SdType_MUTALIST) || index < 0 || 
+         (size_t)index >= SdList_Count(SdValue_GetList(lhs))) {
+         search->result = SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "List element has no key at the given index.");
+         return 0;
+      }
+      key = SdList_GetAt(SdValue_GetList(lhs), index);
+   } else if (SdValue_Type(search->key_selector) == SdType_FUNCTION) {
+      SdList_Clear(search->arguments);
+      SdList_Append(search->arguments, lhs);
+      if (SdFailed(search->result = SdEngine_CallClosure(search->engine, search->frame, search->key_selector, 
+         search->arguments, &key)))
+         return 0;
+   }
+
+   if (search->compare_func) {
+      SdList_Clear(search->arguments);
+      SdList_Append(search->arguments, key);
+      SdList_Append(search->arguments, search->search_key);
+      if (SdFailed(search->result = SdEngine_CallClosure(search->engine, search->frame, search->compare_func, 
+         search->arguments, &order_value)))
+         return 0;
+      if (SdValue_Type(order_value) != SdType_INT) {
+         search->result = SdFail(SdErr_TYPE_MISMATCH, "The comparison function must return an integer.");
+         return 0;
+      }
+      return SdValue_GetInt(order_value);
+   } else {
+      search->result = SdValue_Compare(key, search->search_key, &order);
+      return order;
+   }
+}
+
+/* (list.binary-search list key-selector search-key [compare-func]) where the key selector is a function, an integer
+   index into list-shaped elements, or nil to use the elements themselves. returns the index of the match, or
+   -(index + 1) where index is the position at which search-key would be inserted. */
+static SdResult SdEngine_Intrinsic_ListBinarySearch(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdEngineSearch search;
+   SdSearchResult found = { 0, SdFalse };
+   SdValue_r list_value = NULL;
+   size_t count = 0;
+   SdType key_selector_type = SdType_NIL;
+
+   SdAssert(self);
+   SdAssert(arguments);
+   SdAssert(out_return);
+   count = SdList_Count(arguments);
+   if (count != 3 && count != 4)
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "Expected 3 or 4 arguments.");
+
+   list_value = SdList_GetAt(arguments, 0);
+   memset(&search, 0, sizeof(search));
+   search.result = SdResult_SUCCESS;
+   search.engine = self;
+   search.frame = SdEnv_Root_BottomFrame(SdEnv_Root(self->env));
+   search.key_selector = SdList_GetAt(arguments, 1);
+   search.search_key = SdList_GetAt(arguments, 2);
+   search.compare_func = count == 4 ? SdList_GetAt(arguments, 3) : NULL;
+   key_selector_type = SdValue_Type(search.key_selector);
+
+   if (SdValue_Type(list_value) != SdType_LIST && SdValue_Type(list_value) != SdType_MUTALIST)
+      return SdFail(SdErr_TYPE_MISMATCH, "The first argument must be a list.");
+   if (key_selector_type != SdType_FUNCTION && key_selector_type != SdType_INT && key_selector_type != SdType_NIL)
+      return SdFail(SdErr_TYPE_MISMATCH, "The key selector must be a function, an integer, or nil.");
+   if (search.compare_func && SdValue_Type(search.compare_func) == SdType_NIL)
+      search.compare_func = NULL;
+   if (search.compare_func && SdValue_Type(search.compare_func) != SdType_FUNCTION)
+      return SdFail(SdErr_TYPE_MISMATCH, "The comparison function must be a function.");
+
+   search.arguments = SdList_New();
+   found = SdList_Search(SdValue_GetList(list_value), SdEngine_BinarySearch_CompareFunc, &search);
+   SdList_Delete(search.arguments);
+   if (SdFailed(search.result))
+      return search.result;
+
+   *out_return = SdEnv_BoxInt(self->env, found.exact ? (int)found.index : -(int)found.index - 1);
+   return SdResult_SUCCESS;
+}
+
 SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_StringLength)
    if (a_type == SdType_STRING) {
       *out_return = SdEnv_BoxInt(self->env, (int)SdString_Length(SdValue_GetString(a_val)));
@@ -6224,7 +10916,6 @@ SdEngine_INTRINSIC_END
 
 SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringGetAt)
    if (a_type == SdType_STRING && b_type == SdType_INT) {
-      char char_str[2] = { 0 };
       SdString_r a_str = NULL;
       int b_int = 0;
 
@@ -6232,20 +10923,136 @@ SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringGetAt)
       b_int = SdValue_GetInt(b_val);
       if (b_int < 0 || (size_t)b_int >= SdString_Length(a_str))
          return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
-      char_str[0] = SdString_CStr(a_str)[b_int];
-      char_str[1] = 0;
-      *out_return = SdEnv_BoxString(self->env, SdString_FromCStr(char_str));
+      *out_return = SdEnv_BoxString(self->env, SdString_FromChar(SdString_Chars(a_str)[b_int]));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_StringIntern)
+   if (a_type == SdType_STRING) {
+      *out_return = SdEnv_InternValue(self->env, a_val);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_StringSubstring)
+   if (a_type == SdType_STRING && b_type == SdType_INT && c_type == SdType_INT) {
+      SdString_r str = NULL;
+      int start = 0, end = 0;
+
+      str = SdValue_GetString(a_val);
+      start = SdValue_GetInt(b_val);
+      end = SdValue_GetInt(c_val);
+      if (start < 0 || end < start || (size_t)end > SdString_Length(str))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      *out_return = SdEnv_BoxString(self->env, SdString_Substring(str, (size_t)start, (size_t)(end - start)));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringSplit)
+   if (a_type == SdType_STRING && b_type == SdType_STRING) {
+      SdString_r str = NULL, separator = NULL;
+      SdList* pieces = NULL;
+      size_t start = 0, index = 0;
+
+      str = SdValue_GetString(a_val);
+      separator = SdValue_GetString(b_val);
+      if (SdString_Length(separator) == 0)
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "The separator must not be empty.");
+
+      /* the pieces are boxed as we go, and nothing here can trigger a garbage collection */
+      pieces = SdList_New();
+      while (SdString_Find(str, separator, start, &index)) {
+         SdList_Append(pieces, SdEnv_BoxString(self->env, SdString_Substring(str, start, index - start)));
+         start = index + SdString_Length(separator);
+      }
+      SdList_Append(pieces, SdEnv_BoxString(self->env, SdString_Substring(str, start, SdString_Length(str) - start)));
+      SdList_MakeReadOnly(pieces);
+      *out_return = SdEnv_BoxList(self->env, pieces);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringFind)
+   if (a_type == SdType_STRING && b_type == SdType_STRING) {
+      size_t index = 0;
+
+      if (SdString_Find(SdValue_GetString(a_val), SdValue_GetString(b_val), 0, &index) && index <= INT_MAX)
+         *out_return = SdEnv_BoxInt(self->env, (int)index);
+      else
+         *out_return = SdEnv_BoxInt(self->env, -1);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringStartsWith)
+   if (a_type == SdType_STRING && b_type == SdType_STRING) {
+      SdString_r str = NULL, prefix = NULL;
+
+      str = SdValue_GetString(a_val);
+      prefix = SdValue_GetString(b_val);
+      *out_return = SdEnv_BoxBool(self->env, SdString_Length(prefix) <= SdString_Length(str) &&
+         memcmp(SdString_Chars(str), SdString_Chars(prefix), SdString_Length(prefix)) == 0);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_StringIndexOf)
+   if (a_type == SdType_STRING && b_type == SdType_STRING && c_type == SdType_INT) {
+      size_t index = 0;
+      int start = SdValue_GetInt(c_val);
+
+      if (start < 0 || (size_t)start > SdString_Length(SdValue_GetString(a_val)))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      if (SdString_Find(SdValue_GetString(a_val), SdValue_GetString(b_val), (size_t)start, &index) && index <= INT_MAX)
+         *out_return = SdEnv_BoxInt(self->env, (int)index);
+      else
+         *out_return = SdEnv_BoxInt(self->env, -1);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringCount)
+   if (a_type == SdType_STRING && b_type == SdType_STRING) {
+      if (SdString_Length(SdValue_GetString(b_val)) == 0)
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "The string to count must not be empty.");
+      *out_return = SdEnv_BoxInt(self->env, (int)SdString_Count(SdValue_GetString(a_val), SdValue_GetString(b_val)));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_StringReplace)
+   if (a_type == SdType_STRING && b_type == SdType_STRING && c_type == SdType_STRING) {
+      SdString* replaced = NULL;
+
+      if (SdString_Length(SdValue_GetString(b_val)) == 0)
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "The string to replace must not be empty.");
+      replaced = SdString_Replace(SdValue_GetString(a_val), SdValue_GetString(b_val), SdValue_GetString(c_val));
+      *out_return = replaced ? SdEnv_BoxString(self->env, replaced) : a_val;
    }
 SdEngine_INTRINSIC_END
 
 SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_Print)
-   SdUnreferenced(self);
    if (a_type == SdType_STRING) {
-      printf("%s", SdString_CStr(SdValue_GetString(a_val)));
+      SdString_r str = SdValue_GetString(a_val);
+      SdOutput_Write(self->output, SdString_Chars(str), SdString_Length(str));
       *out_return = a_val;
    }
 SdEngine_INTRINSIC_END
 
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_FileLines)
+   if (a_type == SdType_STRING) {
+      SdLineReader* reader = SdLineReader_Open(SdValue_GetString(a_val));
+      if (!reader)
+         return SdFail(SdErr_CANNOT_OPEN_FILE, "Failed to open the file.");
+      *out_return = SdEngine_FileLines_New(self, reader);
+   }
+SdEngine_INTRINSIC_END
+
+static SdResult SdEngine_Intrinsic_Flush(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdAssert(self);
+   SdAssert(arguments);
+   SdAssert(out_return);
+   if (SdList_Count(arguments) != 0)
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "Expected 0 arguments.");
+   SdOutput_Flush(self->output);
+   *out_return = SdEnv_BoxNil(self->env);
+   return SdResult_SUCCESS;
+}
+
 SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_Error)
    if (a_type == SdType_STRING) {
       SdList* error_list = SdList_NewWithLength(1);
@@ -6303,7 +11110,7 @@ SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringJoin)
       SdStringBuf* buf = NULL;
       SdString_r separator = NULL;
       SdList_r strings = NULL;
-      size_t i = 0, count = 0;
+      size_t i = 0, count = 0, total_length = 0;
 
       separator = SdValue_GetString(a_val);
       strings = SdValue_GetList(b_val);
@@ -6314,25 +11121,25 @@ SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StringJoin)
          return SdResult_SUCCESS;
       }
 
+      /* check the types and add up the final length first so the result is allocated once */
+      for (i = 0; i < count; i++) {
+         SdValue_r str = SdList_GetAt(strings, i);
+         if (SdValue_Type(str) != SdType_STRING)
+            return SdFail(SdErr_TYPE_MISMATCH, "All arguments to string.join must be strings.");
+         total_length += SdString_Length(SdValue_GetString(str));
+      }
+      total_length += (count - 1) * SdString_Length(separator);
+
       buf = SdStringBuf_New();
+      SdStringBuf_Reserve(buf, total_length);
 
       for (i = 0; i < count; i++) {
-         SdValue_r str = NULL;
-
          if (i > 0)
             SdStringBuf_AppendString(buf, separator);
-
-         str = SdList_GetAt(strings, i);
-         if (SdValue_Type(str) == SdType_STRING) {
-            SdStringBuf_AppendString(buf, SdValue_GetString(str));
-         } else {
-            SdStringBuf_Delete(buf);
-            return SdFail(SdErr_TYPE_MISMATCH, "All arguments to string.join must be strings.");
-         }
+         SdStringBuf_AppendString(buf, SdValue_GetString(SdList_GetAt(strings, i)));
       }
 
-      *out_return = SdEnv_BoxString(self->env, SdString_FromCStr(SdStringBuf_CStr(buf)));
-      SdStringBuf_Delete(buf);
+      *out_return = SdEnv_BoxString(self->env, SdStringBuf_ToString(buf));
    }
 SdEngine_INTRINSIC_END
 
@@ -6352,3 +11159,561 @@ static SdResult SdEngine_Intrinsic_Mutalist(SdEngine_r self, SdList_r arguments,
    *out_return = SdEnv_BoxList(self->env, SdList_Clone(arguments));
    return SdResult_SUCCESS;
 }
+
+static SdResult SdEngine_Intrinsic_Vector(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdAssert(arguments);
+   *out_return = SdVector_FromList(self->env, arguments);
+   return SdResult_SUCCESS;
+}
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_ListToVector)
+   if (a_type == SdType_LIST || a_type == SdType_MUTALIST) {
+      *out_return = SdVector_FromList(self->env, SdValue_GetList(a_val));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_VectorLength)
+   if (a_type == SdType_VECTOR) {
+      *out_return = SdEnv_BoxInt(self->env, (int)SdVector_Count(a_val));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_VectorGetAt)
+   SdUnreferenced(self);
+   if (a_type == SdType_VECTOR && b_type == SdType_INT) {
+      int b_int = SdValue_GetInt(b_val);
+      if (b_int < 0 || (size_t)b_int >= SdVector_Count(a_val))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      *out_return = SdVector_GetAt(a_val, b_int);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_VectorSetAt)
+   if (a_type == SdType_VECTOR && b_type == SdType_INT) {
+      int b_int = SdValue_GetInt(b_val);
+      if (b_int < 0 || (size_t)b_int >= SdVector_Count(a_val))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      *out_return = SdVector_SetAt(self->env, a_val, b_int, c_val);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_VectorAppend)
+   if (a_type == SdType_VECTOR) {
+      *out_return = SdVector_Append(self->env, a_val, b_val);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_VectorSlice)
+   if (a_type == SdType_VECTOR && b_type == SdType_INT && c_type == SdType_INT) {
+      int b_int = SdValue_GetInt(b_val), c_int = SdValue_GetInt(c_val);
+      if (b_int < 0 || c_int < b_int || (size_t)c_int > SdVector_Count(a_val))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      *out_return = SdVector_Slice(self->env, a_val, b_int, c_int);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_VectorToList)
+   if (a_type == SdType_VECTOR) {
+      SdList* list = SdVector_ToList(a_val);
+      SdList_MakeReadOnly(list);
+      *out_return = SdEnv_BoxList(self->env, list);
+   }
+SdEngine_INTRINSIC_END
+
+static SdResult SdEngine_Intrinsic_Hashmap(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdValue_r map = NULL;
+   size_t i = 0, count = 0;
+
+   SdAssert(arguments);
+   count = SdList_Count(arguments);
+   if (count % 2 != 0)
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "Expected alternating keys and values.");
+
+   map = SdHashmap_NewEmpty(self->env);
+   for (i = 0; i < count; i += 2)
+      map = SdHashmap_Set(self->env, map, SdList_GetAt(arguments, i), SdList_GetAt(arguments, i + 1));
+   *out_return = map;
+   return SdResult_SUCCESS;
+}
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_HashmapCount)
+   if (a_type == SdType_HASHMAP) {
+      *out_return = SdEnv_BoxInt(self->env, (int)SdHashmap_Count(a_val));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_HashmapGet)
+   if (a_type == SdType_HASHMAP) {
+      SdValue_r value = SdHashmap_Get(a_val, b_val);
+      *out_return = value ? value : SdEnv_BoxNil(self->env);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_HashmapHas)
+   if (a_type == SdType_HASHMAP) {
+      *out_return = SdEnv_BoxBool(self->env, SdHashmap_Get(a_val, b_val) != NULL);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_HashmapSet)
+   if (a_type == SdType_HASHMAP) {
+      *out_return = SdHashmap_Set(self->env, a_val, b_val, c_val);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_HashmapRemove)
+   if (a_type == SdType_HASHMAP) {
+      *out_return = SdHashmap_Remove(self->env, a_val, b_val);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_HashmapToList)
+   if (a_type == SdType_HASHMAP) {
+      SdList* pairs = SdHashmap_ToList(self->env, a_val);
+      SdList_MakeReadOnly(pairs);
+      *out_return = SdEnv_BoxList(self->env, pairs);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_SharedMap)
+   if (a_type == SdType_STRING) {
+      SdSharedMapBinding_r binding = SdEngine_FindSharedMap(self, SdValue_GetString(a_val));
+      if (!binding) { /* nothing attached by the host under this name, so the map is private to this instance */
+         SdSharedMap* map = SdSharedMap_New();
+         SdEngine_BindSharedMap(self, SdSharedValue_CopyString(SdValue_GetString(a_val)), map);
+         SdSharedMap_Delete(map);
+         binding = SdEngine_FindSharedMap(self, SdValue_GetString(a_val));
+      }
+      *out_return = SdEnv_BoxSharedMap(self->env, binding->map);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_SharedMapGet)
+   if (a_type == SdType_SHARED_MAP) {
+      SdSharedValue value;
+      SdSharedMap_Get(SdValue_GetSharedMap(a_val), b_val, &value);
+      *out_return = SdSharedValue_Box(self->env, &value);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_SharedMapSet)
+   SdUnreferenced(self);
+   if (a_type == SdType_SHARED_MAP) {
+      if (!SdSharedValue_CanStore(b_val) || !SdSharedValue_CanStore(c_val))
+         return SdFail(SdErr_TYPE_MISMATCH, "Only nil, ints, doubles, bools, and strings can be shared.");
+      SdSharedMap_Set(SdValue_GetSharedMap(a_val), b_val, c_val);
+      *out_return = c_val;
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_SharedMapAdd)
+   if (a_type == SdType_SHARED_MAP) {
+      if (!SdSharedValue_CanStore(b_val))
+         return SdFail(SdErr_TYPE_MISMATCH, "Only nil, ints, doubles, bools, and strings can be shared.");
+      *out_return = SdEnv_BoxBool(self->env, SdSharedMap_Add(SdValue_GetSharedMap(a_val), b_val));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_SharedMapIncrement)
+   if (a_type == SdType_SHARED_MAP && c_type == SdType_INT) {
+      int count = 0;
+      if (!SdSharedValue_CanStore(b_val))
+         return SdFail(SdErr_TYPE_MISMATCH, "Only nil, ints, doubles, bools, and strings can be shared.");
+      if (SdFailed(result = SdSharedMap_Increment(SdValue_GetSharedMap(a_val), b_val, SdValue_GetInt(c_val), &count)))
+         return result;
+      *out_return = SdEnv_BoxInt(self->env, count);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_SharedMapCount)
+   if (a_type == SdType_SHARED_MAP) {
+      *out_return = SdEnv_BoxInt(self->env, (int)SdSharedMap_Count(SdValue_GetSharedMap(a_val)));
+   }
+SdEngine_INTRINSIC_END
+
+static SdResult SdEngine_Intrinsic_IntArray(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdArray* array = NULL;
+   size_t i = 0, count = 0;
+
+   SdAssert(arguments);
+   count = SdList_Count(arguments);
+   array = SdArray_New(SdType_INT, count);
+   for (i = 0; i < count; i++) {
+      SdValue_r item = SdList_GetAt(arguments, i);
+      if (SdValue_Type(item) != SdType_INT) {
+         SdArray_Delete(array);
+         return SdFail(SdErr_TYPE_MISMATCH, "All arguments to int-array must be integers.");
+      }
+      SdArray_SetInt(array, i, SdValue_GetInt(item));
+   }
+   *out_return = SdEnv_BoxArray(self->env, array);
+   return SdResult_SUCCESS;
+}
+
+static SdResult SdEngine_Intrinsic_DoubleArray(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdArray* array = NULL;
+   size_t i = 0, count = 0;
+
+   SdAssert(arguments);
+   count = SdList_Count(arguments);
+   array = SdArray_New(SdType_DOUBLE, count);
+   for (i = 0; i < count; i++) {
+      SdValue_r item = SdList_GetAt(arguments, i);
+      if (SdValue_Type(item) != SdType_DOUBLE) {
+         SdArray_Delete(array);
+         return SdFail(SdErr_TYPE_MISMATCH, "All arguments to double-array must be doubles.");
+      }
+      SdArray_SetDouble(array, i, SdValue_GetDouble(item));
+   }
+   *out_return = SdEnv_BoxArray(self->env, array);
+   return SdResult_SUCCESS;
+}
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_IntArrayNew)
+   if (a_type == SdType_INT) {
+      if (SdValue_GetInt(a_val) < 0)
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Length must be non-negative.");
+      *out_return = SdEnv_BoxArray(self->env, SdArray_New(SdType_INT, SdValue_GetInt(a_val)));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_DoubleArrayNew)
+   if (a_type == SdType_INT) {
+      if (SdValue_GetInt(a_val) < 0)
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Length must be non-negative.");
+      *out_return = SdEnv_BoxArray(self->env, SdArray_New(SdType_DOUBLE, SdValue_GetInt(a_val)));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_ArrayLength)
+   if (a_type == SdType_INT_ARRAY || a_type == SdType_DOUBLE_ARRAY) {
+      *out_return = SdEnv_BoxInt(self->env, (int)SdArray_Count(SdValue_GetArray(a_val)));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_ArrayGetAt)
+   if ((a_type == SdType_INT_ARRAY || a_type == SdType_DOUBLE_ARRAY) && b_type == SdType_INT) {
+      SdArray_r a_array = SdValue_GetArray(a_val);
+      int b_int = SdValue_GetInt(b_val);
+      if (b_int < 0 || (size_t)b_int >= SdArray_Count(a_array))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      if (a_type == SdType_INT_ARRAY)
+         *out_return = SdEnv_BoxInt(self->env, SdArray_GetInt(a_array, b_int));
+      else
+         *out_return = SdEnv_BoxDouble(self->env, SdArray_GetDouble(a_array, b_int));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS3(SdEngine_Intrinsic_ArraySetAt)
+   SdUnreferenced(self);
+   if ((a_type == SdType_INT_ARRAY && b_type == SdType_INT && c_type == SdType_INT) ||
+       (a_type == SdType_DOUBLE_ARRAY && b_type == SdType_INT && c_type == SdType_DOUBLE)) {
+      SdArray_r a_array = SdValue_GetArray(a_val);
+      int b_int = SdValue_GetInt(b_val);
+      if (b_int < 0 || (size_t)b_int >= SdArray_Count(a_array))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      if (a_type == SdType_INT_ARRAY)
+         SdArray_SetInt(a_array, b_int, SdValue_GetInt(c_val));
+      else
+         SdArray_SetDouble(a_array, b_int, SdValue_GetDouble(c_val));
+      *out_return = c_val;
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_ArrayAppend)
+   SdUnreferenced(self);
+   if (a_type == SdType_INT_ARRAY && b_type == SdType_INT) {
+      SdArray_AppendInt(SdValue_GetArray(a_val), SdValue_GetInt(b_val));
+      *out_return = b_val;
+   } else if (a_type == SdType_DOUBLE_ARRAY && b_type == SdType_DOUBLE) {
+      SdArray_AppendDouble(SdValue_GetArray(a_val), SdValue_GetDouble(b_val));
+      *out_return = b_val;
+   }
+SdEngine_INTRINSIC_END
+
+static SdResult SdEngine_ArrayElementwise(SdEngine_r self, SdList_r arguments, SdArrayOp op, SdValue_r* out_return) {
+   SdResult result = SdResult_SUCCESS;
+   SdValue_r a_val = NULL, b_val = NULL;
+   SdType a_type = SdType_NIL, b_type = SdType_NIL;
+   SdArray_r a_array = NULL, b_array = NULL;
+   size_t i = 0;
+
+   SdAssert(self);
+   SdAssert(arguments);
+   SdAssert(out_return);
+   if (SdFailed(result = SdEngine_Args2(arguments, &a_val, &a_type, &b_val, &b_type)))
+      return result;
+   if (a_type != b_type || (a_type != SdType_INT_ARRAY && a_type != SdType_DOUBLE_ARRAY))
+      return SdFail(SdErr_TYPE_MISMATCH, "Both arguments must be arrays of the same type.");
+
+   a_array = SdValue_GetArray(a_val);
+   b_array = SdValue_GetArray(b_val);
+   if (SdArray_Count(a_array) != SdArray_Count(b_array))
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "Both arrays must have the same length.");
+   if (op == SdArrayOp_DIVIDE && a_type == SdType_INT_ARRAY)
+      for (i = 0; i < SdArray_Count(b_array); i++)
+         if (SdFailed(result = SdEngine_CheckIntDivision(SdArray_GetInt(a_array, i), SdArray_GetInt(b_array, i))))
+            return result;
+
+   *out_return = SdEnv_BoxArray(self->env, SdArray_Elementwise(op, a_array, b_array));
+   return SdResult_SUCCESS;
+}
+
+static SdResult SdEngine_Intrinsic_ArrayAdd(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   return SdEngine_ArrayElementwise(self, arguments, SdArrayOp_ADD, out_return);
+}
+
+static SdResult SdEngine_Intrinsic_ArraySubtract(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   return SdEngine_ArrayElementwise(self, arguments, SdArrayOp_SUBTRACT, out_return);
+}
+
+static SdResult SdEngine_Intrinsic_ArrayMultiply(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   return SdEngine_ArrayElementwise(self, arguments, SdArrayOp_MULTIPLY, out_return);
+}
+
+static SdResult SdEngine_Intrinsic_ArrayDivide(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   return SdEngine_ArrayElementwise(self, arguments, SdArrayOp_DIVIDE, out_return);
+}
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_ArraySum)
+   if (a_type == SdType_INT_ARRAY)
+      *out_return = SdEnv_BoxInt(self->env, SdArray_SumInt(SdValue_GetArray(a_val)));
+   else if (a_type == SdType_DOUBLE_ARRAY)
+      *out_return = SdEnv_BoxDouble(self->env, SdArray_SumDouble(SdValue_GetArray(a_val)));
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_ArrayDot)
+   if (a_type == b_type && (a_type == SdType_INT_ARRAY || a_type == SdType_DOUBLE_ARRAY)) {
+      SdArray_r a_array = SdValue_GetArray(a_val);
+      SdArray_r b_array = SdValue_GetArray(b_val);
+      if (SdArray_Count(a_array) != SdArray_Count(b_array))
+         return SdFail(SdErr_ARGUMENT_MISMATCH, "Both arrays must have the same length.");
+      if (a_type == SdType_INT_ARRAY)
+         *out_return = SdEnv_BoxInt(self->env, SdArray_DotInt(a_array, b_array));
+      else
+         *out_return = SdEnv_BoxDouble(self->env, SdArray_DotDouble(a_array, b_array));
+   }
+SdEngine_INTRINSIC_END
+
+static SdResult SdEngine_ArrayExtreme(SdEngine_r self, SdList_r arguments, SdBool is_max, SdValue_r* out_return) {
+   SdResult result = SdResult_SUCCESS;
+   SdValue_r a_val = NULL;
+   SdType a_type = SdType_NIL;
+   SdArray_r a_array = NULL;
+
+   SdAssert(self);
+   SdAssert(arguments);
+   SdAssert(out_return);
+   if (SdFailed(result = SdEngine_Args1(arguments, &a_val, &a_type)))
+      return result;
+   if (a_type != SdType_INT_ARRAY && a_type != SdType_DOUBLE_ARRAY)
+      return SdFail(SdErr_TYPE_MISMATCH, "Argument must be an array.");
+
+   a_array = SdValue_GetArray(a_val);
+   if (SdArray_Count(a_array) == 0)
+      *out_return = SdEnv_BoxNil(self->env);
+   else if (a_type == SdType_INT_ARRAY)
+      *out_return = SdEnv_BoxInt(self->env, SdArray_ExtremeInt(a_array, is_max));
+   else
+      *out_return = SdEnv_BoxDouble(self->env, SdArray_ExtremeDouble(a_array, is_max));
+   return SdResult_SUCCESS;
+}
+
+static SdResult SdEngine_Intrinsic_ArrayMin(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   return SdEngine_ArrayExtreme(self, arguments, SdFalse, out_return);
+}
+
+static SdResult SdEngine_Intrinsic_ArrayMax(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   return SdEngine_ArrayExtreme(self, arguments, SdTrue, out_return);
+}
+
+#define SdEngine_INTRINSIC_DOUBLE_ARRAY1(name, func) \
+   SdEngine_INTRINSIC_START_ARGS1(name) \
+   if (a_type == SdType_DOUBLE_ARRAY) { \
+      *out_return = SdEnv_BoxArray(self->env, SdArray_MapDouble(SdValue_GetArray(a_val), func)); \
+   } \
+   SdEngine_INTRINSIC_END
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArraySin, sin)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayCos, cos)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayTan, tan)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayASin, asin)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayACos, acos)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayATan, atan)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArraySinH, sinh)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayCosH, cosh)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayTanH, tanh)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayExp, exp)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayLog, log)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayLog10, log10)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArraySqrt, sqrt)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayCeil, ceil)
+SdEngine_INTRINSIC_DOUBLE_ARRAY1(SdEngine_Intrinsic_ArrayFloor, floor)
+
+static SdResult SdEngine_Intrinsic_Clock(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdAssert(self);
+   SdAssert(arguments);
+   SdAssert(out_return);
+   if (SdList_Count(arguments) != 0)
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "Expected 0 arguments.");
+   *out_return = SdEnv_BoxDouble(self->env, (double)clock() / (double)CLOCKS_PER_SEC);
+   return SdResult_SUCCESS;
+}
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StreamMap)
+   if (a_type == SdType_FUNCTION && SdStream_IsStreamable(b_val))
+      *out_return = SdStream_AddStage(self->env, b_val, SdStreamStage_MAP, a_val);
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StreamFilter)
+   if (a_type == SdType_FUNCTION && SdStream_IsStreamable(b_val))
+      *out_return = SdStream_AddStage(self->env, b_val, SdStreamStage_FILTER, a_val);
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StreamTake)
+   if (a_type == SdType_INT && SdStream_IsStreamable(b_val))
+      *out_return = SdStream_AddStage(self->env, b_val, SdStreamStage_TAKE, a_val);
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StreamSkip)
+   if (a_type == SdType_INT && SdStream_IsStreamable(b_val))
+      *out_return = SdStream_AddStage(self->env, b_val, SdStreamStage_SKIP, a_val);
+SdEngine_INTRINSIC_END
+
+/* folds the stream from the left. an empty stream reduces to nil, and an error in the stream is returned as is. */
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_StreamReduce)
+   if (a_type == SdType_FUNCTION && SdStream_IsStreamable(b_val)) {
+      SdIterator iterator;
+      SdList* reducer_arguments = NULL;
+      SdList_r state = NULL;
+      SdValue_r frame = NULL, state_value = NULL, value = NULL, next = NULL;
+
+      frame = SdEnv_Root_BottomFrame(SdEnv_Root(self->env));
+      if (SdFailed(result = SdEngine_Iterator_Begin(self, frame, b_val, &iterator)))
+         return result;
+
+      /* the running value isn't a stage argument, so it needs its own protection while the stages run */
+      state = SdList_NewWithLength(1);
+      state_value = SdEnv_BoxList(self->env, state);
+      SdEnv_PushProtectedValue(self->env, state_value);
+      reducer_arguments = SdList_New();
+
+      if (!SdFailed(result = SdEngine_Iterator_Next(&iterator, &value)) && value && 
+          SdValue_Type(value) != SdType_ERROR) {
+         SdList_SetAt(state, 0, value); /* the next pull overwrites the iterator's hold on it */
+         while (!SdFailed(result = SdEngine_Iterator_Next(&iterator, &next)) && next) {
+            if (SdValue_Type(next) == SdType_ERROR) {
+               value = next;
+               break;
+            }
+            SdList_Clear(reducer_arguments);
+            SdList_Append(reducer_arguments, value);
+            SdList_Append(reducer_arguments, next);
+            if (SdFailed(result = SdEngine_CallClosure(self, frame, a_val, reducer_arguments, &value)))
+               break;
+            SdList_SetAt(state, 0, value);
+         }
+      }
+
+      SdList_Delete(reducer_arguments);
+      SdEnv_PopProtectedValue(self->env);
+      SdEngine_Iterator_End(&iterator);
+      if (SdFailed(result))
+         return result;
+      *out_return = value ? value : SdEnv_BoxNil(self->env);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_StreamToList)
+   if (SdStream_IsStreamable(a_val)) {
+      SdIterator iterator;
+      SdList_r list = NULL;
+      SdValue_r list_value = NULL, value = NULL;
+
+      if (SdFailed(result = SdEngine_Iterator_Begin(self, SdEnv_Root_BottomFrame(SdEnv_Root(self->env)), a_val, 
+         &iterator)))
+         return result;
+      list = SdList_New();
+      list_value = SdEnv_BoxList(self->env, list);
+      SdEnv_PushProtectedValue(self->env, list_value);
+      while (!SdFailed(result = SdEngine_Iterator_Next(&iterator, &value)) && value)
+         SdList_Append(list, value);
+      SdEnv_PopProtectedValue(self->env);
+      SdEngine_Iterator_End(&iterator);
+      if (SdFailed(result))
+         return result;
+      *out_return = list_value;
+   }
+SdEngine_INTRINSIC_END
+
+/* (to-iterator xs) opens an Iterator over anything foreach accepts; (iterator.next! it) returns the next value, or nil 
+   at the end. to-stream uses them to turn a Stream back into a stream function. */
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_ToIterator)
+   if (SdStream_IsStreamable(a_val) && SdFailed(result = SdEngine_Iterator_Box(self, a_val, out_return)))
+      return result;
+SdEngine_INTRINSIC_END
+
+static SdResult SdEngine_Iterator_Box(SdEngine_r self, SdValue_r source, SdValue_r* out_return) {
+   SdResult result = SdResult_SUCCESS;
+   SdIterator* iterator = NULL;
+
+   SdAssert(self);
+   SdAssert(source);
+   SdAssert(out_return);
+
+   iterator = SdAlloc(sizeof(SdIterator));
+   if (SdFailed(result = SdEngine_Iterator_Begin(self, SdEnv_Root_BottomFrame(SdEnv_Root(self->env)), source, 
+      iterator))) {
+      SdFree(iterator);
+      return result;
+   }
+   /* from here on the Iterator value keeps the roots reachable */
+   *out_return = SdEnv_BoxIterator(self->env, iterator);
+   SdEnv_PopProtectedValue(self->env);
+   return SdResult_SUCCESS;
+}
+
+/* (... low high) is the integers from low to high inclusive, and (... low) counts up from low without end */
+static SdResult SdEngine_Intrinsic_Range(SdEngine_r self, SdList_r arguments, SdValue_r* out_return) {
+   SdValue_r low = NULL, high = NULL;
+   size_t count = 0;
+
+   SdAssert(arguments);
+   count = SdList_Count(arguments);
+   if (count != 1 && count != 2)
+      return SdFail(SdErr_ARGUMENT_MISMATCH, "Wrong number of arguments to ...");
+   low = SdList_GetAt(arguments, 0);
+   high = count == 2 ? SdList_GetAt(arguments, 1) : NULL;
+   if (SdValue_Type(low) != SdType_INT || (high && SdValue_Type(high) != SdType_INT))
+      return SdFail(SdErr_TYPE_MISMATCH, "All arguments to ... must be integers.");
+   *out_return = SdEnv_BoxRange(self->env, SdValue_GetInt(low), high ? SdValue_GetInt(high) : INT_MAX);
+   return SdResult_SUCCESS;
+}
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_RangeLength)
+   if (a_type == SdType_RANGE) {
+      size_t count = SdRange_Count(SdValue_GetRange(a_val));
+      if (count > INT_MAX)
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "The range is too long to count.");
+      *out_return = SdEnv_BoxInt(self->env, (int)count);
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS2(SdEngine_Intrinsic_RangeGetAt)
+   if (a_type == SdType_RANGE && b_type == SdType_INT) {
+      SdRange range = SdValue_GetRange(a_val);
+      int b_int = SdValue_GetInt(b_val);
+      if (b_int < 0 || (size_t)b_int >= SdRange_Count(range))
+         return SdFail(SdErr_ARGUMENT_OUT_OF_RANGE, "Index is out of range.");
+      *out_return = SdEnv_BoxInt(self->env, (int)((unsigned int)range.low + (unsigned int)b_int));
+   }
+SdEngine_INTRINSIC_END
+
+SdEngine_INTRINSIC_START_ARGS1(SdEngine_Intrinsic_IteratorNext)
+   if (a_type == SdType_ITERATOR) {
+      SdValue_r value = NULL;
+
+      if (SdFailed(result = SdEngine_Iterator_Next(SdValue_GetIterator(a_val), &value)))
+         return result;
+      *out_return = value ? value : SdEnv_BoxNil(self->env);
+   }
+SdEngine_INTRINSIC_END
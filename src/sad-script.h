@@ -54,6 +54,8 @@ typedef struct SdValue_s SdValue;
 typedef struct SdValue_s* SdValue_r;
 typedef struct SdList_s SdList;
 typedef struct SdList_s* SdList_r;
+typedef struct SdSharedMap_s SdSharedMap;
+typedef struct SdSharedMap_s* SdSharedMap_r;
 
 /* Data Structures ***************************************************************************************************/
 typedef enum SdErr_e {
@@ -81,24 +83,41 @@ typedef enum SdType_e {
    SdType_FUNCTION = 7, /* really a list */
    SdType_ERROR = 8, /* really a list */
    SdType_TYPE = 9, /* really an integer */
-   SdType_ANY = 10 /* can't create a value of this type; exists only for pattern matching*/
+   SdType_ANY = 10, /* can't create a value of this type; exists only for pattern matching*/
+   SdType_VECTOR = 11, /* really a list */
+   SdType_HASHMAP = 12, /* really a list */
+   SdType_INT_ARRAY = 13,
+   SdType_DOUBLE_ARRAY = 14,
+   SdType_STREAM = 15, /* really a list */
+   SdType_ITERATOR = 16,
+   SdType_RANGE = 17,
+   SdType_SHARED_MAP = 18
 } SdType;
 
 struct SdResult_s {
    SdErr code;
 };
 
+/* Receives text written by print. It is called with large pieces of buffered output rather than once per print. */
+typedef void (*SdOutputSink)(void* context, const char* chars, size_t length);
+
 /* SdResult ***********************************************************************************************************/
 SdBool         SdFailed(SdResult result);
-const char*    SdGetLastFailMessage(void);
+const char*    SdGetLastFailMessage(void); /* of the last failure on the calling thread */
 
 /* Sad ***************************************************************************************************************/
+/* Separate instances may run on separate threads at the same time, unless built with SD_NO_THREADS. Each instance must
+   only be used by one thread at a time, and the values it creates stay within it. */
 SdErr          SdRunScript(const char* prelude_file_path, const char* script_code);
 
 Sad*           Sad_New(void);
 void           Sad_Delete(Sad* self);
 SdResult       Sad_AddScript(Sad_r self, const char* code);
 SdResult       Sad_Execute(Sad_r self);
+void           Sad_SetOutputSink(Sad_r self, SdOutputSink sink, void* context); /* null sink for stdout (default) */
+void           Sad_SetOutputBufferSize(Sad_r self, size_t size); /* 0 to write each print through immediately */
+void           Sad_Flush(Sad_r self);
+void           Sad_SetSharedMap(Sad_r self, const char* name, SdSharedMap_r map); /* (shared-map name) returns it */
 
 /* SdString **********************************************************************************************************/
 SdString*      SdString_New(void);
@@ -109,6 +128,8 @@ SdBool         SdString_Equals(SdString_r a, SdString_r b);
 SdBool         SdString_EqualsCStr(SdString_r a, const char* b);
 size_t         SdString_Length(SdString_r self);
 int            SdString_Compare(SdString_r a, SdString_r b);
+SdString*      SdString_Concat(SdString_r a, SdString_r b);
+SdString*      SdString_Substring(SdString_r self, size_t start, size_t length);
 
 /* SdValue ***********************************************************************************************************/
 SdType         SdValue_Type(SdValue_r self);
@@ -119,13 +140,17 @@ SdString_r     SdValue_GetString(SdValue_r self);
 SdList_r       SdValue_GetList(SdValue_r self);
 SdBool         SdValue_Equals(SdValue_r a, SdValue_r b);
 int            SdValue_Hash(SdValue_r self);
+SdResult       SdValue_Compare(SdValue_r a, SdValue_r b, int* out_order);
 
 /* SdList ************************************************************************************************************/
 SdList*        SdList_New(void);
 SdList*        SdList_NewWithLength(size_t length);
+SdList*        SdList_NewWithCapacity(size_t capacity);
 void           SdList_Delete(SdList* self);
 void           SdList_MakeReadOnly(SdList_r self);
 SdBool         SdList_IsReadOnly(SdList_r self);
+void           SdList_Reserve(SdList_r self, size_t capacity);
+size_t         SdList_Capacity(SdList_r self);
 void           SdList_Append(SdList_r self, SdValue_r item);
 void           SdList_SetAt(SdList_r self, size_t index, SdValue_r item);
 void           SdList_InsertAt(SdList_r self, size_t index, SdValue_r item);
@@ -136,6 +161,13 @@ void           SdList_Clear(SdList_r self);
 SdBool         SdList_Equals(SdList_r a, SdList_r b);
 SdList*        SdList_Clone(SdList_r self);
 
+/* SdSharedMap *******************************************************************************************************/
+/* A table of plain values that several Sad instances can read and update with the shared-map.* intrinsics, from
+   separate threads at the same time. It is freed once the host and every instance it is attached to let go of it. */
+SdSharedMap*   SdSharedMap_New(void);
+void           SdSharedMap_Delete(SdSharedMap* self); /* lets go of the host's reference */
+size_t         SdSharedMap_Count(SdSharedMap_r self);
+
 /* SdFile ************************************************************************************************************/
 SdResult       SdFile_WriteAllText(SdString_r file_path, SdString_r text);
 SdResult       SdFile_ReadAllText(SdString_r file_path, SdString** out_text);